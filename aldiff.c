@@ -12,6 +12,9 @@
 #include "collection_main.h"
 #include "print_main.h"
 #include "dump_main.h"
+#include "fold_main.h"
+#include "rateless_main.h"
+#include "serve_main.h"
 #include "ketopt.h"
 #include "err.h"
 
@@ -47,8 +50,20 @@ int main(int argc, char** argv) {
         error_code = build_main(argc - om.ind, &argv[om.ind]);
     } else if (strcmp(argv[om.ind], "diff") == 0) {
         error_code = diff_main(argc - om.ind, &argv[om.ind]);
+    } else if (strcmp(argv[om.ind], "fold") == 0) {
+        error_code = fold_main(argc - om.ind, &argv[om.ind]);
+    } else if (strcmp(argv[om.ind], "encode") == 0) {
+        error_code = encode_main(argc - om.ind, &argv[om.ind]);
+    } else if (strcmp(argv[om.ind], "decode") == 0) {
+        error_code = decode_main(argc - om.ind, &argv[om.ind]);
     } else if (strcmp(argv[om.ind], "list") == 0) {
         error_code = list_main(argc - om.ind, &argv[om.ind]);
+    } else if (strcmp(argv[om.ind], "difflist") == 0) {
+        error_code = difflist_main(argc - om.ind, &argv[om.ind]);
+    } else if (strcmp(argv[om.ind], "serve") == 0) {
+        error_code = serve_main(argc - om.ind, &argv[om.ind]);
+    } else if (strcmp(argv[om.ind], "reconcile") == 0) {
+        error_code = reconcile_main(argc - om.ind, &argv[om.ind]);
     } else if (strcmp(argv[om.ind], "jaccard") == 0) {
         error_code = jaccard_main(argc - om.ind, &argv[om.ind]);
     } else if (strcmp(argv[om.ind], "collection") == 0) {
@@ -86,7 +101,13 @@ void print_subcommands() {
     fprintf(stderr, "\tsample\tsample sequences\n");
     fprintf(stderr, "\tbuild\tInvertible Bloom Filter construction\n");
     fprintf(stderr, "\tdiff\tcompute difference between two Invertible Bloom Filters\n");
+    fprintf(stderr, "\tfold\tshrink a foldable Invertible Bloom Filter (build -F) to track fewer differences\n");
+    fprintf(stderr, "\tencode\tencode a set as a prefix of its stream of rateless coded symbols\n");
+    fprintf(stderr, "\tdecode\tdecode the difference of two streams of rateless coded symbols\n");
     fprintf(stderr, "\tlist\ttry to list the content of an Invertible Bloom Filter\n");
+    fprintf(stderr, "\tdifflist\tlist the difference of two Invertible Bloom Filters without storing it (diff + list)\n");
+    fprintf(stderr, "\tserve\tkeep a reference Invertible Bloom Filter in memory and answer reconcile queries on a socket\n");
+    fprintf(stderr, "\treconcile\tsend an Invertible Bloom Filter to serve and print the difference, a summary or the jaccard\n");
     fprintf(stderr, "\tjaccard\tcompute jaccard similarity between two Invertible Bloom Filters\n");
     fprintf(stderr, "\tcollection\tbuild an IBF storing a collection of minHash sketches\n");
     fprintf(stderr, "\tcount\tcount elements inside IBF\n");
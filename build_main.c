@@ -1,15 +1,23 @@
 #include "build_main.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ketopt.h"
 #include "constants.h"
 #include "ibflib.h"
+#include "shard.h"
+#include "stats.h"
 
 #include <assert.h>
 
+#define BATCH_KEYS 4096 /*lines are parsed in batches, then inserted, so that the two phases can be timed separately*/
+#define BATCH_BYTES (BATCH_KEYS * 64)
+
 int check_build_args(unsigned int n, unsigned char r, float e, char *opath);
 void print_build_help();
+static int insert_batch(char const *kmers, uint32_t const *ends, uint32_t nkeys, ibf_t *ibf, uint32_t nsketches, FILE *spill, sharded_t *sharded, unsigned int threads, uint8_t *ibfbuf, uint64_t blen);
+static char *multi_path(char const *output_path, uint32_t n, uint32_t seed, unsigned char by_n, unsigned char by_seed);
 
 /*
  * Construction algorithm for an IBF built on a set of k-mers.
@@ -17,23 +25,35 @@ void print_build_help();
  * Each k-mer must be at the beginning of a line.
  */
 enum Error build_main(int argc, char *argv[]) {
-    FILE *fp;
+    FILE *fp, *spill;
     char *output_path;
     int c, i, err;
     unsigned char r, l;
+    uint8_t hash_family;
     unsigned int n, s;
+    uint32_t block_width;
+    unsigned char foldable;
     long parsed;
     float e;
     ketopt_t opt;
     char* kmer;
+    uint32_t *ends, nkeys, used;
     uint8_t *ibfbuf;
-    uint64_t blen;
+    uint64_t blen, memory;
     ibf_t ibf;
+    sharded_t sharded_ibf, *sharded;
+    long shards;
+    char *resize;
+    uint32_t *which, nwhich, si;
+    unsigned int threads;
+    ibf_t *multi;
+    uint32_t *ns, *seeds, nn, nseeds, nsketches;
+    char *path;
 
     assert(argv != NULL);
 
     opt = KETOPT_INIT;
-    fp = NULL;
+    fp = spill = NULL;
     output_path = NULL;
     r = 3;
     n = 0;
@@ -41,12 +61,25 @@ enum Error build_main(int argc, char *argv[]) {
     e = 0;
     err = NO_ERROR;
     kmer = NULL;
+    ends = NULL;
     ibfbuf = NULL;
-    blen = 0;
+    blen = memory = 0;
     l = 0;
+    hash_family = IBF_HASH_MURMUR3;
+    block_width = 0;
+    foldable = FALSE;
+    sharded = NULL;
+    shards = -1;
+    resize = NULL;
+    which = NULL;
+    nwhich = 0;
+    threads = 1;
+    multi = NULL;
+    ns = seeds = NULL;
+    nn = nseeds = 1;
 
-    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
-    while((c = ketopt(&opt, argc, argv, 1, "i:o:n:r:e:s:l:h", longopts)) >= 0) {
+    static ko_longopt_t longopts[] = {{"hugepages", ko_no_argument, LONGOPT_HUGEPAGES}, {"stats", ko_no_argument, LONGOPT_STATS}, {"memory", ko_required_argument, LONGOPT_MEMORY}, {"shards", ko_required_argument, LONGOPT_SHARDS}, {"resize", ko_required_argument, LONGOPT_RESIZE}, {NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:o:n:r:e:s:l:H:B:t:Fh", longopts)) >= 0) {
         if (c == 'i') {
             if ((fp = fopen(opt.arg, "r")) == NULL) {
                 fprintf(stderr, "Unable to open the input file\n");
@@ -67,12 +100,13 @@ enum Error build_main(int argc, char *argv[]) {
             }
             l = (unsigned char)parsed;
         } else if (c == 'n') {
-            parsed = strtol(opt.arg, NULL, 10);
-            if (parsed > (unsigned int)-1) {
+            free(ns);
+            if (parse_u32_list(opt.arg, &ns, &nn) != NO_ERROR) {
                 fprintf(stderr, "Unable to parse option %c\n", c);
+                free(ns);
                 return ERR_OUTOFBOUNDS;
             }
-            n = (unsigned int)parsed;
+            for(si = 0, n = ns[0]; si < nn; ++si) if (ns[si] == 0) n = 0;
         } else if (c == 'r') {
             parsed = strtol(opt.arg, NULL, 10);
             if (parsed > (unsigned char)-1) {
@@ -83,12 +117,43 @@ enum Error build_main(int argc, char *argv[]) {
         } else if (c == 'e') {
             e = atof(opt.arg);
         } else if (c == 's') {
+            free(seeds);
+            if (parse_u32_list(opt.arg, &seeds, &nseeds) != NO_ERROR) {
+                fprintf(stderr, "Unable to parse option %c\n", c);
+                free(seeds);
+                return ERR_OUTOFBOUNDS;
+            }
+            s = seeds[0];
+        } else if (c == 'H') {
+            if (ibf_hash_family_parse(opt.arg, &hash_family) != NO_ERROR) {
+                fprintf(stderr, "Unknown hash family %s\n", opt.arg);
+                return ERR_OPTION;
+            }
+        } else if (c == 'B') {
             parsed = strtol(opt.arg, NULL, 10);
-            if (parsed > (unsigned int)-1) {
+            if (parsed < 0 || parsed > (uint32_t)-1) {
                 fprintf(stderr, "Unable to parse option %c\n", c);
                 return ERR_OUTOFBOUNDS;
             }
-            s = (unsigned int)parsed;
+            block_width = (uint32_t)parsed;
+        } else if (c == 'F') {
+            foldable = TRUE;
+        } else if (c == LONGOPT_HUGEPAGES) {
+            ibf_set_alloc_policy(IBF_ALLOC_HUGEPAGES);
+        } else if (c == LONGOPT_STATS) {
+            stats_enable("build");
+        } else if (c == LONGOPT_MEMORY) {
+            memory = strtoull(opt.arg, NULL, 10) << 20;
+        } else if (c == LONGOPT_SHARDS) {
+            shards = strtol(opt.arg, NULL, 10);
+            if (shards < 0 || shards > (uint32_t)-1) {
+                fprintf(stderr, "Unable to parse option --shards\n");
+                return ERR_OUTOFBOUNDS;
+            }
+        } else if (c == LONGOPT_RESIZE) {
+            resize = opt.arg;
+        } else if (c == 't') {
+            threads = (unsigned int)strtoul(opt.arg, NULL, 10);
         } else if (c == 'h') {
             print_build_help();
             /*if (output_path != NULL) free(output_path);*/
@@ -100,21 +165,76 @@ enum Error build_main(int argc, char *argv[]) {
         }
     }
     if (!check_build_args(n, r, e, output_path)) return ERR_OPTION;
+    if (foldable && block_width != 0) {
+        fprintf(stderr, "Options -F and -B are mutually exclusive\n");
+        return ERR_OPTION;
+    }
+    for(si = 0; block_width != 0 && si < nn; ++si) {
+        if (block_width < ibf_blocked_min_width(r, e, ns[si])) {
+            fprintf(stderr, "Blocks of %u cells need more than %d times the buckets of the classic layout for n = %u, the narrowest accepted is -B %u\n", block_width, BLOCKED_MAX_EXPANSION, ns[si], ibf_blocked_min_width(r, e, ns[si]));
+            return ERR_OUTOFBOUNDS;
+        }
+    }
+    nsketches = nn * nseeds;
+    if (nsketches > 1 && (memory != 0 || shards >= 0 || resize != NULL)) {
+        fprintf(stderr, "Several sketches (lists of -n or -s) are built in memory, without --memory, --shards or --resize\n");
+        return ERR_OPTION;
+    }
+    if (resize != NULL && shards < 0) shards = 0;/*the number of shards is the one of the file*/
+    if (shards >= 0 && (foldable || block_width != 0 || memory != 0)) {
+        fprintf(stderr, "Sharded sketches are built in memory with the classic layout (no -F, -B or --memory)\n");
+        return ERR_OPTION;
+    }
+    if (resize != NULL && parse_u32_list(resize, &which, &nwhich) != NO_ERROR) {
+        fprintf(stderr, "Unable to parse the shards to be resized\n");
+        free(which);
+        return ERR_OPTION;
+    }
     if(fp == NULL) fp = stdin;
 
+    if (err == NO_ERROR && shards >= 0) {/*keys routed to independent cache-sized sketches*/
+        sharded = &sharded_ibf;
+        if (resize != NULL) err = sharded_resize_init(output_path, which, nwhich, s, r, e, hash_family, sharded);
+        else {
+            if (shards == 0 && (err = shard_count(r, e, n, SHARD_CACHE_BYTES, &nwhich)) == NO_ERROR) shards = nwhich;
+            if (err == NO_ERROR) err = sharded_init((uint32_t)shards, s, r, e, n, hash_family, sharded);
+            if (err == NO_ERROR) fprintf(stderr, "[build] %ld shards of %llu differences each\n", shards, (unsigned long long)sharded->dir.n[0]);
+        }
+        if (err == ERR_INCOMPATIBLE) fprintf(stderr, "Unable to resize %s: different seed\n", output_path);
+        else if (err == ERR_OUTOFBOUNDS) fprintf(stderr, "Unable to resize %s: no such shard or too large\n", output_path);
+        else print_error(err, "sharded sketch init");
+    }
     if (err == NO_ERROR) {
         err = ibf_buffer_init(&ibfbuf);
         blen = WSIZE;
         print_error(err, "buffer init");
     }
-    if (err == NO_ERROR) {
-        err = ibf_sketch_init(s, r, e, n, &ibf);
+    if (err == NO_ERROR && nsketches > 1) {/*one pass over the keys for all of them, seed by seed so that sketches sharing their hashes follow each other*/
+        if ((multi = (ibf_t*)calloc(nsketches, sizeof(ibf_t))) == NULL) err = ERR_ALLOC;
+        for(si = 0; si < nsketches && err == NO_ERROR; ++si) {
+            n = ns[si % nn];
+            s = seeds ? seeds[si / nn] : s;
+            if (foldable) err = ibf_sketch_init_foldable(s, r, e, n, &multi[si]);
+            else err = ibf_sketch_init_blocked(s, r, e, n, block_width, &multi[si]);
+            if (err == NO_ERROR) err = ibf_sketch_set_hash(&multi[si], hash_family);
+        }
         print_error(err, "sketch init");
+    } else if (err == NO_ERROR && sharded == NULL) {
+        if (memory != 0) err = ibf_sketch_shape(s, r, e, n, block_width, foldable, &ibf);/*buckets allocated window by window when storing*/
+        else if (foldable) err = ibf_sketch_init_foldable(s, r, e, n, &ibf);
+        else err = ibf_sketch_init_blocked(s, r, e, n, block_width, &ibf);
+        if (err == NO_ERROR) err = ibf_sketch_set_hash(&ibf, hash_family);
+        print_error(err, "sketch init");
+    }
+    if (err == NO_ERROR && memory != 0 && (spill = tmpfile()) == NULL) {
+        err = ERR_FILE;
+        print_error(err, "spill file creation");
     }
 
     if (err == NO_ERROR) {
-        kmer = (char*)malloc(BUFSIZ);
-        if (kmer == NULL) {
+        kmer = (char*)malloc(BATCH_BYTES + BUFSIZ);
+        ends = (uint32_t*)malloc(BATCH_KEYS * sizeof *ends);
+        if (kmer == NULL || ends == NULL) {
             err = ERR_ALLOC;
             print_error(err, "kmer buffer allocation");
         }
@@ -124,36 +244,70 @@ enum Error build_main(int argc, char *argv[]) {
         fprintf(stderr, "seq,2bit,length,position,row,col\n");
 #endif
         i = 0;
+        used = nkeys = 0;
         #ifdef GLEN
         ibf.key_len = 0;
         #endif
+        stats_begin(STATS_PARSE);
         while((c = fgetc(fp)) != EOF && err == NO_ERROR) {
             switch (c) {
                 case '\n':
                     /*if (i != k) err = ERR_RUNTIME;*/
-                    if (err == NO_ERROR && i > 0) err = ibf_insert_seq(kmer, 0, i, &ibf, ibfbuf, blen);
+                    if (i > 0) ends[nkeys++] = used += i;
                     if (err == NO_ERROR && l != 0) if (i > l) err = ERR_VALUE;
                     #ifdef GLEN
                     if (ibf.key_len < i) ibf.key_len = i;
                     #endif
                     i = 0;
+                    if (err == NO_ERROR && (nkeys == BATCH_KEYS || used > BATCH_BYTES)) {
+                        stats_end(STATS_PARSE);
+                        err = multi ? insert_batch(kmer, ends, nkeys, multi, nsketches, spill, sharded, threads, ibfbuf, blen) : insert_batch(kmer, ends, nkeys, &ibf, 1, spill, sharded, threads, ibfbuf, blen);
+                        used = nkeys = 0;
+                        stats_begin(STATS_PARSE);
+                    }
                     break;
                 default:
-                    kmer[i++] = c; /*Ignore k-mers with non-genomic bases (ibf_insert_seq default behaviour)*/
+                    kmer[used + i++] = c; /*Ignore k-mers with non-genomic bases (ibf_insert_seq default behaviour)*/
             }
             
         }
+        stats_end(STATS_PARSE);
+        if (err == NO_ERROR) err = multi ? insert_batch(kmer, ends, nkeys, multi, nsketches, spill, sharded, threads, ibfbuf, blen) : insert_batch(kmer, ends, nkeys, &ibf, 1, spill, sharded, threads, ibfbuf, blen);
     }
 
     if (kmer) free(kmer);
+    if (ends) free(ends);
     if (ibfbuf) ibf_buffer_destroy(&ibfbuf);
+    if (which) free(which);
     if (fp) fclose(fp);
     /*ibf_sketch_dump(&ibf, stderr);*/
+    #ifdef GLEN
+    for(si = 0; sharded && err == NO_ERROR && si < sharded->dir.count; ++si) sharded->shards[si].key_len = ibf.key_len;
+    for(si = 0; multi && err == NO_ERROR && si < nsketches; ++si) multi[si].key_len = ibf.key_len;
+    #endif
     if (err == NO_ERROR) {
-        err = ibf_sketch_store(output_path, &ibf);
+        stats_begin(STATS_STORE);
+        if (multi) {/*<output>.n<n> and/or .s<seed>*/
+            for(si = 0; err == NO_ERROR && si < nsketches; ++si) {
+                if ((path = multi_path(output_path, ns[si % nn], seeds ? seeds[si / nn] : s, nn > 1, nseeds > 1)) == NULL) err = ERR_ALLOC;
+                else err = ibf_sketch_store(path, &multi[si]);
+                free(path);
+            }
+        } else if (sharded) err = sharded_store(output_path, sharded, 0);/*shards not resized are copied*/
+        else if (spill) err = ibf_sketch_store_spilled(output_path, &ibf, spill, memory);/*one pass over the spilled keys per window*/
+        else err = ibf_sketch_store(output_path, &ibf);
+        stats_end(STATS_STORE);
         if (err != NO_ERROR) print_error(err, "IBF save");
     }
-    if (err == NO_ERROR) {
+    if (spill) fclose(spill);
+    stats_print(stderr);
+    free(ns);
+    free(seeds);
+    if (multi) {
+        for(si = 0; si < nsketches; ++si) ibf_sketch_destroy(&multi[si]);
+        free(multi);
+    } else if (sharded) sharded_destroy(sharded);
+    else if (err == NO_ERROR) {
         err = ibf_sketch_destroy(&ibf);
         if (err != NO_ERROR) print_error(err, "sketch destroy");
     }
@@ -161,6 +315,29 @@ enum Error build_main(int argc, char *argv[]) {
     return err;
 }
 
+/*insert the keys kmers[ends[j-1], ends[j]) of a batch (into their shards if sharded), or append them to the spill file if any*/
+static int insert_batch(char const *kmers, uint32_t const *ends, uint32_t nkeys, ibf_t *ibf, uint32_t nsketches, FILE *spill, sharded_t *sharded, unsigned int threads, uint8_t *ibfbuf, uint64_t blen) {
+    int err;
+    uint32_t j, start;
+    err = NO_ERROR;
+    stats_begin(STATS_INSERT);
+    if (sharded) err = sharded_insert_batch(sharded, kmers, ends, nkeys, threads);
+    else if (spill) for(j = 0, start = 0; j < nkeys && err == NO_ERROR; start = ends[j++]) err = ibf_spill_seq(spill, kmers, start, ends[j], ibfbuf, blen);
+    else if (nsketches > 1) for(j = 0, start = 0; j < nkeys && err == NO_ERROR; start = ends[j++]) err = ibf_insert_seq_multi(kmers, start, ends[j], ibf, nsketches, ibfbuf, blen);
+    else for(j = 0, start = 0; j < nkeys && err == NO_ERROR; start = ends[j++]) err = ibf_insert_seq(kmers, start, ends[j], ibf, ibfbuf, blen);
+    stats_end(STATS_INSERT);
+    return err;
+}
+
+static char *multi_path(char const *output_path, uint32_t n, uint32_t seed, unsigned char by_n, unsigned char by_seed) {
+    char *path;
+    if ((path = (char*)malloc(strlen(output_path) + 24)) == NULL) return NULL;
+    strcpy(path, output_path);
+    if (by_n) sprintf(path + strlen(path), ".n%u", n);
+    if (by_seed) sprintf(path + strlen(path), ".s%u", seed);
+    return path;
+}
+
 int check_build_args(unsigned int n, unsigned char r, float e, char *opath) {
     if(n == 0) {
         fprintf(stderr, "Unspecified n\n");
@@ -185,10 +362,19 @@ void print_build_help() {
     fprintf(stderr, "[build] options:\n");
     fprintf(stderr, "\t-i\tinput set of k-mers [stdin]\n");
     fprintf(stderr, "\t-o\tInvertible Bloom Filter file (binary output)\n");
-    fprintf(stderr, "\t-n\tnumber of differences to track (0 < n)\n");
+    fprintf(stderr, "\t-n\tnumber of differences to track (0 < n), a comma-separated list builds one sketch per value in a single pass, stored as <output>.n<n>\n");
     fprintf(stderr, "\t-r\tnumber of hash functions [3] (3 <= r <= 7)\n");
     fprintf(stderr, "\t-e\tepsilon [0] (0 <= epsilon)\n");
-    fprintf(stderr, "\t-s\trandom seed [42]\n");
+    fprintf(stderr, "\t-s\trandom seed [42], a comma-separated list builds one sketch per seed in the same pass, stored as <output>.s<seed>\n");
+    fprintf(stderr, "\t-H\thash family used to place keys: murmur3, mix64 (fastest for k <= 32), wyhash (wide keys) [murmur3]\n");
+    fprintf(stderr, "\t-B\tblocked layout: all buckets of a key fall in one block of r * B cells, 0 for the classic layout [0]\n");
+    fprintf(stderr, "\t-F\tfoldable layout: power-of-two chunk sizes, the sketch can be shrunk later with fold\n");
+    fprintf(stderr, "\t--shards\tsharded sketch: keys are routed by a hash prefix to this many independent sketches, built, diffed and peeled in parallel, 0 for shards of about %u KiB [no sharding]\n", SHARD_CACHE_BYTES >> 10);
+    fprintf(stderr, "\t--resize\trebuild the listed shards (comma-separated) of the sharded sketch -o for twice their differences, keeping the other ones (same options and input as its build)\n");
+    fprintf(stderr, "\t-t\tnumber of threads filling the shards of a sharded sketch [1]\n");
+    fprintf(stderr, "\t--memory\tout-of-core build: keys are spilled to a temporary file, then the sketch is built and written this many MiB of buckets at a time, one pass over the keys each [0: in memory]\n");
+    fprintf(stderr, "\t--hugepages\tback the sketch with huge pages (explicit if reserved, transparent otherwise)\n");
+    fprintf(stderr, "\t--stats\tprint run statistics (phase times, counters, peak memory) as JSON on stderr\n");
     fprintf(stderr, "\t-l\tmaximum length of input sequences, used for checking correctness\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }
@@ -1,4 +1,9 @@
 #include <sys/stat.h>
+#include <pthread.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <zlib.h>
 #include <stdio.h>
 
@@ -7,6 +12,9 @@
 #include "constants.h"
 #include "minHash.h"
 #include "ibflib.h"
+#include "murmur3.h"
+#include "endian_fixer.h"
+#include "stats.h"
 #include "collection_main.h"
 
 #include <assert.h>
@@ -30,13 +38,33 @@ typedef struct {
     uint64_t n;
     uint8_t r;
     float e;
+    uint32_t t; /* number of sketching threads */
     char *opath;
+    char *cache; /* folder of the on-disk sketch cache, NULL if not used */
     path_itr alice_start, alice_stop, bob_start, bob_stop;
 } param_t; /* Here ketopt.h is not used because we want to replicate the behaviour of Mash */
 
+typedef struct {
+    uint64_t mask;     /* capacity - 1, capacity is a power of two */
+    uint64_t *digests; /* 64-bit fingerprint of the sketch stored in each slot */
+    uint64_t *slots;   /* index + 1 of the sketch stored in each slot, 0 if empty */
+    uint8_t *buffer;   /* WSIZE scratch space used to zero-pad sketches before hashing them */
+} sketch_index_t; /* open addressing table of sketch fingerprints, full comparisons only when fingerprints match */
+
+typedef struct {
+    param_t const *opts;
+    path_itr paths;
+    minhash_t *sketches; /* sketches[i] is the sketch of paths[i], independently of the thread computing it */
+    uint64_t n;
+    uint64_t next;       /* next file to be sketched */
+    enum Error err;      /* first error encountered by any worker */
+    pthread_mutex_t lock;
+} sketch_pool_t;
+
 typedef struct {
     minhash_v_t *alice, *bob;
     uint8_t *dup_alice, *dup_bob;
+    sketch_index_t *idx_alice, *idx_bob;
 } callback_t;
 
 void print_collection_help();
@@ -45,7 +73,17 @@ static enum Error option_parser(int *opt_idx, char opt, char **arg, param_t *par
 enum Error parse_options(int argc, char *argv[], char const * const opt_string, enum Error (*parser)(int*, char, char**, param_t*), param_t *params);
 enum Error check_options(param_t const * const parameters);
 enum Error fill_minhash_sketch(param_t const * const opts, path_itr start, path_itr end, minhash_v_t * const mhdb);
-enum Error mark_duplicates(minhash_v_t const * const mhdb, uint8_t ** const duplicate);
+enum Error sketch_file(param_t const * const opts, char const * const path, minhash_t * const sketch);
+void sketch_cache_entry(param_t const * const opts, char const * const path, struct stat const * const st, char * const key, char * const entry);
+enum Error sketch_cache_load(char const * const entry, char const * const key, minhash_t * const sketch);
+enum Error sketch_cache_store(char const * const entry, char const * const key, minhash_t const * const sketch);
+void *sketch_worker(void *pool);
+enum Error mark_duplicates(minhash_v_t const * const mhdb, uint8_t ** const duplicate, sketch_index_t * const index);
+static inline void pad_sketch(minhash_t const * const sketch, uint8_t * const buffer);
+static inline uint64_t sketch_fingerprint(uint8_t const * const padded);
+enum Error sketch_index_init(uint64_t n, sketch_index_t * const index);
+void sketch_index_destroy(sketch_index_t * const index);
+uint64_t sketch_index_find(sketch_index_t const * const index, minhash_v_t const * const mhdb, uint8_t const * const padded, uint64_t digest);
 void get_sketches(bucket_t const * const bucket, char origin, void *callback_io);
 
 enum Error collection_main(int argc, char *argv[]) {
@@ -58,6 +96,8 @@ enum Error collection_main(int argc, char *argv[]) {
     uint8_t *ibfbuf;
     uint64_t buflen;
     ibf_t ibf_alice, ibf_bob, diff;
+    sketch_index_t index_alice, index_bob;
+    uint64_t digest, found;
     callback_t callback_io;
     assert(argv);
     err = 0;
@@ -69,7 +109,7 @@ enum Error collection_main(int argc, char *argv[]) {
     //dummy.hash_width = 0;/* suppress warning */
     init_options(&opts);
     // fprintf(stderr, "[Log] Begin\n");
-    if (!err) err = parse_options(argc, argv, "k:z:w:n:r:e:s:o:a:b:h", option_parser, &opts);
+    if (!err) err = parse_options(argc, argv, "k:z:w:n:r:e:s:t:c:o:a:b:h", option_parser, &opts);
     if (!err) err = check_options(&opts);
     if (err) return err;
 
@@ -80,18 +120,23 @@ enum Error collection_main(int argc, char *argv[]) {
     kv_init(bob);
     // fprintf(stderr, "index at position %llu after options\n", opts.opt_end);
     // fprintf(stderr, "k = %d, w = %d, s = %u, z = %llu\n", opts.k, opts.w, opts.s, opts.z);
+    stats_begin(STATS_HASH);
     if (!err) err = fill_minhash_sketch(&opts, opts.alice_start, opts.alice_stop, &alice);
     if (!err) err = fill_minhash_sketch(&opts, opts.bob_start, opts.bob_stop, &bob);
+    stats_end(STATS_HASH);
     /* Mark duplicate sketches */
     duplicate_alice = NULL;
     duplicate_bob = NULL;
-    if (!err) err = mark_duplicates(&alice, &duplicate_alice);
-    if (!err) err = mark_duplicates(&bob, &duplicate_bob);
+    memset(&index_alice, 0, sizeof index_alice);
+    memset(&index_bob, 0, sizeof index_bob);
+    if (!err) err = mark_duplicates(&alice, &duplicate_alice, &index_alice);
+    if (!err) err = mark_duplicates(&bob, &duplicate_bob, &index_bob);
     // fprintf(stderr, "[Log] duplicates marked\n");
     /* Insert sketches into IBF */
     if (!err) err = ibf_buffer_init(&ibfbuf);
     buflen = WSIZE;
     // fprintf(stderr, "----- WSIZE = %llu\n", buflen);
+    stats_begin(STATS_INSERT);
     if (!err) err = ibf_sketch_init(opts.s, opts.r, opts.e, opts.n, &ibf_alice);
     for(i = 0; !err && i < alice.n; ++i) {
         if (!duplicate_alice[i]) err = ibf_insert_seq(alice.a[i].hashes, 0, alice.a[i].size * alice.a[i].hash_width, &ibf_alice, ibfbuf, buflen);
@@ -100,23 +145,20 @@ enum Error collection_main(int argc, char *argv[]) {
     for(i = 0; !err && i < bob.n; ++i) {
         if (!duplicate_bob[i]) err = ibf_insert_seq(bob.a[i].hashes, 0, bob.a[i].size * bob.a[i].hash_width, &ibf_bob, ibfbuf, buflen);
     }
+    stats_end(STATS_INSERT);
     if (ibfbuf) ibf_buffer_destroy(&ibfbuf);
     // fprintf(stderr, "[Log] IBFs construction finished\n");
-    /* mark common sketches between alice and bob */
+    /* mark common sketches between alice and bob (bob's index only contains his non-duplicated sketches) */
     for(i = 0; !err && i < alice.n; ++i) {
         if (!duplicate_alice[i]) {
-            ibfbuf = (uint8_t*)1;/* Pure evil, but ok for a boolean variable */
-            for(j = 0; !err && ibfbuf && j < bob.n; ++j) {
-                if (!duplicate_bob[j]) {
-                    a = &alice.a[i];
-                    b = &bob.a[j];
-                    if (!err) if (a->hash_width != b->hash_width || a->size != b->size || a->seed != b->seed) err = ERR_INCOMPATIBLE;
-                    if (memcmp(alice.a[i].hashes, bob.a[i].hashes, bob.a[i].hash_width * bob.a[i].size) == 0) {
-                        duplicate_alice[i] = 2;
-                        duplicate_bob[j] = 2;
-                        ibfbuf = NULL; /* using it as a bool variable, duplicate elements inside both alice and bob are already marked, so it is safe to end the inner loop */
-                    }
-                }
+            a = &alice.a[i];
+            pad_sketch(a, index_bob.buffer);
+            digest = sketch_fingerprint(index_bob.buffer);
+            if ((found = sketch_index_find(&index_bob, &bob, index_bob.buffer, digest)) != UINT64_MAX) {
+                b = &bob.a[found];
+                if (a->hash_width != b->hash_width || a->seed != b->seed) err = ERR_INCOMPATIBLE;
+                duplicate_alice[i] = 2;
+                duplicate_bob[found] = 2;
             }
         }
     }
@@ -124,13 +166,21 @@ enum Error collection_main(int argc, char *argv[]) {
     /* ibf diff */
     diff.seres = NULL;
     diff.data = NULL;
+    stats_begin(STATS_DIFF);
     if (!err) err = ibf_sketch_diff(&ibf_alice, &ibf_bob, &diff);
+    stats_end(STATS_DIFF);
+    stats_begin(STATS_STORE);
     if (!err) err = ibf_sketch_store(opts.opath, &diff);
+    stats_end(STATS_STORE);
     callback_io.alice = &alice;
     callback_io.bob   = &bob;
     callback_io.dup_alice = duplicate_alice;
     callback_io.dup_bob   = duplicate_bob;
+    callback_io.idx_alice = &index_alice;
+    callback_io.idx_bob   = &index_bob;
+    stats_begin(STATS_PEEL);
     if (!err) err = ibf_list_seq(&diff, get_sketches, &callback_io);
+    stats_end(STATS_PEEL);
     // fprintf(stderr, "[Log] difference peeling done\n");
     /* check if all differences have been marked */
     if (!err) {
@@ -156,6 +206,7 @@ enum Error collection_main(int argc, char *argv[]) {
                                 #endif
                                 );
     } else fprintf(stdout, "NaN");
+    stats_print(stderr);
 
     /* cleaning */
     if (!err) err = ibf_sketch_destroy(&diff);
@@ -163,6 +214,8 @@ enum Error collection_main(int argc, char *argv[]) {
     if (!err) err = ibf_sketch_destroy(&ibf_bob);
     if (duplicate_alice) free(duplicate_alice);
     if (duplicate_bob) free(duplicate_bob);
+    sketch_index_destroy(&index_alice);
+    sketch_index_destroy(&index_bob);
     for(i = 0; !err && i < alice.n; ++i) if (!err) err = minhash_sketch_destroy(&alice.a[i]);
     kv_destroy(alice);
     for(i = 0; !err && i < bob.n; ++i) if (!err) err = minhash_sketch_destroy(&bob.a[i]);
@@ -171,91 +224,287 @@ enum Error collection_main(int argc, char *argv[]) {
     return err;
 }
 
+/*
+ * Sketch a list of files, appending the sketches to mhdb in the same order as the paths.
+ * Files are distributed to opts->t workers, each one owning its own kseq reader and sketch,
+ * so the result does not depend on the number of threads.
+ */
 enum Error fill_minhash_sketch(param_t const * const opts, path_itr start, path_itr end, minhash_v_t * const mhdb) {
+    uint64_t i, nthreads;
+    pthread_t *workers;
+    sketch_pool_t pool;
+    enum Error err;
+    assert(mhdb);
+    err = NO_ERROR;
+    pool.opts = opts;
+    pool.paths = start;
+    pool.n = end - start;
+    pool.next = 0;
+    pool.err = NO_ERROR;
+    kv_resize(minhash_t, NULL, *mhdb, mhdb->n + pool.n);
+    pool.sketches = &mhdb->a[mhdb->n];
+    memset(pool.sketches, 0, pool.n * sizeof *pool.sketches);/* destroying a sketch that was never sketched is a no-op */
+    mhdb->n += pool.n;
+    nthreads = opts->t < pool.n ? opts->t : pool.n;
+    if (pthread_mutex_init(&pool.lock, NULL) != 0) return ERR_RUNTIME;
+    if (nthreads <= 1) {
+        sketch_worker(&pool);
+        pthread_mutex_destroy(&pool.lock);
+        return pool.err;
+    }
+    if ((workers = (pthread_t*)malloc(nthreads * sizeof *workers)) == NULL) err = ERR_ALLOC;
+    for(i = 0; !err && i < nthreads; ++i) {
+        if (pthread_create(&workers[i], NULL, sketch_worker, &pool) != 0) {
+            pthread_mutex_lock(&pool.lock);
+            pool.err = ERR_RUNTIME;
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+    }
+    nthreads = i;
+    for(i = 0; i < nthreads; ++i) pthread_join(workers[i], NULL);
+    pthread_mutex_destroy(&pool.lock);
+    if (workers) free(workers);
+    if (!err) err = pool.err;
+    return err;
+}
+
+void *sketch_worker(void *arg) {
+    sketch_pool_t *pool;
+    uint64_t i;
+    enum Error err;
+    pool = (sketch_pool_t*)arg;
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->err ? pool->n : pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->n) break;
+        if ((err = sketch_file(pool->opts, pool->paths[i], &pool->sketches[i])) != NO_ERROR) {
+            pthread_mutex_lock(&pool->lock);
+            if (!pool->err) pool->err = err;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+    return NULL;
+}
+
+enum Error sketch_file(param_t const * const opts, char const * const path, minhash_t * const sketch) {
     gzFile fp;
-    minhash_t dummy;
     kseq_t *seq;
     uint64_t i, j;
     struct stat st;
     enum Error err;
-    assert(mhdb);
+    unsigned char cached;
+    char key[PATH_MAX + 128], entry[PATH_MAX + 32];
+    assert(sketch);
     fp = NULL;
     seq = NULL;
-    err = NO_ERROR;
-    dummy.size = 0;
-    for(; !err && start != end; ++start) {
-        kv_push(minhash_t, NULL, *mhdb, dummy);
-        err = minhash_sketch_init(opts->s, opts->z, opts->w, &mhdb->a[mhdb->n-1]);
-        if (strcmp(*start, "-") == 0) {
-            if ((fp = gzdopen(fileno(stdin), "r")) == NULL) {
-                fprintf(stderr, "Unable to use stdin as input\n");
-                return ERR_FILE;
-            }
-        } else if (stat(*start, &st) == 0 && (st.st_mode & S_IFREG)) {
-            if ((fp = gzopen(*start, "r")) == NULL) {
-                fprintf(stderr, "Unable to open file %s\n", *start);
-                return ERR_FILE;
-            }
-        } else return ERR_FILE;
-        if (fp) seq = kseq_init(fp);
-        while(!err && kseq_read(seq) >= 0) {
-            for(i = 0, j = 0; !err && i < seq->seq.l; ++i) {
-                if (seq_nt4_table[(uint8_t)seq->seq.s[i]] < 4) ++j;
-                else j = 0;
-                if (j >= opts->k) {
-                    // minhash_print(stderr, &sketch_vec.a[sketch_vec.n-1]);
-                    // fprintf(stderr, "i = %llu, j = %llu, kmer = %.*s\n", i, j, opts.k, &seq->seq.s[i-opts.k+1]);
-                    err = minhash_sketch_insert(&seq->seq.s[i-opts->k+1], opts->k, opts->z, &mhdb->a[mhdb->n-1]);
-                }
+    cached = FALSE;
+    if (strcmp(path, "-") == 0) {
+        if ((fp = gzdopen(fileno(stdin), "r")) == NULL) {
+            fprintf(stderr, "Unable to use stdin as input\n");
+            return ERR_FILE;
+        }
+    } else if (stat(path, &st) == 0 && (st.st_mode & S_IFREG)) {
+        if (opts->cache) {
+            cached = TRUE;
+            sketch_cache_entry(opts, path, &st, key, entry);
+            if (sketch_cache_load(entry, key, sketch) == NO_ERROR) return NO_ERROR;
+            minhash_sketch_destroy(sketch);
+        }
+        if ((fp = gzopen(path, "r")) == NULL) {
+            fprintf(stderr, "Unable to open file %s\n", path);
+            return ERR_FILE;
+        }
+    } else return ERR_FILE;
+    if ((err = minhash_sketch_init(opts->s, opts->z, opts->w, sketch)) != NO_ERROR) {
+        gzclose(fp);
+        return err;
+    }
+    seq = kseq_init(fp);
+    while(!err && kseq_read(seq) >= 0) {
+        for(i = 0, j = 0; !err && i < seq->seq.l; ++i) {
+            if (seq_nt4_table[(uint8_t)seq->seq.s[i]] < 4) ++j;
+            else j = 0;
+            if (j >= opts->k) {
+                // fprintf(stderr, "i = %llu, j = %llu, kmer = %.*s\n", i, j, opts.k, &seq->seq.s[i-opts.k+1]);
+                err = minhash_sketch_insert(&seq->seq.s[i-opts->k+1], opts->k, opts->z, sketch);
             }
         }
-        if (seq) kseq_destroy(seq);
-        if (fp) gzclose(fp);
-        fp = NULL;
     }
+    if (!err) err = minhash_sketch_finalize(opts->z, sketch);
+    kseq_destroy(seq);
+    gzclose(fp);
+    if (!err && cached && sketch_cache_store(entry, key, sketch) != NO_ERROR) 
+        fprintf(stderr, "[Warning] Unable to cache the sketch of %s\n", path);
     return err;
 }
 
-enum Error mark_duplicates(minhash_v_t const * const mhdb, uint8_t ** const duplicate) {
-    uint64_t i, j;
+/*
+ * On-disk sketch cache.
+ * Each input file is cached into its own entry, named after a hash of its key (absolute path, size, modification time 
+ * and sketching parameters). The key is also written at the beginning of the entry and checked when loading, 
+ * so that collisions and stale entries are simply sketched again.
+ */
+void sketch_cache_entry(param_t const * const opts, char const * const path, struct stat const * const st, char * const key, char * const entry) {
+    char abspath[PATH_MAX];
+    uint64_t hval[2];
+    if (realpath(path, abspath) == NULL) strncpy(abspath, path, PATH_MAX - 1);
+    abspath[PATH_MAX - 1] = '\0';
+    snprintf(key, PATH_MAX + 128, "%s|%llu|%lld|k%u|z%llu|w%u|s%u", abspath, (unsigned long long)st->st_size, (long long)st->st_mtime, 
+        opts->k, (unsigned long long)opts->z, opts->w, opts->s);
+    MurmurHash3_x64_128(key, strlen(key), 0, hval);
+    snprintf(entry, PATH_MAX + 32, "%s/%016llx.mhc", opts->cache, (unsigned long long)hval[0]);
+}
+
+enum Error sketch_cache_load(char const * const entry, char const * const key, minhash_t * const sketch) {
+    FILE *in;
+    uint32_t len;
+    char stored[PATH_MAX + 128];
     enum Error err;
+    memset(sketch, 0, sizeof *sketch);
+    if ((in = fopen(entry, "rb")) == NULL) return ERR_FILE;
+    err = NO_ERROR;
+    if (fread(&len, sizeof len, 1, in) != 1) err = ERR_IO;
+    if (!err) len = ntoh32(len);
+    if (!err && (len != strlen(key) || fread(stored, 1, len, in) != len || memcmp(stored, key, len) != 0)) err = ERR_VALUE;
+    if (!err) err = minhash_sketch_from_stream(in, sketch);
+    fclose(in);
+    return err;
+}
+
+enum Error sketch_cache_store(char const * const entry, char const * const key, minhash_t const * const sketch) {
+    FILE *out;
+    int fd;
+    uint32_t len;
+    char tmp[PATH_MAX + 48];
+    enum Error err;
+    snprintf(tmp, sizeof tmp, "%s.XXXXXX", entry);
+    if ((fd = mkstemp(tmp)) < 0) return ERR_FILE;
+    if ((out = fdopen(fd, "wb")) == NULL) {
+        close(fd);
+        unlink(tmp);
+        return ERR_FILE;
+    }
+    err = NO_ERROR;
+    len = hton32((uint32_t)strlen(key));
+    if (fwrite(&len, sizeof len, 1, out) != 1 || fwrite(key, 1, strlen(key), out) != strlen(key)) err = ERR_IO;
+    if (!err) err = minhash_sketch_to_stream(out, sketch);
+    if (fclose(out) != 0 && !err) err = ERR_IO;
+    if (!err && rename(tmp, entry) != 0) err = ERR_FILE; /* atomic, concurrent runs never see partial entries */
+    if (err) unlink(tmp);
+    return err;
+}
+
+static inline void pad_sketch(minhash_t const * const sketch, uint8_t * const buffer) {
+    memset(buffer, 0, WSIZE);
+    memcpy(buffer, sketch->hashes, sketch->hash_width * sketch->size);
+}
+
+static inline uint64_t sketch_fingerprint(uint8_t const * const padded) {
+    uint64_t hval[2];
+    MurmurHash3_x64_128(padded, WSIZE, 0, hval);
+    return hval[0];
+}
+
+enum Error sketch_index_init(uint64_t n, sketch_index_t * const index) {
+    uint64_t capacity;
+    assert(index);
+    for(capacity = 2; capacity < 2 * n; capacity <<= 1) {} /* load factor <= 0.5 */
+    index->mask = capacity - 1;
+    index->digests = (uint64_t*)malloc(capacity * sizeof *index->digests);
+    index->slots = (uint64_t*)calloc(capacity, sizeof *index->slots);
+    index->buffer = (uint8_t*)malloc(WSIZE);
+    if (!index->digests || !index->slots || !index->buffer) {
+        sketch_index_destroy(index);
+        return ERR_ALLOC;
+    }
+    return NO_ERROR;
+}
+
+void sketch_index_destroy(sketch_index_t * const index) {
+    assert(index);
+    if (index->digests) free(index->digests);
+    if (index->slots) free(index->slots);
+    if (index->buffer) free(index->buffer);
+    index->digests = index->slots = NULL;
+    index->buffer = NULL;
+}
+
+/*
+ * Look for a sketch inside the index.
+ *
+ * @param padded the sketch to look for, zero-padded to WSIZE bytes (the same layout of an IBF keysum)
+ * @param digest fingerprint of padded
+ * @return position of the matching sketch inside mhdb, UINT64_MAX if not found
+ */
+uint64_t sketch_index_find(sketch_index_t const * const index, minhash_v_t const * const mhdb, uint8_t const * const padded, uint64_t digest) {
+    uint64_t pos, i, len, j;
+    assert(index);
     assert(mhdb);
+    assert(padded);
+    for(pos = digest & index->mask; index->slots[pos]; pos = (pos + 1) & index->mask) {
+        if (index->digests[pos] != digest) continue;
+        i = index->slots[pos] - 1;
+        len = mhdb->a[i].hash_width * mhdb->a[i].size;
+        if (memcmp(mhdb->a[i].hashes, padded, len) != 0) continue;
+        for(j = len; j < WSIZE && padded[j] == 0; ++j) {}
+        if (j == WSIZE) return i;
+    }
+    return UINT64_MAX;
+}
+
+/*
+ * Mark repeated sketches inside a collection (only the first occurrence is kept) and index the remaining ones.
+ * Each sketch is fingerprinted once, so the whole operation is O(n) expected.
+ */
+enum Error mark_duplicates(minhash_v_t const * const mhdb, uint8_t ** const duplicate, sketch_index_t * const index) {
+    uint64_t i, pos, digest;
+    enum Error err;
+    assert(mhdb);
+    assert(index);
     assert(*duplicate == NULL);
     err = NO_ERROR;
     if ((*duplicate = calloc(mhdb->n, sizeof **duplicate)) == 0) {
         fprintf(stderr, "Unable to allocate duplicate vector\n");
         err = ERR_ALLOC;
     }
-    if (!err) {
-        for(i = 0; i < mhdb->n; ++i) {
-            for(j = i + 1; j < mhdb->n; ++j) {
-                if (!(*duplicate)[j] && memcmp(mhdb->a[i].hashes, mhdb->a[j].hashes, mhdb->a[i].hash_width * mhdb->a[i].size) == 0) 
-                    (*duplicate)[j] = 1;
-            }
+    if (!err) err = sketch_index_init(mhdb->n, index);
+    for(i = 0; !err && i < mhdb->n; ++i) {
+        if (mhdb->a[i].hash_width * mhdb->a[i].size > WSIZE) {/*sketches are IBF keys, zero-padded to WSIZE bytes*/
+            fprintf(stderr, "Sketches of %u bytes do not fit keys of %u bytes, build with a larger STORE_HASHES\n", (unsigned int)(mhdb->a[i].hash_width * mhdb->a[i].size), (unsigned int)WSIZE);
+            err = ERR_INCOMPATIBLE;
+            break;
+        }
+        pad_sketch(&mhdb->a[i], index->buffer);
+        digest = sketch_fingerprint(index->buffer);
+        if (sketch_index_find(index, mhdb, index->buffer, digest) != UINT64_MAX) {
+            (*duplicate)[i] = 1;
+        } else {
+            for(pos = digest & index->mask; index->slots[pos]; pos = (pos + 1) & index->mask) {}
+            index->digests[pos] = digest;
+            index->slots[pos] = i + 1;
         }
     }
     return err;
 }
 
 void get_sketches(bucket_t const * const bucket, char origin, void *callback_io) {
-    uint64_t i;
+    uint64_t i, digest;
     callback_t *ino;
     assert(bucket);
     assert(callback_io);
     ino = (callback_t*)callback_io;
-    /* mark differences */
+    /* mark differences, keysums are already zero-padded to WSIZE so they can be fingerprinted directly */
+    digest = sketch_fingerprint(bucket->keysum);
     if (origin == 'i') {
         // fprintf(stderr, "found something unique to alice\n");
-        for(i = 0; i < ino->alice->n; ++i) {
-            if (!ino->dup_alice[i] && memcmp(ino->alice->a[i].hashes, bucket->keysum, ino->alice->a[i].hash_width * ino->alice->a[i].size) == 0)
-                ino->dup_alice[i] = 3;
-        }
+        i = sketch_index_find(ino->idx_alice, ino->alice, bucket->keysum, digest);
+        if (i != UINT64_MAX && !ino->dup_alice[i]) ino->dup_alice[i] = 3;
     } else if (origin == 'j') {
         // fprintf(stderr, "found something unique to bob\n");
-        for(i = 0; i < ino->bob->n; ++i) {
-            if (!ino->dup_bob[i] && memcmp(ino->bob->a[i].hashes, bucket->keysum, ino->bob->a[i].hash_width * ino->bob->a[i].size) == 0)
-                ino->dup_bob[i] = 3;
-        }
+        i = sketch_index_find(ino->idx_bob, ino->bob, bucket->keysum, digest);
+        if (i != UINT64_MAX && !ino->dup_bob[i]) ino->dup_bob[i] = 3;
     } else {
         fprintf(stderr, "[Warning] Unrecognized source ibf\n");
     }
@@ -274,6 +523,9 @@ void print_collection_help() {
     fprintf(stderr, "\t-r\tnumber of hash functions [3] (3 <= r <= 7)\n");
     fprintf(stderr, "\t-e\tepsilon [0] (0 <= epsilon <= 1)\n");
     fprintf(stderr, "\t-s\trandom seed [42]\n");
+    fprintf(stderr, "\t-t\tnumber of threads used to sketch the input files [1]\n");
+    fprintf(stderr, "\t-c\tfolder of the sketch cache, unchanged files are loaded from it instead of being sketched again\n");
+    fprintf(stderr, "\t--stats\tprint run statistics (phase times, counters, peak memory) as JSON on stderr\n");
     fprintf(stderr, "\t-h\tshow this help\n");
     fprintf(stderr, "\nExample:\n");
     fprintf(stderr, "\tminhash_test -o <output_file> -a <fastx|gz> (*[fastx|gz]) -b <fastx|gz> (*[fastx|gz]) -k <k> -z <number of hashes> -w <hash width in bits> -s <seed>\n");
@@ -287,7 +539,9 @@ void init_options(param_t *parameters) {
     parameters->n = 0;
     parameters->r = 3;
     parameters->e = 0;
+    parameters->t = 1;
     parameters->opath = NULL;
+    parameters->cache = NULL;
 }
 
 static enum Error option_parser(int *opt_idx, char opt, char** arg_ptr, param_t *parameters) {
@@ -345,6 +599,14 @@ static enum Error option_parser(int *opt_idx, char opt, char** arg_ptr, param_t
             if (parsed_ll > INT32_MAX || parsed_ll < 0) return ERR_OUTOFBOUNDS;
             parameters->s = (uint32_t)parsed_ll;
             break;
+        case 't':
+            parsed_ld = strtol(arg, NULL, 10);
+            if (parsed_ld > UINT32_MAX || parsed_ld < 1) return ERR_OUTOFBOUNDS;
+            parameters->t = (uint32_t)parsed_ld;
+            break;
+        case 'c':
+            parameters->cache = arg;
+            break;
         case 'h':
             print_collection_help();
             break;
@@ -363,6 +625,10 @@ enum Error check_options(param_t const * const parameters) {
     }
     if (parameters->e > 1 || parameters->e < 0) return ERR_OUTOFBOUNDS;
     if (parameters->r > 7 || parameters->r < 3) return ERR_OUTOFBOUNDS;
+    if (parameters->cache && mkdir(parameters->cache, 0755) != 0 && errno != EEXIST) {/*created on first use*/
+        fprintf(stderr, "Unable to create the cache folder %s\n", parameters->cache);
+        return ERR_FILE;
+    }
     return NO_ERROR;
 }
 
@@ -392,7 +658,9 @@ enum Error parse_options(int argc, char *argv[], char const * const opt_string,
     short_opt = '\0';
     for(i = 1, ok = 1; i < argc && ok; ++i) {
         // fprintf(stderr, "now at %s\n", argv[i]);
-        if (argv[i][0] == '-') {/*Order is important!*/
+        if (strcmp(argv[i], "--stats") == 0) {/*the only long option*/
+            stats_enable("collection");
+        } else if (argv[i][0] == '-') {/*Order is important!*/
             opt_len = strlen(argv[i]);
             if(opt_len == 1) short_opt = argv[i][0];/* just '-' if everything fine */
             else if (opt_len == 2) short_opt = argv[i][1];
@@ -0,0 +1,8 @@
+#ifndef COMPILE_OPTIONS_H
+#define COMPILE_OPTIONS_H
+
+#define STORE_SEQUENCES 31
+
+/*#define DEBUG*/
+
+#endif
@@ -14,7 +14,7 @@ def configure_length(algorithm: str, k: int, m: int):
     #elif algorithm == "min-hash-collection": return int((k + 7) / 8) * m # = CEILING(hash_width, 8) * number_of_hashes_in_minhash_sketch
     else: raise ValueError("This should never happen because the parser should catch it with options")
 
-def configure_for_fixed_length_sequences(path: str, algorithm: str, k: int, z: int, always_make: bool, debug: bool):
+def configure_for_fixed_length_sequences(path: str, algorithm: str, k: int, z: int, weighted: bool, always_make: bool, debug: bool):
     assert 0 <= k
     assert 0 <= z < k
     aldiff_path = path #same folder as source code
@@ -28,6 +28,7 @@ def configure_for_fixed_length_sequences(path: str, algorithm: str, k: int, z: i
         print(algorithm)
         print("-->", dnalen)
         ch.write("#define STORE_SEQUENCES {}\n".format(dnalen))
+        if weighted: ch.write("#define STORE_WEIGHTS      /*Counting IBLT: store multiplicities*/\n")
         ch.write("\n")
         ch.write("{}#define DEBUG{}\n".format("" if debug else "/*", "" if debug else "*/"))
         ch.write("\n")
@@ -77,7 +78,7 @@ def configure_for_variable_length_sequences(path: str, maximum_length: int, alwa
         exit(out.returncode)
 
 def main(args):
-    if args.command == "sequences": return configure_for_fixed_length_sequences(args.__exepath, args.algorithm, args.k, args.z, args.always, args.debug)
+    if args.command == "sequences": return configure_for_fixed_length_sequences(args.__exepath, args.algorithm, args.k, args.z, args.weighted, args.always, args.debug)
     elif args.command == "hashes": return configure_for_hashes(args.__exepath, args.l, args.s, args.always, args.debug)
     elif args.command == "vls": return configure_for_variable_length_sequences(args.__exepath, args.l, args.always, args.debug)
     else: sys.stderr.write("-h to list available subcommands\n")
@@ -92,6 +93,7 @@ def parser_init():
     parser_sequences.add_argument("-a", "--algorithm", help="algorithm to compute the set (minimizers, syncmers) [minimizers]", type=str, default="minimizers", choices=["minimizers", "syncmers", "segmentation"])
     parser_sequences.add_argument("-k", help="k-mer length", type=int, required=True)
     parser_sequences.add_argument("-z", help="minimizer length used for improving space requirements (see algorithm for actual usage)", type=int, required=True)
+    parser_sequences.add_argument("--weighted", help="store k-mer multiplicities (counting IBLT, see kmc2ibf -w)", action="store_true")
     parser_sequences.add_argument("--debug", help="activate debugging information to stderr", action="store_true")
     parser_sequences.add_argument("--always", help="recompile everything", action="store_true")
 
@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <stdlib.h>
 #include "constants.h"
 #include "err.h"
 
@@ -56,3 +57,20 @@ unsigned char pDNA8(const char *nib, int len)/*FIXME use AVX instruction set to
 	}
 	return v;
 }
+
+int parse_u32_list(char const *list, uint32_t **values, uint32_t *count) {
+	char const *p;
+	char *end;
+	unsigned long value;
+	uint32_t n;
+	assert(list != NULL);
+	for(n = 1, p = list; *p; ++p) if (*p == ',') ++n;
+	if ((*values = (uint32_t*)malloc(n * sizeof(uint32_t))) == NULL) return ERR_ALLOC;
+	for(*count = 0, p = list; *count < n; p = end + 1) {
+		value = strtoul(p, &end, 10);
+		if (end == p || (*end != ',' && *end != '\0') || value > (uint32_t)-1) return ERR_VALUE;
+		(*values)[(*count)++] = (uint32_t)value;
+		if (*end == '\0') break;
+	}
+	return NO_ERROR;
+}
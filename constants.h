@@ -11,6 +11,19 @@
 
 #define CEILING(x,y) (((x) + (y) - 1) / (y))
 
+#define LONGOPT_HUGEPAGES 300 /*ketopt values of long-only options, above all short ones*/
+#define LONGOPT_INTERLEAVE 301
+#define LONGOPT_STATS 302
+#define LONGOPT_RESIDUAL 303
+#define LONGOPT_SOCKET 304
+#define LONGOPT_PORT 305
+#define LONGOPT_HOST 306
+#define LONGOPT_SPARSE 307
+#define LONGOPT_BUFFER 308
+#define LONGOPT_MEMORY 309
+#define LONGOPT_SHARDS 310
+#define LONGOPT_RESIZE 311
+
 #if defined(STORE_HASHES) && !defined(STORE_SEQUENCES) /*if we do not want to store sequences, store their 64bit hashes instead*/
     #define HASHLEN STORE_HASHES
     #define WSIZE ((CEILING(HASHLEN,8)))
@@ -61,10 +74,12 @@
         }\
     } while(0)
 
-unsigned char seq_nt4_table[256];
+extern unsigned char seq_nt4_table[256];
 
-char seq_nt4_inv_table[5];
+extern char seq_nt4_inv_table[5];
 
 int pack2bit(const char *seq, unsigned char len, unsigned char *out);
 
+int parse_u32_list(char const *list, uint32_t **values, uint32_t *count);/*comma-separated integers, values to be freed*/
+
 #endif/*CONSTANTS_H*/
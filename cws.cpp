@@ -1,10 +1,12 @@
 #include <cstdio>
 #include <random>
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fstream>
-#include <set>
+#include <thread>
 #include "./kmc_api/kmc_file.h"
+#include "kmc_partitions.h"
 extern "C" {
 	#include "murmur3.h"
 	#include "ketopt.h"
@@ -23,10 +25,50 @@ bool operator==(const hash_t& x, const hash_t& y) {
 	return std::tie(x.msb, x.lsb) == std::tie(y.msb, y.lsb);
 }
 
+/*
+ * Bottom-s sketch over a flat buffer of 2s candidates.
+ * Once s distinct hashes are known the largest one becomes the rejection threshold,
+ * so most insertions cost a single comparison and no allocation.
+ */
+struct bottom_s_t {
+	std::size_t s;
+	bool saturated;
+	hash_t threshold;
+	std::vector<hash_t> buffer;
+
+	bottom_s_t(std::size_t s) : s(s), saturated(false), threshold{0, 0} {buffer.reserve(2 * s);}
+
+	void insert(hash_t const& hash)
+	{
+		if(s == 0 or (saturated and !(hash < threshold))) return;
+		buffer.push_back(hash);
+		if(buffer.size() >= 2 * s) compact();
+	}
+
+	void compact()
+	{
+		std::sort(buffer.begin(), buffer.end());
+		buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+		if(buffer.size() > s) buffer.resize(s);
+		if(buffer.size() == s and s > 0)
+		{
+			saturated = true;
+			threshold = buffer.back();
+		}
+	}
+
+	std::vector<hash_t>& finalize()
+	{
+		compact();
+		return buffer;
+	}
+};
+
 void print_subcommands()
 {
 	std::cerr << 
 		"sketch\tsketch a KMC database with I2CWS\n" <<
+		"i2cws\tsketch a KMC database with Improved ICWS samples\n" <<
 		"compare\tcompare two I2CWS sketches\n" <<
 		"full\tcompute full Jaccard and full Weighted Jaccard between two KMC databases\n" <<
 		"total\tget total number of k-mers in kmc database\n" << 
@@ -37,9 +79,10 @@ void print_subcommands()
 void print_full_help()
 {
 	std::cerr <<
-		"the 'full' subcommand has two positional options only:\n"
+		"the 'full' subcommand has two positional options:\n"
 		"[file1] first KMC database\n" <<
 		"[file2] second KMC database\n" <<
+		"and an optional -t <threads> [1] (effective for kmc1 databases with the same LUT prefix length)\n" <<
 		"\n" <<
 		"output on stdout in the form <J>|<WJ> Example:\n" << 
 		"0.3|0.4 -> 0.3 is the simple Jaccard while 0.4 is its weighted counterpart\n";
@@ -52,7 +95,19 @@ void print_sketch_help()
 		"i\tinput KMC database to sketch (without extensions)\n" <<
 		"o\toutput sketch file\n" <<
 		"s\tnumber of elements in the sketch [1000]\n" <<
-		"r\trandom seed [42]\n";
+		"r\trandom seed [42]\n" <<
+		"t\tnumber of threads [1]\n";
+}
+
+void print_i2cws_help()
+{
+	std::cerr <<
+		"i2cws subcommand options:\n" <<
+		"i\tinput KMC database to sketch (without extensions)\n" <<
+		"o\toutput sketch file\n" <<
+		"s\tnumber of samples in the sketch [1000]\n" <<
+		"r\trandom seed [42]\n" <<
+		"t\tnumber of threads [1]\n";
 }
 
 void print_compare_help()
@@ -69,8 +124,9 @@ void print_compare_help()
 void print_total_help()
 {
 	std::cerr <<
-		"the 'total' subcommand takes only one positional argument:\n"
+		"the 'total' subcommand takes one positional argument:\n"
 		"[file1] a KMC database\n" <<
+		"and an optional -t <threads> [1]\n" <<
 		"\n" <<
 		"output on stdout the total number of k-mers in the database with repetitions (L1 norm)\n";
 }
@@ -96,10 +152,13 @@ int wmh_main(int argc, char* argv[])
 	std::string kmc_path, output_path;
 	std::size_t s = 1000;
 	std::size_t dummy_seed = 42;
-	while((c = ketopt(&opt, argc, argv, 1, "i:o:s:r:h", longopts)) > 0)
+	std::size_t nthreads = 1;
+	while((c = ketopt(&opt, argc, argv, 1, "i:o:s:r:t:h", longopts)) > 0)
 	{
 		if (c == 'r') {
 			dummy_seed = std::stoul(opt.arg, nullptr, 10);
+		} else if (c == 't') {
+			nthreads = std::max(std::stoul(opt.arg, nullptr, 10), 1UL);
 		} else if (c == 'i') {
 			kmc_path = opt.arg;
 		} else if (c == 's') {
@@ -136,29 +195,36 @@ int wmh_main(int argc, char* argv[])
 	CKMCFileInfo infos;
 	kmcdb.Info(infos);
 	unsigned int _kmer_length = infos.kmer_length;
+	auto partitions = lut_partitions(kmcdb.LUTSize(), nthreads);
+	kmcdb.Close();
 
-	CKmerAPI kmer(_kmer_length);
-	char skmer[_kmer_length];	
-	uint32_t counter;
-	hash_t hash;
-	std::vector<hash_t> sketch;
+	std::vector<bottom_s_t> partials(partitions.size(), bottom_s_t(s));
+	std::vector<char> opened(partitions.size(), 0);
+	for_each_partition(partitions.size(), [&](std::size_t p)
 	{
-	std::set<hash_t> ssk;
-	while(kmcdb.ReadNextKmer(kmer, counter))
-	{
-		kmer.to_string(skmer);
-		for(std::uint32_t i = 0; i < counter; ++i)
+		CKMCFile kmcpart;
+		if (!kmcpart.OpenForListing(kmc_path, partitions[p].first, partitions[p].second)) return;
+		opened[p] = 1;
+		CKmerAPI kmer(_kmer_length);
+		std::vector<char> skmer(_kmer_length + 1);
+		uint32_t counter;
+		hash_t hash;
+		while(kmcpart.ReadNextKmer(kmer, counter))
 		{
-			MurmurHash3_x86_128(reinterpret_cast<void*>(skmer), _kmer_length, i, reinterpret_cast<void*>(&hash)); //get the seed for the column
-			ssk.insert(hash);
-			if(ssk.size() > s) ssk.erase(--(ssk.end()));
+			kmer.to_string(skmer.data());
+			for(std::uint32_t i = 0; i < counter; ++i)
+			{
+				MurmurHash3_x86_128(reinterpret_cast<void*>(skmer.data()), _kmer_length, i, reinterpret_cast<void*>(&hash)); //get the seed for the column
+				partials[p].insert(hash);
+			}
 		}
-	}
-	kmcdb.Close();
-	std::copy(ssk.cbegin(), ssk.cend(), std::back_inserter(sketch));
-	}
+		kmcpart.Close();
+	});
+	if(std::find(opened.cbegin(), opened.cend(), 0) != opened.cend()) throw std::runtime_error("Unable to open the database\n");
+	bottom_s_t ssk(s);
+	for(auto& partial : partials) for(auto const& hash : partial.finalize()) ssk.insert(hash);
 	std::ofstream skstrm(output_path, std::ios_base::binary);
-	save_wmh_sketch(dummy_seed, static_cast<uint8_t>(_kmer_length), sketch, skstrm);
+	save_wmh_sketch(dummy_seed, static_cast<uint8_t>(_kmer_length), ssk.finalize(), skstrm);
 	skstrm.close();
 	return 0;
 }
@@ -228,6 +294,25 @@ int compare_main(int argc, char* argv[])
 	return 0;
 }
 
+/*
+ * Counter-based generator for I2CWS: the j-th variate of a (k-mer, row) pair is a
+ * finalised hash of their combined key, so no RNG state is constructed or reseeded.
+ */
+static inline uint64_t mix64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static inline double unit_variate(uint64_t key, uint64_t j)
+{
+	return static_cast<double>((mix64(key + j * 0x9e3779b97f4a7c15ULL) >> 11) + 1) / 9007199254740992.0; // (0, 1]
+}
+
 int i2cws_main(int argc, char* argv[])
 {
 	struct sample_t {
@@ -243,6 +328,34 @@ int i2cws_main(int argc, char* argv[])
 		ostrm.write(reinterpret_cast<char*>(sketch.data()), sketch.size() * sizeof(sample_t));
 	};
 
+	/* 
+	 * Update rows of a partial sketch with a slice of k-mers. 
+	 * Gamma(2, 1) variates are drawn as -log(u * u'), the sample y_k is only computed for accepted rows.
+	 */
+	auto sketch_slice = [](std::vector<uint64_t> const& keys, std::vector<double> const& logc, std::size_t from, std::size_t to, std::vector<uint64_t> const& row_seeds, std::vector<sample_t>& sketch)
+	{
+		for(std::size_t k = from; k < to; ++k)
+		{
+			for(std::size_t i = 0; i < row_seeds.size(); ++i)
+			{
+				uint64_t key = keys[k] ^ row_seeds[i];
+				double gamma2 = -std::log(unit_variate(key, 0) * unit_variate(key, 1));
+				double beta2 = unit_variate(key, 2);
+				double c_k = -std::log(unit_variate(key, 3) * unit_variate(key, 4));
+				double t_k2 = std::floor(logc[k] / gamma2 + beta2);
+				double a_k = c_k / std::exp(gamma2 * (t_k2 - beta2 + 1));
+				if(a_k < sketch[i].kstar)
+				{
+					double gamma1 = -std::log(unit_variate(key, 5) * unit_variate(key, 6));
+					double beta1 = unit_variate(key, 7);
+					double t_k1 = std::floor(logc[k] / gamma1 + beta1);
+					sketch[i].kstar = a_k;
+					sketch[i].ykstar = std::exp(gamma1 * (t_k1 - beta1));
+				}
+			}
+		}
+	};
+
 	static ko_longopt_t longopts[] = {
 		{NULL, 0, 0}
 	};
@@ -251,7 +364,8 @@ int i2cws_main(int argc, char* argv[])
 	std::string kmc_path, output_path;
 	std::size_t s = 1000;
 	std::size_t rseed = 42;
-	while((c = ketopt(&opt, argc, argv, 1, "i:o:s:r:h", longopts)) > 0)
+	std::size_t nthreads = 1;
+	while((c = ketopt(&opt, argc, argv, 1, "i:o:s:r:t:h", longopts)) > 0)
 	{
 		if (c == 'r') {
 			rseed = std::stoul(opt.arg, nullptr, 10);
@@ -261,82 +375,72 @@ int i2cws_main(int argc, char* argv[])
 			s = std::stoul(opt.arg, nullptr, 10);
 		} else if (c == 'o') {
 			output_path = opt.arg;
+		} else if (c == 't') {
+			nthreads = std::max(std::stoul(opt.arg, nullptr, 10), 1UL);
 		} else {
 			std::cerr << "Option (" << c << ") not available\n";
-			print_sketch_help();
+			print_i2cws_help();
 			return EXIT_FAILURE;
 		}
 	}
 	if(kmc_path.length() == 0 or output_path.length() == 0) {
 		if(kmc_path.length() == 0) std::cerr << "Option -i is mandatory\n";
 		if(output_path.length() == 0) std::cerr << "Option -o is mandatory\n";
-		print_sketch_help();
+		print_i2cws_help();
 		return EXIT_FAILURE;
 	}
 	
-	std::vector<uint32_t> row_seeds(s);
-	{
-	std::mt19937_64 mersenne;
-	std::uniform_int_distribution<uint32_t> sketch_dist(0, std::numeric_limits<uint32_t>::max());
-	for(auto& seed : row_seeds) seed = sketch_dist(mersenne);
-	}
+	std::vector<uint64_t> row_seeds(s);
+	for(std::size_t i = 0; i < s; ++i) row_seeds[i] = mix64(rseed + (i + 1) * 0x9e3779b97f4a7c15ULL);
 	CKMCFile kmcdb;
 	if (!kmcdb.OpenForListing(kmc_path)) {
 		throw std::runtime_error("Unable to open the database\n");
 	}
 	
-	// unsigned int _kmer_length;
-	// unsigned int _mode;
-	// unsigned int _counter_size;
-	// unsigned int _lut_prefix_length;
-	// unsigned int _signature_len;
-	// unsigned int _min_count;
-	// unsigned long long _max_count;
-	// unsigned long long _total_kmers;
-	// kmcdb.Info(_kmer_length, _mode, _counter_size, _lut_prefix_length, _signature_len, _min_count, _max_count, _total_kmers);
 	CKMCFileInfo infos;
 	kmcdb.Info(infos);
 	unsigned int _kmer_length = infos.kmer_length;
 
 	CKmerAPI kmer(_kmer_length);
-	char skmer[_kmer_length];	
+	std::vector<char> skmer(_kmer_length + 1);
 	uint32_t counter;
 
-	hash_t icws_seed; 
+	hash_t kmer_hash; 
 	sample_t dummy = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
-	std::vector<sample_t> sketch(s, dummy);
-	std::mt19937_64 gen;
-	std::gamma_distribution<double> gamma(2, 1);
-	std::uniform_real_distribution<double> uniform(0, 1);
-	while(kmcdb.ReadNextKmer(kmer, counter))
+	std::vector<std::vector<sample_t>> partials(nthreads, std::vector<sample_t>(s, dummy));
+	const std::size_t block_size = 1 << 16;
+	std::vector<uint64_t> keys;
+	std::vector<double> logc;
+	keys.reserve(block_size);
+	logc.reserve(block_size);
+	bool more = true;
+	while(more)
 	{
-		kmer.to_string(skmer);
-		for(std::size_t i = 0; i < s; ++i)
+		keys.clear();
+		logc.clear();
+		while(keys.size() < block_size and (more = kmcdb.ReadNextKmer(kmer, counter)))
 		{
-			MurmurHash3_x64_128(reinterpret_cast<void*>(skmer), _kmer_length, row_seeds[i], reinterpret_cast<void*>(&icws_seed)); //get the seed for the column
-			
-			gen.seed(icws_seed.msb);
-			double gamma1 = gamma(gen);
-			double gamma2 = gamma(gen);
-			double gamma3 = gamma(gen);
-			gen.seed(icws_seed.lsb);
-			double uniform1 = uniform(gen);
-			double uniform2 = uniform(gen);
-
-			double t_k2 = std::floor(std::log(counter) / gamma2 + uniform1);
-			double z_k  = std::exp(gamma2 * (t_k2 - uniform2 + 1));
-			double a_k  = gamma3 / z_k;
-			
-			if(a_k < sketch[i].kstar)
-			{
-				sketch[i].kstar = a_k;
-				std::size_t t_kstar = std::floor(std::log(counter) / gamma1 + uniform1);
-				sketch[i].ykstar = std::exp(gamma1 * (t_kstar - uniform1));
-			}
+			kmer.to_string(skmer.data());
+			MurmurHash3_x64_128(reinterpret_cast<void*>(skmer.data()), _kmer_length, 0, reinterpret_cast<void*>(&kmer_hash));
+			keys.push_back(kmer_hash.msb);
+			logc.push_back(std::log(counter));
 		}
+		std::size_t slice = (keys.size() + nthreads - 1) / nthreads;
+		std::vector<std::thread> workers;
+		for(std::size_t t = 1; t < nthreads and t * slice < keys.size(); ++t)
+		{
+			workers.emplace_back(sketch_slice, std::cref(keys), std::cref(logc), t * slice, std::min((t + 1) * slice, keys.size()), std::cref(row_seeds), std::ref(partials[t]));
+		}
+		sketch_slice(keys, logc, 0, std::min(slice, keys.size()), row_seeds, partials[0]);
+		for(auto& worker : workers) worker.join();
 	}
 	kmcdb.Close();
 	
+	std::vector<sample_t>& sketch = partials[0];
+	for(std::size_t t = 1; t < nthreads; ++t)
+	{
+		for(std::size_t i = 0; i < s; ++i) if(partials[t][i].kstar < sketch[i].kstar) sketch[i] = partials[t][i];
+	}
 	std::ofstream skstrm(output_path, std::ios_base::binary);
 	save_i2cws_sketch(rseed, sketch, skstrm);
 	skstrm.close();
@@ -345,66 +449,109 @@ int i2cws_main(int argc, char* argv[])
 
 int full_main(int argc, char* argv[])
 {
-	if(argc != 3) 
+	struct accumulator_t {
+		std::size_t numerator, denominator, unione, intersection;
+	};
+
+	static ko_longopt_t longopts[] = {
+		{NULL, 0, 0}
+	};
+	ketopt_t opt = KETOPT_INIT;
+	int c;
+	std::size_t nthreads = 1;
+	while((c = ketopt(&opt, argc, argv, 1, "t:h", longopts)) > 0)
+	{
+		if (c == 't') {
+			nthreads = std::max(std::stoul(opt.arg, nullptr, 10), 1UL);
+		} else {
+			print_full_help();
+			return EXIT_FAILURE;
+		}
+	}
+	if(argc - opt.ind != 2) 
 	{
 		print_full_help();
 		return EXIT_FAILURE;
 	}
+	std::string path1 = argv[opt.ind], path2 = argv[opt.ind + 1];
 
 	CKMCFile file1, file2;
-	if (!file1.OpenForListing(argv[1])) throw std::runtime_error("Unable to open the first kmc database");
-	if (!file2.OpenForListing(argv[2])) throw std::runtime_error("Unable to open the second kmc database");
+	if (!file1.OpenForListing(path1)) throw std::runtime_error("Unable to open the first kmc database");
+	if (!file2.OpenForListing(path2)) throw std::runtime_error("Unable to open the second kmc database");
 	
-	// unsigned int _kmer_length1, _kmer_length2;
-	// unsigned int _mode1, _mode2;
-	// unsigned int _counter_size1, _counter_size2;
-	// unsigned int _lut_prefix_length1, _lut_prefix_length2;
-	// unsigned int _signature_len1, _signature_len2;
-	// unsigned int _min_count1, _min_count2;
-	// unsigned long long _max_count1, _max_count2;
-	// unsigned long long _total_kmers1, _total_kmers2;
-	// file1.Info(_kmer_length1, _mode1, _counter_size1, _lut_prefix_length1, _signature_len1, _min_count1, _max_count1, _total_kmers1);
-	// file2.Info(_kmer_length2, _mode2, _counter_size2, _lut_prefix_length2, _signature_len2, _min_count2, _max_count2, _total_kmers2);
 	CKMCFileInfo infos;
 	file1.Info(infos);
 	unsigned int _kmer_length1 = infos.kmer_length;
+	unsigned int _lut_prefix_length1 = infos.lut_prefix_length;
 	file2.Info(infos);
 	unsigned int _kmer_length2 = infos.kmer_length;
+	unsigned int _lut_prefix_length2 = infos.lut_prefix_length;
 	if (_kmer_length1 != _kmer_length2) {
 		throw std::runtime_error("Error, the two data bases use different k-mer lengths");
 	}
+	/* 
+	 * Partitions must contain the same k-mers in both databases: this holds for (sorted) kmc1 databases 
+	 * sharing the LUT prefix length, where the LUT index is the k-mer prefix.
+	 */
+	std::vector<std::pair<uint64_t, uint64_t>> partitions(1, std::make_pair(0, UINT64_MAX));
+	if (nthreads > 1) 
+	{
+		if (file1.IsKMC2() or file2.IsKMC2() or _lut_prefix_length1 != _lut_prefix_length2) 
+			std::cerr << "[Warning] databases cannot be partitioned consistently, falling back to a single thread\n";
+		else partitions = lut_partitions(file1.LUTSize(), nthreads);
+	}
+	file1.Close();
+	file2.Close();
 
-	CKmerAPI kmer1(_kmer_length1), kmer2(_kmer_length2);
-	uint32_t counter1, counter2;
-	counter1 = counter2 = 0;
-	std::size_t numerator, denominator, unione, intersection;
-	intersection = unione = numerator = denominator = 0;
-	bool s2r1 = true;
-	bool s2r2 = true;
-	while(s2r1 || s2r2)
+	std::vector<accumulator_t> partials(partitions.size(), accumulator_t{0, 0, 0, 0});
+	std::vector<char> opened(partitions.size(), 0);
+	for_each_partition(partitions.size(), [&](std::size_t p)
 	{
-		if(s2r1 && s2r2 && kmer1 == kmer2)
-		{
-			unione += 1;
-			intersection += 1;
-			numerator += std::min(counter1, counter2);
-			denominator += std::max(counter1,counter2);
-			s2r1 = file1.ReadNextKmer(kmer1, counter1);
-			s2r2 = file2.ReadNextKmer(kmer2, counter2);
-		}
-		else if (s2r1 && (!s2r2 || kmer1 < kmer2))
-		{
-			unione += 1;
-			denominator += counter1;
-			s2r1 = file1.ReadNextKmer(kmer1, counter1);
-		}
-		else if (s2r2 && (!s2r1 || kmer2 < kmer1))
+		CKMCFile part1, part2;
+		if (!part1.OpenForListing(path1, partitions[p].first, partitions[p].second)) return;
+		if (!part2.OpenForListing(path2, partitions[p].first, partitions[p].second)) return;
+		opened[p] = 1;
+		CKmerAPI kmer1(_kmer_length1), kmer2(_kmer_length2);
+		uint32_t counter1, counter2;
+		counter1 = counter2 = 0;
+		accumulator_t& acc = partials[p];
+		bool s2r1 = part1.ReadNextKmer(kmer1, counter1);
+		bool s2r2 = part2.ReadNextKmer(kmer2, counter2);
+		while(s2r1 || s2r2)
 		{
-			unione += 1;
-			denominator += counter2;
-			s2r2 = file2.ReadNextKmer(kmer2, counter2);
+			if(s2r1 && s2r2 && kmer1 == kmer2)
+			{
+				acc.unione += 1;
+				acc.intersection += 1;
+				acc.numerator += std::min(counter1, counter2);
+				acc.denominator += std::max(counter1,counter2);
+				s2r1 = part1.ReadNextKmer(kmer1, counter1);
+				s2r2 = part2.ReadNextKmer(kmer2, counter2);
+			}
+			else if (s2r1 && (!s2r2 || kmer1 < kmer2))
+			{
+				acc.unione += 1;
+				acc.denominator += counter1;
+				s2r1 = part1.ReadNextKmer(kmer1, counter1);
+			}
+			else if (s2r2 && (!s2r1 || kmer2 < kmer1))
+			{
+				acc.unione += 1;
+				acc.denominator += counter2;
+				s2r2 = part2.ReadNextKmer(kmer2, counter2);
+			}
 		}
-		//std::cerr << "partial num = " << numerator << " partial den = " << denominator << std::endl;
+	});
+	if(std::find(opened.cbegin(), opened.cend(), 0) != opened.cend()) throw std::runtime_error("Unable to open the kmc databases");
+
+	std::size_t numerator, denominator, unione, intersection;
+	intersection = unione = numerator = denominator = 0;
+	for(auto const& acc : partials)
+	{
+		numerator += acc.numerator;
+		denominator += acc.denominator;
+		unione += acc.unione;
+		intersection += acc.intersection;
 	}
 	if(intersection == 0 && unione == 0) intersection = unione = 1;
 	if(numerator == 0 && denominator == 0) numerator = denominator = 1;
@@ -418,39 +565,54 @@ int full_main(int argc, char* argv[])
 
 int get_total_kmers_main(int argc, char* argv[]) 
 {
-	if(argc != 2) 
+	static ko_longopt_t longopts[] = {
+		{NULL, 0, 0}
+	};
+	ketopt_t opt = KETOPT_INIT;
+	int c;
+	std::size_t nthreads = 1;
+	while((c = ketopt(&opt, argc, argv, 1, "t:h", longopts)) > 0)
+	{
+		if (c == 't') {
+			nthreads = std::max(std::stoul(opt.arg, nullptr, 10), 1UL);
+		} else {
+			print_total_help();
+			return EXIT_FAILURE;
+		}
+	}
+	if(argc - opt.ind != 1) 
 	{
 		print_total_help();
 		return EXIT_FAILURE;
 	}
+	std::string kmc_path = argv[opt.ind];
 
 	CKMCFile kmcdb;
-	if (!kmcdb.OpenForListing(argv[1])) {
+	if (!kmcdb.OpenForListing(kmc_path)) {
 		throw std::runtime_error("Unable to open the database\n");
 	}
 	
-	// unsigned int _kmer_length;
-	// unsigned int _mode;
-	// unsigned int _counter_size;
-	// unsigned int _lut_prefix_length;
-	// unsigned int _signature_len;
-	// unsigned int _min_count;
-	// unsigned long long _max_count;
-	// unsigned long long _total_kmers;
-	// kmcdb.Info(_kmer_length, _mode, _counter_size, _lut_prefix_length, _signature_len, _min_count, _max_count, _total_kmers);
 	CKMCFileInfo infos;
 	kmcdb.Info(infos);
 	unsigned int _kmer_length = infos.kmer_length;
+	auto partitions = lut_partitions(kmcdb.LUTSize(), nthreads);
+	kmcdb.Close();
 
-	CKmerAPI kmer(_kmer_length);	
-	uint32_t counter;
-	unsigned long long total = 0;
-
-	while(kmcdb.ReadNextKmer(kmer, counter))
+	std::vector<unsigned long long> partials(partitions.size(), 0);
+	std::vector<char> opened(partitions.size(), 0);
+	for_each_partition(partitions.size(), [&](std::size_t p)
 	{
-		total += counter;
-	}
+		CKMCFile kmcpart;
+		if (!kmcpart.OpenForListing(kmc_path, partitions[p].first, partitions[p].second)) return;
+		opened[p] = 1;
+		CKmerAPI kmer(_kmer_length);	
+		uint32_t counter;
+		while(kmcpart.ReadNextKmer(kmer, counter)) partials[p] += counter;
+	});
+	if(std::find(opened.cbegin(), opened.cend(), 0) != opened.cend()) throw std::runtime_error("Unable to open the database\n");
 
+	unsigned long long total = 0;
+	for(auto partial : partials) total += partial;
 	std::cout << total;
 	return 0;
 }
@@ -468,6 +630,8 @@ int main(int argc, char* argv[])
 
 	if (std::strcmp(argv[om.ind], "sketch") == 0) {
 		return wmh_main(argc - om.ind, &argv[om.ind]);
+	} else if (std::strcmp(argv[om.ind], "i2cws") == 0) {
+		return i2cws_main(argc - om.ind, &argv[om.ind]);
 	} else if (std::strcmp(argv[om.ind], "compare") == 0) {
 		return compare_main(argc - om.ind, &argv[om.ind]);
 	} else if (std::strcmp(argv[om.ind], "full") == 0) {
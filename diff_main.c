@@ -2,37 +2,52 @@
 #include <stdio.h>
 #include "diff_main.h"
 #include "ketopt.h"
+#include "constants.h"
 #include "ibflib.h"
+#include "shard.h"
+#include "shard_main.h"
+#include "stats.h"
+
+#define SPARSE_DENSITY 0.25 /*difference sketches with fewer nonzero buckets are stored sparse*/
 
 void print_diff_help();
 
 enum Error diff_main(int argc, char** argv) {
     ketopt_t opt;
-    ibf_t ibf1, ibf2, res;
+    ibf_t ibf;
     int c;
-    char *output_path;
+    char *ipath, *jpath, *output_path;
+    uint64_t nonzero, buffer_size;
+    double density;
+    uint8_t sharded;
+    unsigned int threads;
     enum Error err;
 
     opt = KETOPT_INIT;
-    output_path = NULL;
-    res.seres = NULL;
-    res.data = NULL;
+    ipath = jpath = output_path = NULL;
+    density = SPARSE_DENSITY;
+    buffer_size = 0;
+    threads = 1;
     err = NO_ERROR;
 
-    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
-    while((c = ketopt(&opt, argc, argv, 1, "i:j:o:h", longopts)) >= 0) {
+    static ko_longopt_t longopts[] = {{"hugepages", ko_no_argument, LONGOPT_HUGEPAGES}, {"stats", ko_no_argument, LONGOPT_STATS}, {"sparse", ko_required_argument, LONGOPT_SPARSE}, {"buffer", ko_required_argument, LONGOPT_BUFFER}, {NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:j:o:t:h", longopts)) >= 0) {
         if (c == 'i') {
-            if ((err = ibf_sketch_load(opt.arg, &ibf1)) != NO_ERROR) {
-                fprintf(stderr, "Unable to read the first invertible bloom filter\n");
-                return err;
-            }
+            ipath = opt.arg;
         } else if (c == 'j') {
-            if ((err = ibf_sketch_load(opt.arg, &ibf2)) != NO_ERROR) {
-                fprintf(stderr, "Unable to read the second invertible bloom filter\n");
-                return err;
-            }
+            jpath = opt.arg;
         } else if (c == 'o') {
             output_path = opt.arg;
+        } else if (c == 't') {
+            threads = (unsigned int)strtoul(opt.arg, NULL, 10);
+        } else if (c == LONGOPT_HUGEPAGES) {
+            ibf_set_alloc_policy(IBF_ALLOC_HUGEPAGES);
+        } else if (c == LONGOPT_STATS) {
+            stats_enable("diff");
+        } else if (c == LONGOPT_SPARSE) {
+            density = atof(opt.arg);
+        } else if (c == LONGOPT_BUFFER) {
+            buffer_size = strtoull(opt.arg, NULL, 10) << 20;
         } else if (c == 'h') {
             print_diff_help();
             return NO_ERROR;
@@ -41,14 +56,42 @@ enum Error diff_main(int argc, char** argv) {
             return ERR_OPTION;
         }
     }
-    if (output_path == NULL) {
-        err = ERR_VALUE;
+    if (ipath == NULL || jpath == NULL || output_path == NULL) {
+        print_diff_help();
+        return ERR_OPTION;
+    }
+    if (sharded_is(ipath, &sharded) == NO_ERROR && sharded) {/*shard by shard, in parallel, each shard stored sparse or dense on its own*/
+        err = sharded_diff(ipath, jpath, output_path, threads, density);
+        stats_print(stderr);
+        return err;
+    }
+    if (buffer_size != 0) {/*streaming: the density is only known at the end, the difference is sparse unless --sparse 0*/
+        stats_begin(STATS_DIFF);
+        if ((err = ibf_sketch_diff_stream(ipath, jpath, output_path, buffer_size, density > 0)) == ERR_INCOMPATIBLE) fprintf(stderr, "Error while computing the ibf difference\n");
+        else if (err != NO_ERROR) fprintf(stderr, "Error while streaming the difference\n");
+        stats_end(STATS_DIFF);
+        stats_print(stderr);
+        return err;
+    }
+    /*the first sketch is loaded once all options are known, the allocation policy applies to it*/
+    stats_begin(STATS_LOAD);
+    err = ibf_sketch_load(ipath, &ibf);
+    stats_end(STATS_LOAD);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "Unable to read the first invertible bloom filter\n");
+        stats_print(stderr);
+        return err;
     }
-    if (!err && (err = ibf_sketch_diff(&ibf1, &ibf2, &res)) != NO_ERROR) fprintf(stderr, "Error while computing the ibf difference\n");
-    if (!err && (err = ibf_sketch_store(output_path, &res)) != NO_ERROR) fprintf(stderr, "Error saving the difference\n");
-    if (!err) err = ibf_sketch_destroy(&ibf1);
-    if (!err) err = ibf_sketch_destroy(&ibf2);
-    if (!err) err = ibf_sketch_destroy(&res);
+    stats_begin(STATS_DIFF);/*the second one is subtracted from it while being read*/
+    if ((err = ibf_sketch_sub_load(jpath, &ibf)) == ERR_INCOMPATIBLE) fprintf(stderr, "Error while computing the ibf difference\n");
+    else if (err != NO_ERROR) fprintf(stderr, "Unable to read the second invertible bloom filter\n");
+    stats_end(STATS_DIFF);
+    stats_begin(STATS_STORE);
+    if (!err) err = ibf_sketch_nonzero(&ibf, &nonzero);
+    if (!err && (err = nonzero < density * ibf.chunk_size * ibf.repetitions ? ibf_sketch_store_sparse(output_path, &ibf) : ibf_sketch_store(output_path, &ibf)) != NO_ERROR) fprintf(stderr, "Error saving the difference\n");
+    stats_end(STATS_STORE);
+    stats_print(stderr);
+    ibf_sketch_destroy(&ibf);
     return err;
 }
 
@@ -57,5 +100,10 @@ void print_diff_help() {
     fprintf(stderr, "\t-i\tfirst sketch\n");
     fprintf(stderr, "\t-j\tsecond sketch\n");
     fprintf(stderr, "\t-o\tresulting sketch when making $i - $j\n");
+    fprintf(stderr, "\t-t\tnumber of threads, each one subtracting a shard at a time (sharded sketches) [1]\n");
+    fprintf(stderr, "\t--sparse\tstore the difference sparse (nonzero buckets only) if less than this fraction of its buckets is nonzero, 0 never [%.2f]\n", SPARSE_DENSITY);
+    fprintf(stderr, "\t--buffer\tstream the sketches through this many MiB of memory instead of loading them, the difference is then stored sparse unless --sparse 0 [0: load]\n");
+    fprintf(stderr, "\t--hugepages\tback the sketches with huge pages (explicit if reserved, transparent otherwise)\n");
+    fprintf(stderr, "\t--stats\tprint run statistics (phase times, counters, peak memory) as JSON on stderr\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }
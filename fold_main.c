@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "fold_main.h"
+#include "ketopt.h"
+#include "ibflib.h"
+
+void print_fold_help();
+
+/*
+ * Shrink a foldable sketch (build -F) by a power-of-two factor, given directly or as the smallest sketch still
+ * tracking n differences. The result is the sketch that build -F would produce with the smaller chunk size.
+ */
+enum Error fold_main(int argc, char** argv) {
+    ketopt_t opt;
+    ibf_t ibf, res;
+    int c;
+    char *ipath, *output_path;
+    uint64_t factor;
+    unsigned int n;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    ipath = output_path = NULL;
+    factor = 0;
+    n = 0;
+    res.seres = NULL;
+    res.data = NULL;
+    err = NO_ERROR;
+
+    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:o:f:n:h", longopts)) >= 0) {
+        if (c == 'i') {
+            ipath = opt.arg;
+        } else if (c == 'o') {
+            output_path = opt.arg;
+        } else if (c == 'f') {
+            factor = strtoull(opt.arg, NULL, 10);
+        } else if (c == 'n') {
+            n = (unsigned int)strtoul(opt.arg, NULL, 10);
+        } else if (c == 'h') {
+            print_fold_help();
+            return NO_ERROR;
+        } else {
+            fprintf(stderr, "Option -%c not available\n", c);
+            return ERR_OPTION;
+        }
+    }
+    if (ipath == NULL || output_path == NULL || (factor == 0) == (n == 0)) {
+        print_fold_help();
+        return ERR_OPTION;
+    }
+    if ((err = ibf_sketch_load(ipath, &ibf)) != NO_ERROR) {
+        fprintf(stderr, "Unable to read the invertible bloom filter\n");
+        return err;
+    }
+    if (n != 0 && (err = ibf_sketch_fold_factor(&ibf, n, &factor)) != NO_ERROR) fprintf(stderr, "Only sketches built with -F can be folded\n");
+    if (!err && (err = ibf_sketch_fold(&ibf, factor, &res)) != NO_ERROR) {
+        if (err == ERR_INCOMPATIBLE) fprintf(stderr, "Only sketches built with -F can be folded\n");
+        else fprintf(stderr, "The folding factor must be a power of two not larger than the chunk size (%llu)\n", (unsigned long long)ibf.chunk_size);
+    }
+    if (!err && (err = ibf_sketch_store(output_path, &res)) != NO_ERROR) fprintf(stderr, "Error saving the folded sketch\n");
+    if (!err) fprintf(stderr, "[fold] chunk size %llu -> %llu (factor %llu)\n", (unsigned long long)ibf.chunk_size, (unsigned long long)res.chunk_size, (unsigned long long)factor);
+    ibf_sketch_destroy(&ibf);
+    ibf_sketch_destroy(&res);
+    return err;
+}
+
+void print_fold_help() {
+    fprintf(stderr, "[fold] options:\n");
+    fprintf(stderr, "\t-i\tfoldable sketch (build -F)\n");
+    fprintf(stderr, "\t-o\tfolded sketch\n");
+    fprintf(stderr, "\t-f\tfolding factor, a power of two: cells i, i + c/f, i + 2c/f, ... of each repetition are merged\n");
+    fprintf(stderr, "\t-n\tfold as much as possible while still tracking n differences (instead of -f)\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
@@ -0,0 +1,8 @@
+#ifndef FOLD_MAIN_H
+#define FOLD_MAIN_H
+
+#include "err.h"
+
+enum Error fold_main(int argc, char** argv);
+
+#endif/*FOLD_MAIN_H*/
@@ -0,0 +1,304 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ketopt.h"
+#include "constants.h"
+#include "ibflib.h"
+#include "mmlib.h"
+#include "minHash.h"
+#include "err.h"
+
+/*
+ * Microbenchmarks of the hot paths of ibflib, mmlib and minHash on synthetic data generated with fixed seeds.
+ * One CSV line per benchmark and parameter is written to stdout:
+ *
+ * benchmark,param,ops,keys,ns_per_op,keys_per_s
+ *
+ * ops counts the elementary operations of a run (keys inserted, listed or packed, bases scanned, buckets diffed,
+ * stored or loaded) and keys the keys involved (stored in the sketches, listed, or fragments found).
+ * Timings are the best of -t runs, so that lines can be compared across releases.
+ * IBLT benchmarks take the load factor (keys / n) of sketches built for n differences, i.e. relative to the
+ * peeling threshold of ck_table: the last load factors are expected to fail peeling sometimes.
+ */
+
+#define BENCH_SEED 42
+#define SKETCH_R 3
+
+static float load_factors[] = {0.25, 0.5, 0.75, 0.9, 1.0};
+
+void print_ibfbench_help();
+
+static uint64_t bench_state;
+static volatile uint64_t bench_sink;/*keeps the results of pure functions alive*/
+
+static uint64_t bench_rand() {/*splitmix64*/
+    uint64_t z = (bench_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void random_bases(char *seq, uint64_t len) {
+    uint64_t i;
+    for(i = 0; i < len; ++i) seq[i] = "ACGT"[bench_rand() & 3];
+}
+
+#if !defined(DNALEN)
+static void random_bytes(char *seq, uint64_t len) {
+    uint64_t i;
+    for(i = 0; i < len; ++i) seq[i] = (char)bench_rand();
+}
+#endif
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(char const *benchmark, char const *param, uint64_t ops, uint64_t keys, double ns) {
+    fprintf(stdout, "%s,%s,%llu,%llu,%.3f,%.0f\n", benchmark, param, (unsigned long long)ops, (unsigned long long)keys, ns / ops, keys / (ns / 1e9));
+    fflush(stdout);
+}
+
+static void count_bucket(bucket_t const *const bucket, char source, void *listed) {
+    ++*(uint64_t*)listed;
+}
+
+/*insert keys [first, last) with a stride into a new sketch built for n differences, return the time taken*/
+static int fill_sketch(char const *keys, unsigned int klen, uint64_t first, uint64_t last, uint64_t stride, unsigned int n, uint8_t *buffer, ibf_t *sketch, double *ns) {
+    int err;
+    uint64_t i;
+    double t0;
+    memset(sketch, 0, sizeof *sketch);
+    if ((err = ibf_sketch_init(BENCH_SEED, SKETCH_R, 0, n, sketch)) != NO_ERROR) return err;
+    #ifdef GLEN
+    sketch->key_len = klen;
+    #endif
+    t0 = now_ns();
+    for(i = first; i < last && err == NO_ERROR; i += stride) err = ibf_insert_seq(keys, i * klen, (i + 1) * klen, sketch, buffer, WSIZE);
+    *ns = now_ns() - t0;
+    return err;
+}
+
+static int bench_ibf(char const *keys, unsigned int klen, unsigned int n, int trials, char const *tmpdir) {
+    int err, t, fd;
+    unsigned int l;
+    uint64_t nkeys, listed, buckets;
+    double ns, best_insert, best_diff, best_list, best_store, best_load, t0;
+    char param[32], path[4096];
+    uint8_t *buffer;
+    ibf_t a, b, d, work, loaded;
+
+    err = NO_ERROR;
+    if ((err = ibf_buffer_init(&buffer)) != NO_ERROR) return err;
+    memset(&work, 0, sizeof work);
+    snprintf(path, sizeof path, "%s/ibfbenchXXXXXX", tmpdir);
+    if ((fd = mkstemp(path)) < 0) {
+        ibf_buffer_destroy(&buffer);
+        return ERR_FILE;
+    }
+    close(fd);
+    for(l = 0; l < sizeof load_factors / sizeof load_factors[0] && err == NO_ERROR; ++l) {
+        nkeys = (uint64_t)(load_factors[l] * n);
+        snprintf(param, sizeof param, "load=%.2f", load_factors[l]);
+        best_insert = best_diff = best_list = best_store = best_load = -1;
+        listed = buckets = 0;
+        for(t = 0; t < trials && err == NO_ERROR; ++t) {
+            /*a and b hold every other key, so that their difference holds nkeys keys from both sides*/
+            if ((err = fill_sketch(keys, klen, 0, nkeys, 2, n, buffer, &a, &ns)) != NO_ERROR) break;
+            if ((err = fill_sketch(keys, klen, 1, nkeys, 2, n, buffer, &b, &t0)) != NO_ERROR) break;
+            ns += t0;
+            if (best_insert < 0 || ns < best_insert) best_insert = ns;
+            d.data = NULL;
+            d.seres = NULL;
+            t0 = now_ns();
+            err = ibf_sketch_diff(&a, &b, &d);
+            ns = now_ns() - t0;
+            if (best_diff < 0 || ns < best_diff) best_diff = ns;
+            if (err == NO_ERROR) err = ibf_sketch_copy(&d, &work);
+            listed = 0;
+            t0 = now_ns();
+            if (err == NO_ERROR) ibf_list_seq(&work, &count_bucket, &listed);/*peeling may fail at high loads: listed then counts the keys peeled anyway*/
+            ns = now_ns() - t0;
+            if (best_list < 0 || ns < best_list) best_list = ns;
+            t0 = now_ns();
+            if (err == NO_ERROR) err = ibf_sketch_store(path, &d);
+            ns = now_ns() - t0;
+            if (best_store < 0 || ns < best_store) best_store = ns;
+            t0 = now_ns();
+            if (err == NO_ERROR) err = ibf_sketch_load(path, &loaded);
+            ns = now_ns() - t0;
+            if (best_load < 0 || ns < best_load) best_load = ns;
+            if (err == NO_ERROR) ibf_sketch_destroy(&loaded);
+            buckets = a.chunk_size * a.repetitions;
+            ibf_sketch_destroy(&a);
+            ibf_sketch_destroy(&b);
+            ibf_sketch_destroy(&d);
+        }
+        if (err != NO_ERROR) break;
+        report("ibf_insert_seq", param, nkeys, nkeys, best_insert);
+        report("ibf_sketch_diff", param, buckets, nkeys, best_diff);
+        report("ibf_list_seq", param, listed, listed, best_list);
+        report("ibf_sketch_store", param, buckets, nkeys, best_store);
+        report("ibf_sketch_load", param, buckets, nkeys, best_load);
+    }
+    remove(path);
+    ibf_sketch_destroy(&work);
+    ibf_buffer_destroy(&buffer);
+    return err;
+}
+
+static int bench_pack2bit(char const *keys, unsigned int k, uint64_t nkeys, int trials) {
+    int t;
+    uint64_t i;
+    double t0, ns, best;
+    unsigned char out[32];
+    char param[32];
+    best = -1;
+    for(t = 0; t < trials; ++t) {
+        t0 = now_ns();
+        for(i = 0; i < nkeys; ++i) {
+            memset(out, 0, CEILING(k, 4));
+            if (pack2bit(&keys[i * k], k, out) != NO_ERROR) return ERR_RUNTIME;
+            bench_sink += out[0];
+        }
+        ns = now_ns() - t0;
+        if (best < 0 || ns < best) best = ns;
+    }
+    snprintf(param, sizeof param, "k=%u", k);
+    report("pack2bit", param, nkeys, nkeys, best);
+    return NO_ERROR;
+}
+
+static int bench_fragmenters(char const *seq, uint64_t slen, int trials) {
+    int t, err;
+    double t0, ns, best_mm, best_sync;
+    uint32_v_t pos;
+    uint64_t mm_found, sync_found;
+    err = NO_ERROR;
+    pos.n = pos.m = 0;
+    pos.a = NULL;
+    best_mm = best_sync = -1;
+    mm_found = sync_found = 0;
+    for(t = 0; t < trials && err == NO_ERROR; ++t) {
+        pos.n = 0;
+        t0 = now_ns();
+        err = mm_get_pos(seq, slen, 15, 16, BENCH_SEED, &pos);
+        ns = now_ns() - t0;
+        if (best_mm < 0 || ns < best_mm) best_mm = ns;
+        mm_found = pos.n;
+        pos.n = 0;
+        t0 = now_ns();
+        if (err == NO_ERROR) err = sync_get_pos(seq, slen, 31, 11, BENCH_SEED, &pos);
+        ns = now_ns() - t0;
+        if (best_sync < 0 || ns < best_sync) best_sync = ns;
+        sync_found = pos.n;
+    }
+    free(pos.a);
+    if (err != NO_ERROR) return err;
+    report("mm_get_pos", "m=15 w=16", slen, mm_found, best_mm);
+    report("sync_get_pos", "k=31 s=11", slen, sync_found, best_sync);
+    return NO_ERROR;
+}
+
+static int bench_minhash(char const *keys, unsigned int k, uint64_t nkeys, int trials) {
+    int t, err;
+    uint64_t i;
+    double t0, ns, best;
+    minhash_t sketch;
+    best = -1;
+    err = NO_ERROR;
+    for(t = 0; t < trials && err == NO_ERROR; ++t) {
+        if ((err = minhash_sketch_init(BENCH_SEED, 1000, 64, &sketch)) != NO_ERROR) break;
+        t0 = now_ns();
+        for(i = 0; i < nkeys && err == NO_ERROR; ++i) err = minhash_sketch_insert(&keys[i * k], k, 1000, &sketch);
+        if (err == NO_ERROR) err = minhash_sketch_finalize(1000, &sketch);
+        ns = now_ns() - t0;
+        if (best < 0 || ns < best) best = ns;
+        minhash_sketch_destroy(&sketch);
+    }
+    if (err == NO_ERROR) report("minhash_sketch_insert", "s=1000 h=64", nkeys, nkeys, best);
+    return err;
+}
+
+int main(int argc, char *argv[]) {
+    ketopt_t opt;
+    int c, trials;
+    unsigned int n, k, klen;
+    uint64_t slen;
+    char *keys, *tmpdir;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    n = 1000000;
+    k = 31;
+    trials = 3;
+    tmpdir = "/tmp";
+    err = NO_ERROR;
+
+    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "n:k:t:d:h", longopts)) >= 0) {
+        if (c == 'n') {
+            n = (unsigned int)strtoul(opt.arg, NULL, 10);
+        } else if (c == 'k') {
+            k = (unsigned int)strtoul(opt.arg, NULL, 10);
+        } else if (c == 't') {
+            trials = atoi(opt.arg);
+        } else if (c == 'd') {
+            tmpdir = opt.arg;
+        } else if (c == 'h') {
+            print_ibfbench_help();
+            return EXIT_SUCCESS;
+        } else {
+            fprintf(stderr, "Option -%c not available\n", c);
+            print_ibfbench_help();
+            return EXIT_FAILURE;
+        }
+    }
+    if (n == 0 || trials <= 0 || k == 0 || k > 32) {
+        fprintf(stderr, "0 < n, 0 < t and 0 < k <= 32\n");
+        return EXIT_FAILURE;
+    }
+    #if defined(DNALEN)
+    if (k > DNALEN) k = DNALEN;
+    klen = k;/*keys of the IBLT benchmarks are k-mers*/
+    #else
+    klen = WSIZE;/*keys of the IBLT benchmarks are random hash values*/
+    #endif
+    slen = (uint64_t)n * (k > klen ? k : klen);
+    if ((keys = (char*)malloc(slen)) == NULL) {
+        print_error(ERR_ALLOC, "synthetic data");
+        return EXIT_FAILURE;
+    }
+    bench_state = BENCH_SEED;
+    #if defined(DNALEN)
+    random_bases(keys, slen);
+    #else
+    random_bytes(keys, slen);
+    #endif
+
+    fprintf(stdout, "benchmark,param,ops,keys,ns_per_op,keys_per_s\n");
+    err = bench_ibf(keys, klen, n, trials, tmpdir);
+    print_error(err, "IBLT benchmarks");
+    if (err == NO_ERROR) {
+        random_bases(keys, slen);/*the remaining benchmarks work on DNA*/
+        if ((err = bench_pack2bit(keys, k, n, trials)) != NO_ERROR) print_error(err, "pack2bit benchmark");
+    }
+    if (err == NO_ERROR && (err = bench_fragmenters(keys, slen, trials)) != NO_ERROR) print_error(err, "fragmenter benchmarks");
+    if (err == NO_ERROR && (err = bench_minhash(keys, k, n, trials)) != NO_ERROR) print_error(err, "minHash benchmark");
+    free(keys);
+    return err == NO_ERROR ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void print_ibfbench_help() {
+    fprintf(stderr, "ibfbench options:\n");
+    fprintf(stderr, "\t-n\tnumber of differences the benchmarked sketches are built for, and number of synthetic k-mers [1000000]\n");
+    fprintf(stderr, "\t-k\tk-mer length (at most the configured sequence length) [31]\n");
+    fprintf(stderr, "\t-t\tnumber of runs, the fastest one is reported [3]\n");
+    fprintf(stderr, "\t-d\tfolder for the temporary sketch of the store/load benchmarks [/tmp]\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
@@ -8,6 +8,14 @@
 #include "endian_fixer.h"
 
 #include <assert.h>
+#include <pthread.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
 
 /*From paper "Invertible Bloom Lookup Tables" (Michael T. Goodrich, Michael Mitzenmacher)*/
 
@@ -20,6 +28,21 @@ typedef union {
 	uint32_t u32;
 } ufloat32_t;
 
+/*
+ * The first byte of a sketch file stores the number of repetitions (r < 8) in its low 3 bits.
+ * Bit 3 is set in sparse files (only nonzero buckets are stored, see ibf_sketch_write_sparse).
+ * The high nibble records the sketch options: the hash family (bits 4-5) and the bucket layout (bits 6-7).
+ * Sketches written before these options were introduced have a zero high nibble and are read as classic MurmurHash3 sketches.
+ * Blocked sketches also store their block width (uint32) right after the chunk size.
+ * Foldable sketches are classic sketches whose chunk size is a power of two (checked when loading).
+ */
+#define HEADER_REPETITIONS_MASK 0x07
+#define HEADER_SPARSE 0x08
+#define HEADER_HASH_SHIFT 4
+#define HEADER_HASH_MASK 0x03
+#define HEADER_LAYOUT_SHIFT 6
+#define HEADER_LAYOUT_MASK 0x03
+
 int ibf_hash_init(unsigned int root_seed, unsigned char r, hash_gen_t **const gen) {
 	int i, j;
 	assert(gen != NULL);
@@ -60,14 +83,107 @@ int ibf_hash_load(FILE *const in, hash_gen_t *const gen) {
 	return NO_ERROR;
 }
 
-int ibf_hash_seq(char const *const seq, unsigned int start, unsigned int end, unsigned char r, hash_gen_t *const res) {
+/*
+ * Fast hash families.
+ * The key is first reduced to a 64-bit digest, then each repetition mixes the digest with its own seed.
+ * mix64 consumes the key one 64-bit word at a time (a single mixing step for keys of at most 8 bytes, k <= 32),
+ * wyhash consumes 16 bytes per 64x64->128 bit multiplication and is meant for wide keys.
+ * Words are assembled in little-endian order so that sketches do not depend on the host endianness.
+ */
+#define WYP0 0xa0761d6478bd642fULL
+#define WYP1 0xe7037ed1a0b428dbULL
+#define GOLDEN64 0x9e3779b97f4a7c15ULL
+
+static char const *const hash_family_names[IBF_HASH_FAMILIES] = {"murmur3", "mix64", "wyhash"};
+
+static inline uint64_t ibf_mix64(uint64_t x) {/*splitmix64 finalizer*/
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+static inline uint64_t ibf_mum(uint64_t a, uint64_t b) {/*xor of the two halves of the 128-bit product*/
+#ifdef __SIZEOF_INT128__
+	uint128_t p = (uint128_t)a * b;
+	return (uint64_t)p ^ (uint64_t)(p >> 64);
+#else
+	uint64_t ha, hb, la, lb, rh, rm0, rm1, rl, t, lo, hi;
+	ha = a >> 32; hb = b >> 32; la = (uint32_t)a; lb = (uint32_t)b;
+	rh = ha * hb; rm0 = ha * lb; rm1 = hb * la; rl = la * lb;
+	t = rl + (rm0 << 32);
+	lo = t + (rm1 << 32);
+	hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+	return lo ^ hi;
+#endif
+}
+
+static inline uint64_t ibf_load64(uint8_t const *const p, size_t len) {/*little-endian, zero-padded if len < 8*/
+	uint64_t w;
+	size_t i;
+	w = 0;
+	for(i = 0; i < len && i < 8; ++i) w |= (uint64_t)p[i] << (8 * i);
+	return w;
+}
+
+static uint64_t ibf_digest(uint8_t const *const key, size_t len, uint8_t family) {
+	uint64_t h;
+	size_t i;
+	h = len;
+	switch (family) {
+		case IBF_HASH_MIX64:
+			for(i = 0; i + 8 < len; i += 8) h = ibf_mix64(h ^ ibf_load64(&key[i], 8)) + GOLDEN64;
+			return ibf_mix64(h ^ ibf_load64(&key[i], len - i));
+		case IBF_HASH_WYHASH:
+			h ^= WYP0;/*once, as the seed of wyhash*/
+			for(i = 0; i + 16 < len; i += 16) h = ibf_mum(ibf_load64(&key[i], 8) ^ WYP1, ibf_load64(&key[i + 8], 8) ^ h);
+			return ibf_mum(len ^ WYP1, ibf_mum(ibf_load64(&key[i], len - i) ^ WYP1, (len - i > 8 ? ibf_load64(&key[i + 8], len - i - 8) : 0) ^ h));/*final mix of wyhash*/
+		default:
+			return 0;
+	}
+}
+
+int ibf_hash_seq(char const *const seq, unsigned int start, unsigned int end, unsigned char r, uint8_t family, hash_gen_t *const res) {
 	uint8_t i;
+	uint64_t digest;
 	assert(seq != NULL);
 	assert(res != NULL);
-	for(i = 0; i < r; ++i) MurmurHash3_x64_128(&seq[start], end - start, res[i].seed, (void*)( &(res[i].hash) ));
+	if (family == IBF_HASH_MURMUR3) {
+		for(i = 0; i < r; ++i) MurmurHash3_x64_128(&seq[start], end - start, res[i].seed, (void*)( &(res[i].hash) ));
+	} else if (family < IBF_HASH_FAMILIES) {
+		digest = ibf_digest((uint8_t const*)&seq[start], end - start, family);
+		for(i = 0; i < r; ++i) {
+			res[i].hash.ls64b = ibf_mix64(digest ^ ((uint64_t)res[i].seed + 1) * GOLDEN64);
+			res[i].hash.ms64b = ibf_mix64(digest ^ (uint64_t)res[0].seed * GOLDEN64);/*block of blocked sketches, seeded as the rows*/
+		}
+	} else return ERR_INCOMPATIBLE;
 	return NO_ERROR;
 }
 
+/*
+ * Hash a key as stored in a keysum. 
+ * Counting IBLTs hash (key, weight) pairs so that the same key with different multiplicities 
+ * lands in different buckets and is not cancelled by a difference.
+ */
+static int ibf_hash_key(uint8_t const *const keysum, int64_t weight, unsigned char r, uint8_t family, hash_gen_t *const res) {
+#ifdef STORE_WEIGHTS
+	uint8_t buffer[WSIZE + sizeof(uint64_t)];
+	uint64_t buffer64;
+	memcpy(buffer, keysum, WSIZE);
+	buffer64 = hton64((uint64_t)weight);
+	memcpy(&buffer[WSIZE], &buffer64, sizeof buffer64);
+	return ibf_hash_seq((char*)buffer, 0, sizeof buffer, r, family, res);
+#else
+	return ibf_hash_seq((char const*)keysum, 0, WSIZE, r, family, res);
+#endif
+}
+
 int ibf_bucket_store(FILE *const out, bucket_t const *const bucket) {
 	uint64_t buffer64;
 	#ifndef GLEN
@@ -80,6 +196,10 @@ int ibf_bucket_store(FILE *const out, bucket_t const *const bucket) {
 	assert(bucket != NULL);
 	buffer64 = hton64(bucket->counter);
 	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	#ifdef STORE_WEIGHTS
+	buffer64 = hton64(bucket->weight);
+	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	#endif
 	if (fwrite(bucket->keysum, sizeof(uint8_t), WSIZE, out) != WSIZE) return ERR_IO;
 	#ifndef GLEN
 	buffer_len = hton_len(bucket->key_len);
@@ -97,6 +217,10 @@ int ibf_bucket_load(FILE *const in, bucket_t *const bucket) {
 	assert(bucket != NULL);
 	if (fread(&bucket->counter, sizeof bucket->counter, 1, in) != 1) return ERR_IO;
 	bucket->counter = ntoh64(bucket->counter);
+	#ifdef STORE_WEIGHTS
+	if (fread(&bucket->weight, sizeof bucket->weight, 1, in) != 1) return ERR_IO;
+	bucket->weight = ntoh64(bucket->weight);
+	#endif
 	if (fread(&bucket->keysum, sizeof(uint8_t), WSIZE, in) != WSIZE) return ERR_IO;
 	#ifndef GLEN
 	if (fread(&bucket->key_len, sizeof bucket->key_len, 1, in) != 1) return ERR_IO;
@@ -109,18 +233,289 @@ int ibf_bucket_load(FILE *const in, bucket_t *const bucket) {
 	return NO_ERROR;
 }
 
+static inline unsigned char ibf_bucket_empty(bucket_t const *const bucket) {
+	uint64_t i;
+	if (bucket->counter != 0) return FALSE;
+	#ifdef STORE_WEIGHTS
+	if (bucket->weight != 0) return FALSE;
+	#endif
+	#ifndef GLEN
+	if (bucket->key_len != 0) return FALSE;
+	#endif
+	for(i = 0; i < WSIZE; ++i) if (bucket->keysum[i] != 0) return FALSE;
+	return TRUE;
+}
+
+static inline void ibf_bucket_sub(bucket_t *const a, bucket_t const *const b) {/*a = a - b*/
+	uint64_t i;
+	a->counter -= b->counter;
+	#ifdef STORE_WEIGHTS
+	a->weight -= b->weight;
+	#endif
+	for(i = 0; i < WSIZE; ++i) a->keysum[i] ^= b->keysum[i];
+	#ifndef GLEN
+	a->key_len ^= b->key_len;
+	#endif
+	#ifndef RPOS
+	a->position ^= b->position;
+	#endif
+}
+
+/*
+ * Storage of the buckets.
+ * By default buckets are calloc'ed. ibf_set_alloc_policy makes the sketches allocated afterwards map their
+ * buckets directly (sizes rounded up to HUGE_PAGE_SIZE, aligned on it):
+ * IBF_ALLOC_HUGEPAGES tries explicit huge pages (MAP_HUGETLB, needs pages reserved by the system) first and
+ * falls back to transparent huge pages (madvise(MADV_HUGEPAGE)), then to plain pages.
+ * IBF_ALLOC_INTERLEAVE spreads the pages over all NUMA nodes (mbind(MPOL_INTERLEAVE)), otherwise each page
+ * lands on the node of the thread touching it first (e.g. the kmc2ibf thread filling a sketch).
+ * Every step is best effort: unsupported requests silently fall back to the previous one.
+ */
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define MPOL_INTERLEAVE_MODE 3 /*MPOL_INTERLEAVE of <linux/mempolicy.h>*/
+
+static uint8_t alloc_policy = IBF_ALLOC_DEFAULT;
+
+static __thread ibf_counters_t counters;/*per thread, so that shards can be built and peeled in parallel*/
+
+void ibf_counters_get(ibf_counters_t *const dest) {
+	assert(dest != NULL);
+	*dest = counters;
+}
+
+void ibf_counters_add(ibf_counters_t const *const src) {
+	assert(src != NULL);
+	counters.inserted += src->inserted;
+	counters.skipped += src->skipped;
+	counters.peel_iterations += src->peel_iterations;
+	counters.pure_hits += src->pure_hits;
+	counters.false_pure += src->false_pure;
+	counters.remaining_cells += src->remaining_cells;
+}
+
+void ibf_set_alloc_policy(uint8_t policy) {
+	alloc_policy = policy;
+}
+
+#if defined(MAP_ANONYMOUS)
+static void *ibf_data_map(size_t len) {
+	uint8_t *mem, *aligned;
+	size_t head;
+	#if defined(__linux__) && defined(SYS_mbind)
+	unsigned long nodemask;
+	#endif
+	mem = MAP_FAILED;
+	#ifdef MAP_HUGETLB
+	if (alloc_policy & IBF_ALLOC_HUGEPAGES) mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	#endif
+	if (mem == MAP_FAILED) {/*over-allocate then trim to a HUGE_PAGE_SIZE aligned region, so that the kernel can back it with huge pages*/
+		if ((mem = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) return NULL;
+		aligned = (uint8_t*)(CEILING((uintptr_t)mem, HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE);
+		head = aligned - mem;
+		if (head) munmap(mem, head);
+		munmap(aligned + len, HUGE_PAGE_SIZE - head);
+		mem = aligned;
+		#ifdef MADV_HUGEPAGE
+		if (alloc_policy & IBF_ALLOC_HUGEPAGES) madvise(mem, len, MADV_HUGEPAGE);
+		#endif
+	}
+	#if defined(__linux__) && defined(SYS_mbind)
+	if (alloc_policy & IBF_ALLOC_INTERLEAVE) {/*before the first touch, nodes outside the allowed ones are ignored by the kernel*/
+		nodemask = ~0UL;
+		syscall(SYS_mbind, mem, len, MPOL_INTERLEAVE_MODE, &nodemask, sizeof nodemask * 8, 0);
+	}
+	#endif
+	return mem;
+}
+#endif
+
+static size_t ibf_data_mapped_size(ibf_t const *const sketch) {
+	return CEILING(sketch->chunk_size * sketch->repetitions * sizeof(bucket_t), HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+}
+
+/*zero-initialized buckets for the current chunk_size and repetitions of sketch*/
+static int ibf_data_alloc(ibf_t *const sketch) {
+	sketch->data_mapped = FALSE;
+	#if defined(MAP_ANONYMOUS)
+	if (alloc_policy != IBF_ALLOC_DEFAULT && sketch->chunk_size * sketch->repetitions * sizeof(bucket_t) >= HUGE_PAGE_SIZE) {
+		if ((sketch->data = (bucket_t*)ibf_data_map(ibf_data_mapped_size(sketch))) != NULL) {
+			sketch->data_mapped = TRUE;
+			return NO_ERROR;
+		}
+	}
+	#endif
+	if ((sketch->data = (bucket_t*)calloc(sketch->chunk_size * sketch->repetitions, sizeof(bucket_t))) == NULL) return ERR_ALLOC;
+	return NO_ERROR;
+}
+
+static void ibf_data_free(ibf_t *const sketch) {
+	if (sketch->data == NULL) return;
+	#if defined(MAP_ANONYMOUS)
+	if (sketch->data_mapped) munmap(sketch->data, ibf_data_mapped_size(sketch));
+	else free(sketch->data);
+	#else
+	free(sketch->data);
+	#endif
+	sketch->data = NULL;
+	sketch->data_mapped = FALSE;
+}
+
 /*
 public access -------------------------------------------------------------------------------------------------
 */
 
 int ibf_sketch_init(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, ibf_t *const sketch) {
-	int err;
+	return ibf_sketch_init_blocked(root_seed, r, epsilon, n, 0, sketch);
+}
+
+/*
+ * Sizing of blocked sketches.
+ * Each block is a small IBLT receiving Poisson(lambda) keys, lambda = n / blocks. It peels if lambda plus
+ * BLOCKED_LOAD_Z standard deviations stays below its threshold r * w / c_k, which fixes the load of a block.
+ * Two keys of the same block also share all their r cells with probability w^-r, an unpeelable pair
+ * whatever the load: the number of blocks keeps the expected number of such pairs, n^2 / (2 * blocks * w^r),
+ * below BLOCKED_MAX_COLLISIONS. This term dominates for narrow blocks, which only suit small sketches:
+ * widths needing more than BLOCKED_MAX_EXPANSION times the classic size are rejected.
+ * BLOCKED_LOAD_Z was calibrated with scripts/layout_bench.py calibrate (r = 3 and 5, n = 10^5 and 10^6).
+ */
+#define BLOCKED_LOAD_Z 3.0
+#define BLOCKED_MAX_COLLISIONS 0.01
+
+static uint64_t ibf_blocked_chunk_size(unsigned char r, float ck, unsigned int n, uint32_t block_width) {
+	double capacity, lambda, blocks_load, blocks_collisions;
+	capacity = r * (double)block_width / ck;
+	lambda = (sqrt(BLOCKED_LOAD_Z * BLOCKED_LOAD_Z + 4 * capacity) - BLOCKED_LOAD_Z) / 2;
+	lambda *= lambda;
+	blocks_load = ceil(n / lambda);
+	blocks_collisions = ceil((double)n * n / (2 * pow(block_width, r) * BLOCKED_MAX_COLLISIONS));
+	if (blocks_load < blocks_collisions) blocks_load = blocks_collisions;
+	return (uint64_t)(blocks_load > 1 ? blocks_load : 1) * block_width;
+}
+
+/*parameters and seeds, without buckets*/
+static int ibf_sketch_shape_blocked(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint32_t block_width, ibf_t *const sketch) {
 	assert(sketch != NULL);
+	sketch->data = NULL;
+	sketch->data_mapped = FALSE;
+	sketch->seres = NULL;
 	sketch->repetitions = r;
+	sketch->hash_family = IBF_HASH_MURMUR3;
 	sketch->epsilon = epsilon;
 	sketch->chunk_size = (unsigned long)ceil((ck_table[sketch->repetitions] + sketch->epsilon) * n / r + 1);
-	if ((sketch->data = (bucket_t*)calloc(sketch->chunk_size * sketch->repetitions, sizeof(bucket_t))) == NULL) return ERR_ALLOC;
-	if ((err = ibf_hash_init(root_seed, sketch->repetitions, &sketch->seres)) != NO_ERROR) return err;
+	if (block_width == 0) {
+		sketch->layout = IBF_LAYOUT_CLASSIC;
+		sketch->block_width = 0;
+	} else {
+		sketch->layout = IBF_LAYOUT_BLOCKED;
+		sketch->block_width = block_width;
+		if (ibf_blocked_chunk_size(r, ck_table[sketch->repetitions] + sketch->epsilon, n, block_width) > BLOCKED_MAX_EXPANSION * sketch->chunk_size) {
+			return ERR_OUTOFBOUNDS;
+		}
+		sketch->chunk_size = ibf_blocked_chunk_size(r, ck_table[sketch->repetitions] + sketch->epsilon, n, block_width);
+	}
+	return ibf_hash_init(root_seed, sketch->repetitions, &sketch->seres);
+}
+
+/*the blocked size shrinks as blocks widen, until a single block is left*/
+uint32_t ibf_blocked_min_width(unsigned char r, float epsilon, unsigned int n) {
+	uint64_t classic;
+	uint32_t low, high, mid;
+	classic = (unsigned long)ceil((ck_table[r] + epsilon) * n / r + 1);
+	for(high = 1; high < (1U << 31) && ibf_blocked_chunk_size(r, ck_table[r] + epsilon, n, high) > BLOCKED_MAX_EXPANSION * classic; high <<= 1);
+	if (ibf_blocked_chunk_size(r, ck_table[r] + epsilon, n, high) > BLOCKED_MAX_EXPANSION * classic) return 0;
+	for(low = high / 2 + 1; low < high;) {/*the narrowest one in (high / 2, high]*/
+		mid = low + (high - low) / 2;
+		if (ibf_blocked_chunk_size(r, ck_table[r] + epsilon, n, mid) > BLOCKED_MAX_EXPANSION * classic) low = mid + 1;
+		else high = mid;
+	}
+	return high;
+}
+
+int ibf_sketch_init_blocked(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint32_t block_width, ibf_t *const sketch) {
+	int err;
+	if ((err = ibf_sketch_shape_blocked(root_seed, r, epsilon, n, block_width, sketch)) != NO_ERROR) return err;
+	return ibf_data_alloc(sketch);
+}
+
+/*
+ * Foldable sketches round the classic chunk size up to a power of two c and place keys with masks (h & (c - 1)).
+ * Since (h mod c) mod c' = h mod c' for any power of two c' < c, summing the cells i, i + c', i + 2c', ... of each
+ * repetition gives the sketch of chunk size c' of the same keys: a sketch built once for a large n can be folded
+ * to compare it with sketches for smaller differences (and to ship less data).
+ */
+static int ibf_sketch_shape_foldable(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, ibf_t *const sketch) {
+	uint64_t classic;
+	assert(sketch != NULL);
+	sketch->data = NULL;
+	sketch->data_mapped = FALSE;
+	sketch->seres = NULL;
+	sketch->repetitions = r;
+	sketch->hash_family = IBF_HASH_MURMUR3;
+	sketch->layout = IBF_LAYOUT_FOLDABLE;
+	sketch->block_width = 0;
+	sketch->epsilon = epsilon;
+	classic = (uint64_t)ceil((ck_table[sketch->repetitions] + sketch->epsilon) * n / r + 1);
+	for(sketch->chunk_size = 1; sketch->chunk_size < classic; sketch->chunk_size <<= 1);
+	return ibf_hash_init(root_seed, sketch->repetitions, &sketch->seres);
+}
+
+int ibf_sketch_init_foldable(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, ibf_t *const sketch) {
+	int err;
+	if ((err = ibf_sketch_shape_foldable(root_seed, r, epsilon, n, sketch)) != NO_ERROR) return err;
+	return ibf_data_alloc(sketch);
+}
+
+int ibf_sketch_shape(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint32_t block_width, unsigned char foldable, ibf_t *const sketch) {
+	if (foldable) return ibf_sketch_shape_foldable(root_seed, r, epsilon, n, sketch);
+	return ibf_sketch_shape_blocked(root_seed, r, epsilon, n, block_width, sketch);
+}
+
+int ibf_sketch_fold(ibf_t const *const sketch, uint64_t factor, ibf_t *const result) {
+	int err;
+	uint64_t i, j, t, k, folded_size, src, dst;
+	assert(sketch != NULL);
+	assert(result != NULL);
+	if (sketch->layout != IBF_LAYOUT_FOLDABLE) return ERR_INCOMPATIBLE;
+	if (factor == 0 || (factor & (factor - 1)) != 0 || factor > sketch->chunk_size) return ERR_VALUE;
+	if ((err = ibf_sketch_destroy(result)) != NO_ERROR) return err;
+	memcpy(result, sketch, sizeof(ibf_t));
+	result->data = NULL;/*the buckets and seeds of sketch must not be freed with result if the allocations below fail*/
+	result->data_mapped = FALSE;
+	result->seres = NULL;
+	folded_size = sketch->chunk_size / factor;
+	result->chunk_size = folded_size;
+	if ((result->seres = (hash_gen_t*)malloc(sketch->repetitions * sizeof(hash_gen_t))) == NULL) return ERR_ALLOC;
+	memcpy(result->seres, sketch->seres, sketch->repetitions * sizeof(hash_gen_t));
+	if ((err = ibf_data_alloc(result)) != NO_ERROR) return err;
+	for(j = 0; j < sketch->repetitions; ++j) {
+		for(t = 0; t < factor; ++t) {
+			for(i = 0; i < folded_size; ++i) {
+				src = j * sketch->chunk_size + t * folded_size + i;
+				dst = j * folded_size + i;
+				result->data[dst].counter += sketch->data[src].counter;
+				#ifdef STORE_WEIGHTS
+				result->data[dst].weight += sketch->data[src].weight;
+				#endif
+				for(k = 0; k < WSIZE; ++k) result->data[dst].keysum[k] ^= sketch->data[src].keysum[k];
+				#ifndef GLEN
+				result->data[dst].key_len ^= sketch->data[src].key_len;
+				#endif
+				#ifndef RPOS
+				result->data[dst].position ^= sketch->data[src].position;
+				#endif
+			}
+		}
+	}
+	return NO_ERROR;
+}
+
+int ibf_sketch_fold_factor(ibf_t const *const sketch, unsigned int n, uint64_t *const factor) {
+	uint64_t classic;
+	assert(sketch != NULL);
+	assert(factor != NULL);
+	if (sketch->layout != IBF_LAYOUT_FOLDABLE) return ERR_INCOMPATIBLE;
+	classic = (uint64_t)ceil((ck_table[sketch->repetitions] + sketch->epsilon) * n / sketch->repetitions + 1);
+	for(*factor = 1; sketch->chunk_size / (*factor * 2) >= classic && *factor * 2 <= sketch->chunk_size; *factor *= 2);
 	return NO_ERROR;
 }
 
@@ -128,13 +523,13 @@ int ibf_sketch_copy(ibf_t const *const source, ibf_t *const dest) {
 	void* dummy = NULL;
 	assert(source != NULL);
 	dest->repetitions = source->repetitions;
+	dest->hash_family = source->hash_family;
+	dest->layout = source->layout;
+	dest->block_width = source->block_width;
 	dest->epsilon = source->epsilon;
+	ibf_data_free(dest);/*the size of a mapped region depends on the old chunk_size*/
 	dest->chunk_size = source->chunk_size;
-	if ((dummy = realloc(dest->data, dest->chunk_size * dest->repetitions * sizeof(bucket_t))) != NULL) {
-		dest->data = (bucket_t*)dummy;
-	} else {
-		return ERR_ALLOC;
-	}
+	if (ibf_data_alloc(dest) != NO_ERROR) return ERR_ALLOC;
 	if ((dummy = realloc(dest->seres, dest->repetitions * sizeof(hash_gen_t))) != NULL) {
 		dest->seres = (hash_gen_t*)dummy;
 	} else {
@@ -145,78 +540,471 @@ int ibf_sketch_copy(ibf_t const *const source, ibf_t *const dest) {
 	return NO_ERROR;
 }
 
+int ibf_sketch_set_hash(ibf_t *const sketch, uint8_t family) {
+	assert(sketch != NULL);
+	if (family >= IBF_HASH_FAMILIES) return ERR_VALUE;
+	sketch->hash_family = family;
+	return NO_ERROR;
+}
+
+int ibf_hash_family_parse(char const *const name, uint8_t *const family) {
+	uint8_t i;
+	assert(name != NULL);
+	assert(family != NULL);
+	for(i = 0; i < IBF_HASH_FAMILIES; ++i) {
+		if (strcmp(name, hash_family_names[i]) == 0) {
+			*family = i;
+			return NO_ERROR;
+		}
+	}
+	return ERR_VALUE;
+}
+
+char const *ibf_hash_family_name(uint8_t family) {
+	return family < IBF_HASH_FAMILIES ? hash_family_names[family] : "unknown";
+}
+
 int ibf_sketch_destroy(ibf_t *const sketch) {
 	int err;
 	assert(sketch != NULL);
 	err = NO_ERROR;
 	if (sketch->seres != NULL) err = ibf_hash_destroy(sketch->seres);
 	if (err == NO_ERROR) sketch->seres = NULL;
-	if (sketch->data != NULL) free(sketch->data);
-	if (err == NO_ERROR) sketch->data = NULL;
+	ibf_data_free(sketch);
 	return err;
 }
 
-int ibf_sketch_store(char const *const path, ibf_t const *const sketch) {
-	uint64_t i;
-	FILE* out;
+static int ibf_varint_write(FILE *const out, uint64_t value) {/*LEB128: 7 bits per byte, high bit set if more bytes follow*/
+	uint8_t byte;
+	do {
+		byte = value & 0x7F;
+		value >>= 7;
+		if (value) byte |= 0x80;
+		if (fputc(byte, out) == EOF) return ERR_IO;
+	} while (value);
+	return NO_ERROR;
+}
+
+static int ibf_varint_read(FILE *const in, uint64_t *const value) {
+	int c;
+	unsigned int shift;
+	*value = 0;
+	for(shift = 0; shift < 64; shift += 7) {
+		if ((c = fgetc(in)) == EOF) return ERR_IO;
+		*value |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80)) return NO_ERROR;
+	}
+	return ERR_INCOMPATIBLE;
+}
+
+/*everything before the buckets*/
+static int ibf_header_write(FILE *const out, ibf_t const *const sketch, uint8_t sparse) {
+	uint8_t header;
 	ufloat32_t buffer32;
 	uint64_t buffer64;
 	#ifdef GLEN
 	keysum_len_t buffer_len;
 	#endif
-	assert(path != NULL);
-	assert(sketch != NULL);
-	if((out = fopen(path, "wb")) == NULL) return ERR_IO;
-	if (fwrite(&sketch->repetitions, sizeof sketch->repetitions, 1, out) != 1) return ERR_IO;
+	header = sketch->repetitions | (sketch->hash_family << HEADER_HASH_SHIFT) | (sketch->layout << HEADER_LAYOUT_SHIFT) | (sparse ? HEADER_SPARSE : 0);
+	if (fwrite(&header, sizeof header, 1, out) != 1) return ERR_IO;
 	buffer32.f = sketch->epsilon;
 	/*buffer32 = *(uint32_t*)(&sketch->epsilon);*/
 	buffer32.u32 = hton32(buffer32.u32);
 	if (fwrite(&buffer32.u32, sizeof buffer32.u32, 1, out) != 1) return ERR_IO;
 	buffer64 = hton64(sketch->chunk_size);
 	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	if (sketch->layout == IBF_LAYOUT_BLOCKED) {
+		buffer32.u32 = hton32(sketch->block_width);
+		if (fwrite(&buffer32.u32, sizeof buffer32.u32, 1, out) != 1) return ERR_IO;
+	}
 	#ifdef GLEN
     buffer_len = hton_len(sketch->key_len);
 	if (fwrite(&buffer_len, sizeof buffer_len, 1, out) != 1) return ERR_IO;
     #endif
-	
-	for(i = 0; i < sketch->chunk_size * sketch->repetitions; ++i) {
-		if (ibf_bucket_store(out, &sketch->data[i]) != NO_ERROR) return ERR_IO;
-	}
-	for(i = 0; i < sketch->repetitions; ++i) {
-		if (ibf_hash_store(out, &sketch->seres[i]) != NO_ERROR) return ERR_IO;
-	}
-	fclose(out);
 	return NO_ERROR;
 }
 
-int ibf_sketch_load(char const *const path, ibf_t *const sketch) {
-	uint64_t i;
-	FILE* in;
+static int ibf_header_read(FILE *const in, ibf_t *const sketch, uint8_t *const sparse) {
+	uint8_t header;
 	ufloat32_t buffer32;
-	assert(path != NULL);
-	assert(sketch != NULL);
-	if ((in = fopen(path, "rb")) == NULL) return ERR_IO;
-	if (fread(&sketch->repetitions, sizeof sketch->repetitions, 1, in) != 1) return ERR_IO;
+	if (fread(&header, sizeof header, 1, in) != 1) return ERR_IO;
+	sketch->repetitions = header & HEADER_REPETITIONS_MASK;
+	sketch->hash_family = (header >> HEADER_HASH_SHIFT) & HEADER_HASH_MASK;
+	sketch->layout = (header >> HEADER_LAYOUT_SHIFT) & HEADER_LAYOUT_MASK;
+	sketch->block_width = 0;
+	*sparse = (header & HEADER_SPARSE) != 0;
+	if (sketch->hash_family >= IBF_HASH_FAMILIES || sketch->layout >= IBF_LAYOUTS) {
+		return ERR_INCOMPATIBLE;
+	}
 	if (fread(&buffer32.u32, sizeof buffer32.u32, 1, in) != 1) return ERR_IO;
 	buffer32.u32 = ntoh32(buffer32.u32);
 	/*sketch->epsilon = *(float*)(&buffer32);*/
 	sketch->epsilon = buffer32.f;
 	if (fread(&sketch->chunk_size, sizeof sketch->chunk_size, 1, in) != 1) return ERR_IO;
 	sketch->chunk_size = ntoh64(sketch->chunk_size);
+	if (sketch->layout == IBF_LAYOUT_FOLDABLE && (sketch->chunk_size == 0 || (sketch->chunk_size & (sketch->chunk_size - 1)) != 0)) {
+		return ERR_INCOMPATIBLE;
+	}
+	if (sketch->layout == IBF_LAYOUT_BLOCKED) {
+		if (fread(&buffer32.u32, sizeof buffer32.u32, 1, in) != 1) return ERR_IO;
+		sketch->block_width = ntoh32(buffer32.u32);
+		if (sketch->block_width == 0 || sketch->chunk_size % sketch->block_width != 0) {
+			return ERR_INCOMPATIBLE;
+		}
+	}
 	#ifdef GLEN
 	if (fread(&sketch->key_len, sizeof sketch->key_len, 1, in) != 1) return ERR_IO;
 	sketch->key_len = ntoh_len(sketch->key_len);
 	#endif
-	if ((sketch->data = (bucket_t*)malloc(sketch->chunk_size * sketch->repetitions * sizeof(bucket_t))) == NULL) return ERR_ALLOC;
-	for(i = 0; i < sketch->chunk_size * sketch->repetitions; ++i) {
-		if (ibf_bucket_load(in, &sketch->data[i]) != NO_ERROR) return ERR_IO;
+	return NO_ERROR;
+}
+
+/*everything after the buckets*/
+static int ibf_seres_write(FILE *const out, ibf_t const *const sketch) {
+	uint64_t i;
+	for(i = 0; i < sketch->repetitions; ++i) {
+		if (ibf_hash_store(out, &sketch->seres[i]) != NO_ERROR) return ERR_IO;
 	}
+	return NO_ERROR;
+}
+
+static int ibf_seres_read(FILE *const in, ibf_t *const sketch) {
+	uint64_t i;
 	if ((sketch->seres = (hash_gen_t*)malloc(sketch->repetitions * sizeof(hash_gen_t))) == NULL) return ERR_ALLOC;
 	for(i = 0; i < sketch->repetitions; ++i) {
 		if (ibf_hash_load(in, &sketch->seres[i]) != NO_ERROR) return ERR_IO;
 		sketch->seres[i].hash.ls64b = sketch->seres[i].hash.ms64b = 0;
 	}
+	return NO_ERROR;
+}
+
+int ibf_sketch_write(FILE *const out, ibf_t const *const sketch) {
+	int err;
+	uint64_t i;
+	assert(out != NULL);
+	assert(sketch != NULL);
+	if ((err = ibf_header_write(out, sketch, FALSE)) != NO_ERROR) return err;
+	for(i = 0; i < sketch->chunk_size * sketch->repetitions; ++i) {
+		if (ibf_bucket_store(out, &sketch->data[i]) != NO_ERROR) return ERR_IO;
+	}
+	return ibf_seres_write(out, sketch);
+}
+
+/*
+ * Sparse files (HEADER_SPARSE) store the number of nonzero buckets (uint64) followed by each of them, preceded by
+ * the number of zero buckets skipped since the previous one (LEB128 varint).
+ */
+int ibf_sketch_write_sparse(FILE *const out, ibf_t const *const sketch) {
+	int err;
+	uint64_t i, next, nonzero;
+	assert(out != NULL);
+	assert(sketch != NULL);
+	if ((err = ibf_header_write(out, sketch, TRUE)) != NO_ERROR) return err;
+	if ((err = ibf_sketch_nonzero(sketch, &nonzero)) != NO_ERROR) return err;
+	nonzero = hton64(nonzero);
+	if (fwrite(&nonzero, sizeof nonzero, 1, out) != 1) return ERR_IO;
+	for(i = next = 0; i < sketch->chunk_size * sketch->repetitions; ++i) {
+		if (ibf_bucket_empty(&sketch->data[i])) continue;
+		if (ibf_varint_write(out, i - next) != NO_ERROR || ibf_bucket_store(out, &sketch->data[i]) != NO_ERROR) return ERR_IO;
+		next = i + 1;
+	}
+	return ibf_seres_write(out, sketch);
+}
+
+int ibf_sketch_store(char const *const path, ibf_t const *const sketch) {
+	int err;
+	FILE* out;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	if((out = fopen(path, "wb")) == NULL) return ERR_IO;
+	err = ibf_sketch_write(out, sketch);
+	if (fclose(out) != 0 && err == NO_ERROR) err = ERR_IO;
+	return err;
+}
+
+int ibf_sketch_store_sparse(char const *const path, ibf_t const *const sketch) {
+	int err;
+	FILE* out;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	if((out = fopen(path, "wb")) == NULL) return ERR_IO;
+	err = ibf_sketch_write_sparse(out, sketch);
+	if (fclose(out) != 0 && err == NO_ERROR) err = ERR_IO;
+	return err;
+}
+
+int ibf_sketch_read(FILE *const in, ibf_t *const sketch) {
+	int err;
+	uint64_t i, gap, next, nonzero;
+	uint8_t sparse;
+	assert(in != NULL);
+	assert(sketch != NULL);
+	if ((err = ibf_header_read(in, sketch, &sparse)) != NO_ERROR) return err;
+	if (ibf_data_alloc(sketch) != NO_ERROR) return ERR_ALLOC;
+	if (sparse) {/*expanded, buckets not stored are zero*/
+		if (fread(&nonzero, sizeof nonzero, 1, in) != 1) return ERR_IO;
+		nonzero = ntoh64(nonzero);
+		for(i = next = 0; i < nonzero; ++i) {
+			if ((err = ibf_varint_read(in, &gap)) != NO_ERROR) return err;
+			if (gap >= sketch->chunk_size * sketch->repetitions - next) return ERR_INCOMPATIBLE;
+			next += gap;
+			if (ibf_bucket_load(in, &sketch->data[next++]) != NO_ERROR) return ERR_IO;
+		}
+	} else {
+		for(i = 0; i < sketch->chunk_size * sketch->repetitions; ++i) {
+			if (ibf_bucket_load(in, &sketch->data[i]) != NO_ERROR) return ERR_IO;
+		}
+	}
+	return ibf_seres_read(in, sketch);
+}
+
+int ibf_sketch_load(char const *const path, ibf_t *const sketch) {
+	int err;
+	FILE* in;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	if ((in = fopen(path, "rb")) == NULL) return ERR_IO;
+	err = ibf_sketch_read(in, sketch);
+	fclose(in);
+	return err;
+}
+
+/*same shape and hash functions, the seeds are only compared if seeds is TRUE*/
+static unsigned char ibf_sketch_compatible(ibf_t const *const a, ibf_t const *const b, unsigned char seeds) {
+	uint8_t i8;
+	unsigned char compatibles;
+	compatibles = TRUE;
+	compatibles &= a->repetitions == b->repetitions;
+	compatibles &= a->hash_family == b->hash_family;
+	compatibles &= a->layout == b->layout;
+	compatibles &= a->block_width == b->block_width;
+	compatibles &= a->chunk_size == b->chunk_size;
+	for(i8 = 0; seeds && compatibles && i8 < a->repetitions; ++i8) compatibles &= a->seres[i8].seed == b->seres[i8].seed;
+	return compatibles;
+}
+
+/*
+ * sketch = sketch - the sketch read from in, subtracted bucket by bucket as it is read: the second sketch is never
+ * held in memory. Its seeds follow its buckets, so on ERR_INCOMPATIBLE sketch may already have been modified.
+ */
+int ibf_sketch_sub_read(FILE *const in, ibf_t *const sketch) {
+	int err;
+	uint64_t i, gap, next, nonzero;
+	uint8_t sparse, i8;
+	ibf_t other;
+	bucket_t bucket;
+	assert(in != NULL);
+	assert(sketch != NULL);
+	memset(&other, 0, sizeof other);
+	if ((err = ibf_header_read(in, &other, &sparse)) != NO_ERROR) return err;
+	if (!ibf_sketch_compatible(sketch, &other, FALSE)) return ERR_INCOMPATIBLE;
+	if (sparse) {
+		if (fread(&nonzero, sizeof nonzero, 1, in) != 1) return ERR_IO;
+		nonzero = ntoh64(nonzero);
+		for(i = next = 0; i < nonzero; ++i) {
+			if ((err = ibf_varint_read(in, &gap)) != NO_ERROR) return err;
+			if (gap >= sketch->chunk_size * sketch->repetitions - next) return ERR_INCOMPATIBLE;
+			next += gap;
+			if (ibf_bucket_load(in, &bucket) != NO_ERROR) return ERR_IO;
+			ibf_bucket_sub(&sketch->data[next++], &bucket);
+		}
+	} else {
+		for(i = 0; i < sketch->chunk_size * sketch->repetitions; ++i) {
+			if (ibf_bucket_load(in, &bucket) != NO_ERROR) return ERR_IO;
+			ibf_bucket_sub(&sketch->data[i], &bucket);
+		}
+	}
+	if ((err = ibf_seres_read(in, &other)) == NO_ERROR) {
+		for(i8 = 0; i8 < sketch->repetitions; ++i8) if (sketch->seres[i8].seed != other.seres[i8].seed) err = ERR_INCOMPATIBLE;
+	}
+	if (other.seres) free(other.seres);
+	#ifdef GLEN
+	if (!err && sketch->key_len < other.key_len) sketch->key_len = other.key_len;
+	#endif
+	return err;
+}
+
+int ibf_sketch_sub_load(char const *const path, ibf_t *const sketch) {
+	int err;
+	FILE* in;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	if ((in = fopen(path, "rb")) == NULL) return ERR_IO;
+	err = ibf_sketch_sub_read(in, sketch);
+	fclose(in);
+	return err;
+}
+
+/*
+ * Streaming difference: both sketches (dense or sparse) are read one window of buckets at a time, the window is
+ * subtracted and written while the next one is read by one thread per sketch. Memory is bounded by the four windows
+ * whatever the size of the sketches.
+ */
+typedef struct {
+	FILE *in;
+	uint8_t sparse;
+	uint64_t total;/* buckets of the sketch */
+	uint64_t position;/* first bucket of the next window */
+	uint64_t left;/* sparse: stored buckets not read yet */
+	uint64_t base;/* sparse: bucket after the last stored one read */
+	uint64_t next;/* sparse: position of the next stored bucket, total if none */
+	bucket_t bucket;/* sparse: the next stored bucket */
+	bucket_t *window;
+	uint64_t size;
+	int err;
+} ibf_stream_t;
+
+static int ibf_stream_advance(ibf_stream_t *const stream) {
+	int err;
+	uint64_t gap;
+	if (stream->left == 0) {
+		stream->next = stream->total;
+		return NO_ERROR;
+	}
+	if ((err = ibf_varint_read(stream->in, &gap)) != NO_ERROR) return err;
+	if (gap >= stream->total - stream->base) return ERR_INCOMPATIBLE;
+	stream->next = stream->base + gap;
+	stream->base = stream->next + 1;
+	--stream->left;
+	return ibf_bucket_load(stream->in, &stream->bucket);
+}
+
+static void *ibf_stream_fill(void *arg) {
+	uint64_t i;
+	ibf_stream_t *stream = (ibf_stream_t*)arg;
+	stream->err = NO_ERROR;
+	if (stream->sparse) {/*expanded, buckets not stored are zero*/
+		memset(stream->window, 0, stream->size * sizeof(bucket_t));
+		while(!stream->err && stream->next < stream->position + stream->size) {
+			stream->window[stream->next - stream->position] = stream->bucket;
+			stream->err = ibf_stream_advance(stream);
+		}
+	} else {
+		for(i = 0; !stream->err && i < stream->size; ++i) stream->err = ibf_bucket_load(stream->in, &stream->window[i]);
+	}
+	stream->position += stream->size;
+	return NULL;
+}
+
+static int ibf_stream_open(FILE *const in, ibf_t *const sketch, ibf_stream_t *const stream) {
+	int err;
+	memset(stream, 0, sizeof *stream);
+	stream->in = in;
+	if ((err = ibf_header_read(in, sketch, &stream->sparse)) != NO_ERROR) return err;
+	stream->total = sketch->chunk_size * sketch->repetitions;
+	if (!stream->sparse) return NO_ERROR;
+	if (fread(&stream->left, sizeof stream->left, 1, in) != 1) return ERR_IO;
+	stream->left = ntoh64(stream->left);
+	return ibf_stream_advance(stream);
+}
+
+static int ibf_diff_stream(FILE *const a, FILE *const b, FILE *const out, uint64_t buffer_size, unsigned char sparse) {
+	int err;
+	uint8_t i8;
+	uint64_t i, j, window, size, position, next, nonzero, count_offset;
+	unsigned char cur, started[2];
+	ibf_t sa, sb;
+	ibf_stream_t streams[2];
+	bucket_t *buffers[4];
+	pthread_t readers[2];
+	memset(&sa, 0, sizeof sa);
+	memset(&sb, 0, sizeof sb);
+	memset(buffers, 0, sizeof buffers);
+	count_offset = nonzero = 0;
+	if ((err = ibf_stream_open(a, &sa, &streams[0])) != NO_ERROR) return err;
+	if ((err = ibf_stream_open(b, &sb, &streams[1])) != NO_ERROR) return err;
+	if (!ibf_sketch_compatible(&sa, &sb, FALSE)) return ERR_INCOMPATIBLE;
+	#ifdef GLEN
+	if (sa.key_len < sb.key_len) sa.key_len = sb.key_len;
+	#endif
+	window = buffer_size / (4 * sizeof(bucket_t));/*two windows per sketch*/
+	if (window == 0) window = 1;
+	if (window > streams[0].total) window = streams[0].total ? streams[0].total : 1;
+	for(i = 0; !err && i < 4; ++i) if ((buffers[i] = (bucket_t*)malloc(window * sizeof(bucket_t))) == NULL) err = ERR_ALLOC;
+	if (!err) err = ibf_header_write(out, &sa, sparse);
+	if (!err && sparse) {/*the number of nonzero buckets is only known at the end*/
+		if ((count_offset = ftell(out)) == (uint64_t)-1 || fwrite(&nonzero, sizeof nonzero, 1, out) != 1) err = ERR_IO;
+	}
+	cur = 0;
+	size = window < streams[0].total ? window : streams[0].total;
+	for(i = 0; !err && i < 2; ++i) {
+		streams[i].window = buffers[2 * i + cur];
+		streams[i].size = size;
+		ibf_stream_fill(&streams[i]);
+	}
+	for(position = next = 0; !err && position < streams[0].total; position += size, cur ^= 1) {
+		if ((err = streams[0].err ? streams[0].err : streams[1].err) != NO_ERROR) break;
+		size = streams[0].total - position < window ? streams[0].total - position : window;
+		for(i = 0; i < 2; ++i) {/*read the next window while this one is written*/
+			started[i] = FALSE;
+			if (position + size == streams[0].total) continue;
+			streams[i].window = buffers[2 * i + !cur];
+			streams[i].size = streams[0].total - position - size < window ? streams[0].total - position - size : window;
+			if (!(started[i] = pthread_create(&readers[i], NULL, ibf_stream_fill, &streams[i]) == 0)) ibf_stream_fill(&streams[i]);
+		}
+		for(j = 0; !err && j < size; ++j) {
+			ibf_bucket_sub(&buffers[cur][j], &buffers[2 + cur][j]);
+			if (!sparse) err = ibf_bucket_store(out, &buffers[cur][j]);
+			else if (!ibf_bucket_empty(&buffers[cur][j])) {
+				if (ibf_varint_write(out, position + j - next) != NO_ERROR || ibf_bucket_store(out, &buffers[cur][j]) != NO_ERROR) err = ERR_IO;
+				next = position + j + 1;
+				++nonzero;
+			}
+		}
+		for(i = 0; i < 2; ++i) if (started[i]) pthread_join(readers[i], NULL);
+	}
+	for(i = 0; i < 4; ++i) if (buffers[i]) free(buffers[i]);
+	if (!err && streams[0].sparse && streams[0].left != 0) err = ERR_INCOMPATIBLE;
+	if (!err && streams[1].sparse && streams[1].left != 0) err = ERR_INCOMPATIBLE;
+	if (!err) err = ibf_seres_read(a, &sa);
+	if (!err) err = ibf_seres_read(b, &sb);
+	for(i8 = 0; !err && i8 < sa.repetitions; ++i8) if (sa.seres[i8].seed != sb.seres[i8].seed) err = ERR_INCOMPATIBLE;
+	if (!err) err = ibf_seres_write(out, &sa);
+	if (!err && sparse) {
+		nonzero = hton64(nonzero);
+		if (fseek(out, count_offset, SEEK_SET) != 0 || fwrite(&nonzero, sizeof nonzero, 1, out) != 1) err = ERR_IO;
+	}
+	if (sa.seres) free(sa.seres);
+	if (sb.seres) free(sb.seres);
+	return err;
+}
+
+int ibf_sketch_diff_stream(char const *const apath, char const *const bpath, char const *const opath, uint64_t buffer_size, unsigned char sparse) {
+	int err;
+	FILE *a, *b, *out;
+	assert(apath != NULL);
+	assert(bpath != NULL);
+	assert(opath != NULL);
+	a = b = out = NULL;
+	if ((a = fopen(apath, "rb")) == NULL || (b = fopen(bpath, "rb")) == NULL || (out = fopen(opath, "wb")) == NULL) err = ERR_IO;
+	else err = ibf_diff_stream(a, b, out, buffer_size, sparse);
+	if (a) fclose(a);
+	if (b) fclose(b);
+	if (out && fclose(out) != 0 && err == NO_ERROR) err = ERR_IO;
+	return err;
+}
+
+int ibf_sketch_is_sparse(char const *const path, uint8_t *const sparse) {
+	FILE* in;
+	uint8_t header;
+	assert(path != NULL);
+	assert(sparse != NULL);
+	if ((in = fopen(path, "rb")) == NULL) return ERR_IO;
+	if (fread(&header, sizeof header, 1, in) != 1) {
+		fclose(in);
+		return ERR_IO;
+	}
 	fclose(in);
+	*sparse = (header & HEADER_SPARSE) != 0;
+	return NO_ERROR;
+}
+
+int ibf_sketch_nonzero(ibf_t const *const sketch, uint64_t *const count) {
+	uint64_t i;
+	assert(sketch != NULL);
+	assert(count != NULL);
+	*count = 0;
+	for(i = 0; i < sketch->chunk_size * sketch->repetitions; ++i) *count += !ibf_bucket_empty(&sketch->data[i]);
 	return NO_ERROR;
 }
 
@@ -279,26 +1067,21 @@ int ibf_sketch_dump(ibf_t const *const sketch, FILE *const strm) {
 
 int ibf_sketch_diff(ibf_t const *const a, ibf_t const *const b, ibf_t *const result) {
 	int err;
-	uint8_t i8;
-	unsigned char compatibles;
 	uint64_t i, j;
 	assert(a != NULL);
 	assert(b != NULL);
 	assert(result != NULL);
-	compatibles = TRUE;
-	compatibles &= a->repetitions == b->repetitions;
-	compatibles &= a->chunk_size == b->chunk_size;
-	for(i8 = 0; i8 < a->repetitions; ++i8) compatibles &= a->seres[i8].seed == b->seres[i8].seed;
-	if (!compatibles) {
-		return ERR_INCOMPATIBLE;
-	}
+	if (!ibf_sketch_compatible(a, b, TRUE)) return ERR_INCOMPATIBLE;
 	if ((err = ibf_sketch_destroy(result)) != NO_ERROR) return err;
 	memcpy(result, a, sizeof(ibf_t));
 	if ((result->seres = (hash_gen_t*)malloc(a->repetitions * sizeof(hash_gen_t))) == NULL) return ERR_ALLOC;
 	memcpy(result->seres, a->seres, a->repetitions * sizeof(hash_gen_t));
-	if ((result->data = (bucket_t*)malloc(a->repetitions * a->chunk_size * sizeof(bucket_t))) == NULL) return ERR_ALLOC;
+	if ((err = ibf_data_alloc(result)) != NO_ERROR) return err;
 	for(i = 0; i < a->chunk_size * a->repetitions; ++i) {
 		result->data[i].counter = a->data[i].counter - b->data[i].counter;
+		#ifdef STORE_WEIGHTS
+		result->data[i].weight = a->data[i].weight - b->data[i].weight;
+		#endif
 		for(j = 0; j < WSIZE; ++j) result->data[i].keysum[j] = a->data[i].keysum[j] ^ b->data[i].keysum[j];
 		#ifndef GLEN
 		result->data[i].key_len = a->data[i].key_len ^ b->data[i].key_len;
@@ -310,60 +1093,297 @@ int ibf_sketch_diff(ibf_t const *const a, ibf_t const *const b, ibf_t *const res
 	return NO_ERROR;
 }
 
-int ibf_access_seq(void const *const seq, unsigned int start, unsigned int end, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len, enum Access_t atype) {
-	int i, j, err;
+int ibf_sketch_sub_inplace(ibf_t *const a, ibf_t const *const b) {
+	uint64_t i;
+	assert(a != NULL);
+	assert(b != NULL);
+	if (!ibf_sketch_compatible(a, b, TRUE)) return ERR_INCOMPATIBLE;
+	#ifdef GLEN
+	if (a->key_len < b->key_len) a->key_len = b->key_len;
+	#endif
+	for(i = 0; i < a->chunk_size * a->repetitions; ++i) ibf_bucket_sub(&a->data[i], &b->data[i]);
+	return NO_ERROR;
+}
+
+int ibf_sketch_add_inplace(ibf_t *const a, ibf_t const *const b) {
+	uint64_t i, j;
+	assert(a != NULL);
+	assert(b != NULL);
+	if (!ibf_sketch_compatible(a, b, TRUE)) return ERR_INCOMPATIBLE;
+	#ifdef GLEN
+	if (a->key_len < b->key_len) a->key_len = b->key_len;
+	#endif
+	for(i = 0; i < a->chunk_size * a->repetitions; ++i) {
+		a->data[i].counter += b->data[i].counter;
+		#ifdef STORE_WEIGHTS
+		a->data[i].weight += b->data[i].weight;
+		#endif
+		for(j = 0; j < WSIZE; ++j) a->data[i].keysum[j] ^= b->data[i].keysum[j];
+		#ifndef GLEN
+		a->data[i].key_len ^= b->data[i].key_len;
+		#endif
+		#ifndef RPOS
+		a->data[i].position ^= b->data[i].position;
+		#endif
+	}
+	return NO_ERROR;
+}
+
+/*
+ * Buckets of a key in each repetition, from the hashes stored in sketch->seres.
+ * Classic layout: repetition j owns cells [j * chunk_size, (j + 1) * chunk_size).
+ * Blocked layout: the key is confined to one block of r * block_width contiguous cells, chosen by the upper half of
+ * the first hash, in which repetition j owns block_width cells. All r cells of a key then share a few cache lines (or a page).
+ * Blocked positions use multiply-shift range reductions instead of divisions (block counts and widths fit 32 bits).
+ * Foldable layout: the classic layout with masks instead of modulos (power-of-two chunk sizes).
+ */
+static inline void ibf_positions(ibf_t const *const sketch, uint64_t *const positions) {
+	unsigned char j;
+	uint64_t block;
+	if (sketch->layout == IBF_LAYOUT_BLOCKED) {
+		block = ((sketch->seres[0].hash.ms64b >> 32) * (sketch->chunk_size / sketch->block_width)) >> 32;
+		for (j = 0; j < sketch->repetitions; ++j) {
+			positions[j] = (block * sketch->repetitions + j) * sketch->block_width + (((sketch->seres[j].hash.ls64b >> 32) * sketch->block_width) >> 32);
+		}
+	} else if (sketch->layout == IBF_LAYOUT_FOLDABLE) {
+		for (j = 0; j < sketch->repetitions; ++j) positions[j] = (sketch->seres[j].hash.ls64b & (sketch->chunk_size - 1)) + j * sketch->chunk_size;
+	} else {
+		for (j = 0; j < sketch->repetitions; ++j) positions[j] = sketch->seres[j].hash.ls64b % sketch->chunk_size + j * sketch->chunk_size;
+	}
+}
+
+/*add (remove) a 2bit-packed key to the sums of a bucket, its counter is updated by the caller*/
+static inline void ibf_bucket_toggle(bucket_t *const bucket, uint8_t const *const buffer, unsigned int start, unsigned int end) {
+	int i;
+	for(i = 0; i < WSIZE; ++i) {/*add (remove) 2bit-encoded fragment to keysum by XORing*/
+		bucket->keysum[i] ^= buffer[i];
+	}
+	#ifndef GLEN
+	bucket->key_len ^= (keysum_len_t)(end - start); /*FIXME [possible bug] XOR does not work here because many equal lengths by chance*/
+	#endif
+	#ifndef RPOS
+	bucket->position ^= (position_t)(start);/*positions are all different*/
+	#endif
+}
+
+static int ibf_access_hashed(uint8_t const *const buffer, char const *const seq, unsigned int start, unsigned int end, int64_t weight, ibf_t *const sketch, enum Access_t atype);
+
+/*
+ * Insert (delete) a 2bit-packed key of len bases and multiplicity weight, stored in a zero-padded buffer of WSIZE bytes.
+ * seq is only used to print debugging information and can be NULL.
+ */
+static int ibf_access_packed(uint8_t const *const buffer, char const *const seq, unsigned int start, unsigned int end, int64_t weight, ibf_t *const sketch, enum Access_t atype) {
+	int err;
+	if((err = ibf_hash_key(buffer, weight, sketch->repetitions, sketch->hash_family, sketch->seres)) != NO_ERROR) return err;/*hash 2bit sequence*/
+	return ibf_access_hashed(buffer, seq, start, end, weight, sketch, atype);
+}
+
+/*as ibf_access_packed, the key being already hashed into sketch->seres*/
+static int ibf_access_hashed(uint8_t const *const buffer, char const *const seq, unsigned int start, unsigned int end, int64_t weight, ibf_t *const sketch, enum Access_t atype) {
+	int j;
+#ifdef DEBUG
+	int i;
+#endif
 	uint64_t pos;
+	uint64_t positions[RMAX];
+	ibf_positions(sketch, positions);
+	for (j = 0; j < sketch->repetitions; ++j) {
+		pos = positions[j];
+#ifdef DEBUG
+		if (seq) fprintf(stderr, "%.*s,", end - start, &seq[start]);
+		else fprintf(stderr, "-,");
+		for(i = 0; i < WSIZE; ++i) fprintf(stderr, "%02X", buffer[i]);
+		fprintf(stderr, ",%d,%u,%d,%llu\n", end - start, start, j, pos);
+#endif
+		switch (atype) {
+			case INSERTION:
+				++sketch->data[pos].counter;
+				#ifdef STORE_WEIGHTS
+				sketch->data[pos].weight += weight;
+				#endif
+				break;
+			case DELETION:
+				--sketch->data[pos].counter;
+				#ifdef STORE_WEIGHTS
+				sketch->data[pos].weight -= weight;
+				#endif
+				break;
+			default:
+				return ERR_VALUE;
+		}
+		ibf_bucket_toggle(&sketch->data[pos], buffer, start, end);
+	}
+	return NO_ERROR;
+}
+
+/*key seq[start, end) as stored in the buckets, FALSE if it must be skipped*/
+static inline unsigned char ibf_pack_key(void const *const seq, unsigned int start, unsigned int end, uint8_t *const buffer, uint64_t buffer_len) {
+	memset(buffer, 0, buffer_len);
+#if defined(STORE_SEQUENCES) || defined(STORE_VLSEQUENCES) || defined(STORE_FRAGMENTS)/*if buckets contain sequences, init buffer and 2 pack the seq fragment*/
+	return pack2bit(&((char*)seq)[start], end-start, buffer) == NO_ERROR;/*skip fragments with a base not in {A,C,G,T}*/
+#elif defined(STORE_HASHES) /*otherwise, directly copy the hash value (our sequence) into the buffer FIXME, not true anymore*/
+	memcpy(buffer, &((char*)seq)[start], end-start);
+	return TRUE;
+#endif
+}
+
+int ibf_pack_seq(void const *const seq, int start, int end, uint8_t *const buffer, uint64_t buffer_len) {
 	assert(seq != NULL);
 	assert(start <= end);
-	assert(sketch != NULL);
 	assert(buffer != NULL);
 	if (buffer_len < WSIZE) return ERR_OUTOFBOUNDS;
-	memset(buffer, 0, buffer_len);
+	if (ibf_pack_key(seq, start, end, buffer, buffer_len)) return NO_ERROR;
+	++counters.skipped;
+	return ERR_VALUE;
+}
 
-#if defined(STORE_SEQUENCES) || defined(STORE_VLSEQUENCES) || defined(STORE_FRAGMENTS)/*if buckets contain sequences, init buffer and 2 pack the seq fragment*/
-	if (pack2bit(&((char*)seq)[start], end-start, buffer) == NO_ERROR) {/*skip fragments with a base not in {A,C,G,T}*/
-#elif defined(STORE_HASHES) /*otherwise, directly copy the hash value (our sequence) into the buffer FIXME, not true anymore*/
-	memcpy(buffer, seq, end-start);
-	{
-#endif
-		if((err = ibf_hash_seq((char*)buffer, 0, WSIZE, sketch->repetitions, sketch->seres)) != NO_ERROR) return err;/*hash 2bit sequence*/
-		for (j = 0; j < sketch->repetitions; ++j) {
-			pos = sketch->seres[j].hash.ls64b % sketch->chunk_size + j * sketch->chunk_size; /*FIXME: lsb is 64 bit, msb is not used to find the position*/
-#ifdef DEBUG
-			fprintf(stderr, "%.*s,", end - start, &((char*)seq)[start]);
-			for(i = 0; i < WSIZE; ++i) fprintf(stderr, "%02X", buffer[i]);
-			fprintf(stderr, ",%d,%u,%d,%llu\n", end - start, start, j, sketch->seres[j].hash.ls64b % sketch->chunk_size);
-#endif
-			switch (atype) {
-				case INSERTION:
-					++sketch->data[pos].counter;
-					break;
-				case DELETION:
-					--sketch->data[pos].counter;
-					break;
-				default:
-					return ERR_VALUE;
-			}
-			for(i = 0; i < WSIZE; ++i) {/*add (remove) 2bit-encoded fragment to keysum by XORing*/
-				sketch->data[pos].keysum[i] ^= buffer[i];
-			}
-			#ifndef GLEN
-			sketch->data[pos].key_len ^= (keysum_len_t)(end - start); /*FIXME [possible bug] XOR does not work here because many equal lengths by chance*/
-			#endif
-			#ifndef RPOS
-			sketch->data[pos].position ^= (position_t)(start);/*positions are all different*/
-			#endif
-		}
+int ibf_access_seq(void const *const seq, unsigned int start, unsigned int end, int64_t weight, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len, enum Access_t atype) {
+	assert(seq != NULL);
+	assert(start <= end);
+	assert(sketch != NULL);
+	assert(buffer != NULL);
+	if (buffer_len < WSIZE) return ERR_OUTOFBOUNDS;
+	if (ibf_pack_key(seq, start, end, buffer, buffer_len)) {
+		if (atype == INSERTION) ++counters.inserted;
+		return ibf_access_packed(buffer, (char const*)seq, start, end, weight, sketch, atype);
 	}
+	++counters.skipped;
 	return NO_ERROR;
 }
 
 int ibf_insert_seq(void const *const seq, int start, int end, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len) {
-	return ibf_access_seq(seq, start, end, sketch, buffer, buffer_len, INSERTION);
+	return ibf_access_seq(seq, start, end, 1, sketch, buffer, buffer_len, INSERTION);
+}
+
+/*
+ * Multi-resolution construction: the key is packed once and hashed once for each run of sketches sharing their seeds
+ * (and hash family), whose positions are then derived from the same hashes, e.g. sketches of several sizes.
+ */
+int ibf_insert_seq_multi(void const *const seq, int start, int end, ibf_t *const sketches, uint32_t count, uint8_t *const buffer, uint64_t buffer_len) {
+	int err;
+	uint32_t i, hashed;
+	unsigned char j;
+	assert(seq != NULL);
+	assert(start <= end);
+	assert(sketches != NULL);
+	assert(buffer != NULL);
+	if (buffer_len < WSIZE) return ERR_OUTOFBOUNDS;
+	if (!ibf_pack_key(seq, start, end, buffer, buffer_len)) {
+		++counters.skipped;
+		return NO_ERROR;
+	}
+	++counters.inserted;
+	for(i = 0, hashed = 0, err = NO_ERROR; i < count && err == NO_ERROR; ++i) {
+		if (i != 0 && sketches[i].repetitions == sketches[hashed].repetitions && sketches[i].hash_family == sketches[hashed].hash_family) {
+			for(j = 0; j < sketches[i].repetitions && sketches[i].seres[j].seed == sketches[hashed].seres[j].seed; ++j);
+		} else j = 0;
+		if (i != 0 && j == sketches[i].repetitions) {
+			for(j = 0; j < sketches[i].repetitions; ++j) sketches[i].seres[j].hash = sketches[hashed].seres[j].hash;
+		} else if ((err = ibf_hash_key(buffer, 1, sketches[i].repetitions, sketches[i].hash_family, sketches[i].seres)) != NO_ERROR) break;
+		else hashed = i;
+		err = ibf_access_hashed(buffer, (char const*)seq, start, end, 1, &sketches[i], INSERTION);
+	}
+	return err;
 }
 
 int ibf_delete_seq(void const *const seq, int start, int end, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len) {
-	return ibf_access_seq(seq, start, end, sketch, buffer, buffer_len, DELETION);
+	return ibf_access_seq(seq, start, end, 1, sketch, buffer, buffer_len, DELETION);
+}
+
+int ibf_insert_counted_seq(void const *const seq, int start, int end, int64_t weight, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len) {
+	#ifndef STORE_WEIGHTS
+	if (weight != 1) return ERR_INCOMPATIBLE;
+	#endif
+	return ibf_access_seq(seq, start, end, weight, sketch, buffer, buffer_len, INSERTION);
+}
+
+int ibf_insert_packed(uint8_t const *const packed, unsigned int len, ibf_t *const sketch) {
+	assert(packed != NULL);
+	assert(sketch != NULL);
+	return ibf_access_packed(packed, NULL, 0, len, 1, sketch, INSERTION);
+}
+
+/*
+ * Out-of-core construction: keys are spilled to a binary file (start and end offsets, then the packed key), then the
+ * sketch is built and written one window of buckets at a time, reading the spilled keys once per window.
+ * Windows are made of whole repetition chunks (whole blocks for the blocked layout) when the memory allows it.
+ */
+int ibf_spill_seq(FILE *const spill, void const *const seq, int start, int end, uint8_t *const buffer, uint64_t buffer_len) {
+	uint32_t range[2];
+	assert(spill != NULL);
+	assert(seq != NULL);
+	assert(start <= end);
+	assert(buffer != NULL);
+	if (buffer_len < WSIZE) return ERR_OUTOFBOUNDS;
+	if (!ibf_pack_key(seq, start, end, buffer, buffer_len)) {
+		++counters.skipped;
+		return NO_ERROR;
+	}
+	++counters.inserted;
+	range[0] = start;
+	range[1] = end;
+	if (fwrite(range, sizeof range, 1, spill) != 1 || fwrite(buffer, sizeof(uint8_t), WSIZE, spill) != WSIZE) return ERR_IO;
+	return NO_ERROR;
+}
+
+int ibf_sketch_store_spilled(char const *const path, ibf_t *const sketch, FILE *const spill, uint64_t memory) {
+	int err;
+	FILE *out;
+	unsigned char j;
+	uint32_t range[2];
+	uint64_t total, unit, window, first, size, i, pos;
+	uint64_t positions[RMAX];
+	uint8_t buffer[WSIZE];
+	bucket_t *data;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	assert(spill != NULL);
+	total = sketch->chunk_size * sketch->repetitions;
+	unit = sketch->layout == IBF_LAYOUT_BLOCKED ? sketch->repetitions * sketch->block_width : sketch->chunk_size;
+	window = memory / sizeof(bucket_t);
+	if (window >= unit) window -= window % unit;
+	if (window == 0) window = 1;
+	if (window > total) window = total;
+	if ((data = (bucket_t*)malloc(window * sizeof(bucket_t))) == NULL) return ERR_ALLOC;
+	if ((out = fopen(path, "wb")) == NULL) {
+		free(data);
+		return ERR_IO;
+	}
+	err = ibf_header_write(out, sketch, FALSE);
+	for(first = 0; !err && first < total; first += size) {
+		size = total - first < window ? total - first : window;
+		memset(data, 0, size * sizeof(bucket_t));
+		rewind(spill);
+		while(!err && fread(range, sizeof range, 1, spill) == 1) {
+			if (fread(buffer, sizeof(uint8_t), WSIZE, spill) != WSIZE) err = ERR_IO;
+			else err = ibf_hash_key(buffer, 1, sketch->repetitions, sketch->hash_family, sketch->seres);
+			if (err) break;
+			ibf_positions(sketch, positions);
+			for(j = 0; j < sketch->repetitions; ++j) {
+				if ((pos = positions[j] - first) >= size) continue;/*outside the window (wraps around if before it)*/
+				++data[pos].counter;
+				#ifdef STORE_WEIGHTS
+				++data[pos].weight;
+				#endif
+				ibf_bucket_toggle(&data[pos], buffer, range[0], range[1]);
+			}
+		}
+		if (!err && ferror(spill)) err = ERR_IO;
+		for(i = 0; !err && i < size; ++i) err = ibf_bucket_store(out, &data[i]);
+	}
+	if (!err) err = ibf_seres_write(out, sketch);
+	if (fclose(out) != 0 && err == NO_ERROR) err = ERR_IO;
+	free(data);
+	return err;
+}
+
+int ibf_insert_counted_packed(uint8_t const *const packed, unsigned int len, int64_t weight, ibf_t *const sketch) {
+	assert(packed != NULL);
+	assert(sketch != NULL);
+	#ifndef STORE_WEIGHTS
+	if (weight != 1) return ERR_INCOMPATIBLE;
+	#endif
+	return ibf_access_packed(packed, NULL, 0, len, weight, sketch, INSERTION);
 }
 
 /*
@@ -402,12 +1422,14 @@ unsigned char find_peelable_bucket(bucket_t const *const buckets, uint64_t blen,
 int ibf_list_seq(ibf_t *const sketch, void (*output_bucket)(bucket_t const *const, char, void*), void *iostruct) {
 	int err;
 	uint64_t i, j, blen, idx, pos, seen;
+	uint64_t positions[RMAX];
 	unsigned char peelable, too_small;
 	assert(sketch != NULL);
 	assert(output_bucket != NULL);
 	blen = sketch->chunk_size * sketch->repetitions;
 	idx = seen = 0;
 	too_small = FALSE;
+	counters.remaining_cells = 0;
 	peelable = find_peelable_bucket(sketch->data, blen, &idx);
 	while(idx != blen && seen < MAXPASSES * blen) {/*removed condition !too_small. It now ignores the bucket and continues at idx+1*/
 #ifdef DEBUG
@@ -415,18 +1437,25 @@ int ibf_list_seq(ibf_t *const sketch, void (*output_bucket)(bucket_t const *cons
 		ibf_sketch_print(sketch, stderr);
 		fprintf(stderr, "bucket %llu with counter = %lld\n", idx, sketch->data[idx].counter);
 #endif
-		if ((err = ibf_hash_seq((char*)sketch->data[idx].keysum, 0, WSIZE, sketch->repetitions, sketch->seres)) != NO_ERROR) return err;/*hash 2bit sequence*/
+		#ifdef STORE_WEIGHTS
+		err = ibf_hash_key(sketch->data[idx].keysum, sketch->data[idx].weight * sketch->data[idx].counter, sketch->repetitions, sketch->hash_family, sketch->seres);
+		#else
+		err = ibf_hash_key(sketch->data[idx].keysum, 1, sketch->repetitions, sketch->hash_family, sketch->seres);
+		#endif
+		if (err != NO_ERROR) return err;/*hash 2bit sequence*/
 		too_small = TRUE;
-		for (j = 0; j < sketch->repetitions; ++j) {/*FIXME: first compute all positions*/
-			pos = sketch->seres[j].hash.ls64b % sketch->chunk_size + j * sketch->chunk_size;/*msb not used*/
-			if (pos == idx) too_small = FALSE;/*check if idx is in there, if not, skip this index (increment by one)*/
-			sketch->seres[j].hash.ls64b = pos;
+		ibf_positions(sketch, positions);
+		for (j = 0; j < sketch->repetitions; ++j) {
+			if (positions[j] == idx) too_small = FALSE;/*check if idx is in there, if not, skip this index (increment by one)*/
 		}
 		if (!too_small) {/*hopefully we will find another bucket which was not an error*/
 			for (j = 0; j < sketch->repetitions; ++j) {
-				pos = sketch->seres[j].hash.ls64b;
+				pos = positions[j];
 				if (pos != idx) {/*peel all the buckets associated to the found key*/
 					sketch->data[pos].counter -= sketch->data[idx].counter;/*update counter*/
+					#ifdef STORE_WEIGHTS
+					sketch->data[pos].weight -= sketch->data[idx].weight;
+					#endif
 					for(i = 0; i < WSIZE; ++i) {/*remove 2bit-encoded fragment to keysum by XORing*/
 						sketch->data[pos].keysum[i] ^= sketch->data[idx].keysum[i];
 					}
@@ -439,12 +1468,18 @@ int ibf_list_seq(ibf_t *const sketch, void (*output_bucket)(bucket_t const *cons
 				}
 			}
 		} else {
+			++counters.false_pure;
 			++idx;
 			idx %= blen;
 		}
 		if (!too_small) {/*now remove the found key itself*/
+			++counters.pure_hits;
 			output_bucket(&sketch->data[idx], sketch->data[idx].counter == 1 ? 'i' : 'j', iostruct);/*and print it*/
 			sketch->data[idx].counter -= sketch->data[idx].counter;/*clear counter of peeled bucket*/
+			memset(sketch->data[idx].keysum, 0, WSIZE);/*so that only unpeeled cells are left nonzero*/
+			#ifdef STORE_WEIGHTS
+			sketch->data[idx].weight -= sketch->data[idx].weight;
+			#endif
 			#ifndef GLEN
 			sketch->data[idx].key_len ^= sketch->data[idx].key_len;
 			#endif
@@ -455,6 +1490,8 @@ int ibf_list_seq(ibf_t *const sketch, void (*output_bucket)(bucket_t const *cons
 		++seen;
 		peelable = find_peelable_bucket(sketch->data, blen, &idx);
 	}
+	counters.peel_iterations += seen;
+	for(i = 0; i < blen; ++i) counters.remaining_cells += !ibf_bucket_empty(&sketch->data[i]);
 	/*if(too_small) return ERR_OUTOFBOUNDS;*/
 	if (!peelable || seen >= MAXPASSES * blen) 
 	{
@@ -464,6 +1501,364 @@ int ibf_list_seq(ibf_t *const sketch, void (*output_bucket)(bucket_t const *cons
 	return NO_ERROR;
 }
 
+#ifdef STORE_WEIGHTS /*counted listing only*/
+typedef struct {
+	bucket_t *keys;
+	uint64_t size;
+	uint64_t capacity;
+	int err;
+} peeled_t;
+
+static void collect_bucket(bucket_t const *const bucket, char source, void *peeled) {
+	peeled_t *p = (peeled_t*)peeled;
+	void *dummy;
+	if (p->err) return;
+	if (p->size == p->capacity) {
+		p->capacity = p->capacity ? 2 * p->capacity : 64;
+		if ((dummy = realloc(p->keys, p->capacity * sizeof(bucket_t))) == NULL) {
+			p->err = ERR_ALLOC;
+			return;
+		}
+		p->keys = (bucket_t*)dummy;
+	}
+	p->keys[p->size++] = *bucket;
+}
+
+static int cmp_bucket_key(void const *a, void const *b) {
+	int cmp;
+	bucket_t const *x = (bucket_t const*)a;
+	bucket_t const *y = (bucket_t const*)b;
+	if ((cmp = memcmp(x->keysum, y->keysum, WSIZE)) != 0) return cmp;
+	#ifndef GLEN
+	if (x->key_len != y->key_len) return x->key_len < y->key_len ? -1 : 1;
+	#endif
+	return 0;
+}
+
+/*merge the two copies of the keys whose multiplicity changed, then output them (and free the peeled keys)*/
+static int ibf_output_counted(peeled_t *const peeled, int err, void (*output_key)(bucket_t const *const, char, int64_t, void*), void *iostruct) {
+	uint64_t i, j;
+	int64_t delta;
+	char source;
+	if (peeled->err) err = peeled->err;
+	if (!err || err == ERR_VALUE) qsort(peeled->keys, peeled->size, sizeof(bucket_t), cmp_bucket_key);
+	for(i = 0; (!err || err == ERR_VALUE) && i < peeled->size; i = j) {/*partial listings are output too, see below*/
+		delta = 0;
+		source = peeled->keys[i].counter > 0 ? 'i' : 'j';
+		for(j = i; j < peeled->size && cmp_bucket_key(&peeled->keys[i], &peeled->keys[j]) == 0; ++j) {
+			#ifdef STORE_WEIGHTS
+			delta += peeled->keys[j].weight;
+			#endif
+			if ((peeled->keys[j].counter > 0 ? 'i' : 'j') != source) source = 'b';
+		}
+		if (delta != 0) output_key(&peeled->keys[i], source, delta, iostruct);/*0: the same (garbage) key peeled once on each side*/
+	}
+	if (peeled->keys) free(peeled->keys);
+	return err;
+}
+#endif
+
+/*
+ * List a (difference of) counting IBLT(s) as (key, multiplicity delta) pairs.
+ * A key whose multiplicity changed is peeled twice, as (key, w_i) and (key, w_j): the two are merged here.
+ * source is 'i' or 'j' for keys in one set only and 'b' for keys in both sets with different multiplicities.
+ * Groups whose deltas cancel out are not output: they are in neither set or have the same multiplicity in both.
+ * If peeling fails (ERR_VALUE), the keys peeled so far are still output: a key with one of its two copies left in
+ * the sketch then has a partial delta (and a one-sided source).
+ */
+int ibf_list_counted(ibf_t *const sketch, void (*output_key)(bucket_t const *const, char, int64_t, void*), void *iostruct) {
+#ifdef STORE_WEIGHTS
+	int err;
+	peeled_t peeled;
+#endif
+	assert(sketch != NULL);
+	assert(output_key != NULL);
+#ifndef STORE_WEIGHTS
+	return ERR_INCOMPATIBLE;
+#else
+	peeled.keys = NULL;
+	peeled.size = peeled.capacity = 0;
+	peeled.err = NO_ERROR;
+	err = ibf_list_seq(sketch, &collect_bucket, &peeled);
+	return ibf_output_counted(&peeled, err, output_key, iostruct);
+#endif
+}
+
+/*
+ * Sparse sketches: only the nonzero buckets of a (difference) sketch, as a list of (position, bucket) pairs indexed by
+ * an open-addressing table. Peeling uses a stack of candidate cells instead of scanning the whole sketch, so that
+ * memory and time depend on the number of nonzero buckets only.
+ */
+#define SPARSE_MIN_TABLE 1024
+
+static int ibf_sparse_rehash(ibf_sparse_t *const sparse, uint64_t table_size) {
+	uint64_t i, h, *table;
+	if ((table = (uint64_t*)calloc(table_size, sizeof(uint64_t))) == NULL) return ERR_ALLOC;
+	for(i = 0; i < sparse->size; ++i) {
+		for(h = ibf_mix64(sparse->positions[i]) & (table_size - 1); table[h] != 0; h = (h + 1) & (table_size - 1));
+		table[h] = i + 1;
+	}
+	if (sparse->table) free(sparse->table);
+	sparse->table = table;
+	sparse->table_size = table_size;
+	return NO_ERROR;
+}
+
+/*slot of the bucket at position, sparse->size if not stored*/
+static uint64_t ibf_sparse_find(ibf_sparse_t const *const sparse, uint64_t position) {
+	uint64_t h;
+	if (sparse->table_size == 0) return sparse->size;
+	for(h = ibf_mix64(position) & (sparse->table_size - 1); sparse->table[h] != 0; h = (h + 1) & (sparse->table_size - 1)) {
+		if (sparse->positions[sparse->table[h] - 1] == position) return sparse->table[h] - 1;
+	}
+	return sparse->size;
+}
+
+/*slot of the bucket at position, a zero bucket is added if not stored yet*/
+static int ibf_sparse_slot(ibf_sparse_t *const sparse, uint64_t position, uint64_t *const slot) {
+	int err;
+	uint64_t h, capacity;
+	void *dummy;
+	if (2 * (sparse->size + 1) > sparse->table_size) {
+		if ((err = ibf_sparse_rehash(sparse, sparse->table_size ? 2 * sparse->table_size : SPARSE_MIN_TABLE)) != NO_ERROR) return err;
+	}
+	for(h = ibf_mix64(position) & (sparse->table_size - 1); sparse->table[h] != 0; h = (h + 1) & (sparse->table_size - 1)) {
+		if (sparse->positions[sparse->table[h] - 1] == position) {
+			*slot = sparse->table[h] - 1;
+			return NO_ERROR;
+		}
+	}
+	if (sparse->size == sparse->capacity) {
+		capacity = sparse->capacity ? 2 * sparse->capacity : SPARSE_MIN_TABLE / 2;
+		if ((dummy = realloc(sparse->positions, capacity * sizeof(uint64_t))) == NULL) return ERR_ALLOC;
+		sparse->positions = (uint64_t*)dummy;
+		if ((dummy = realloc(sparse->cells, capacity * sizeof(bucket_t))) == NULL) return ERR_ALLOC;
+		sparse->cells = (bucket_t*)dummy;
+		sparse->capacity = capacity;
+	}
+	*slot = sparse->size++;
+	sparse->positions[*slot] = position;
+	memset(&sparse->cells[*slot], 0, sizeof(bucket_t));
+	sparse->table[h] = *slot + 1;
+	return NO_ERROR;
+}
+
+int ibf_sparse_read(FILE *const in, ibf_sparse_t *const sparse) {
+	int err;
+	uint64_t i, gap, next, nonzero, slot;
+	uint8_t is_sparse;
+	bucket_t bucket;
+	assert(in != NULL);
+	assert(sparse != NULL);
+	memset(sparse, 0, sizeof *sparse);
+	if ((err = ibf_header_read(in, &sparse->sketch, &is_sparse)) != NO_ERROR) return err;
+	if (is_sparse) {
+		if (fread(&nonzero, sizeof nonzero, 1, in) != 1) return ERR_IO;
+		nonzero = ntoh64(nonzero);
+		for(i = next = 0; i < nonzero; ++i) {
+			if ((err = ibf_varint_read(in, &gap)) != NO_ERROR) return err;
+			if (gap >= sparse->sketch.chunk_size * sparse->sketch.repetitions - next) return ERR_INCOMPATIBLE;
+			next += gap;
+			if (ibf_bucket_load(in, &bucket) != NO_ERROR) return ERR_IO;
+			if ((err = ibf_sparse_slot(sparse, next++, &slot)) != NO_ERROR) return err;
+			sparse->cells[slot] = bucket;
+		}
+	} else {/*dense files are read bucket by bucket, keeping the nonzero ones*/
+		for(i = 0; i < sparse->sketch.chunk_size * sparse->sketch.repetitions; ++i) {
+			if (ibf_bucket_load(in, &bucket) != NO_ERROR) return ERR_IO;
+			if (ibf_bucket_empty(&bucket)) continue;
+			if ((err = ibf_sparse_slot(sparse, i, &slot)) != NO_ERROR) return err;
+			sparse->cells[slot] = bucket;
+		}
+	}
+	return ibf_seres_read(in, &sparse->sketch);
+}
+
+int ibf_sparse_load(char const *const path, ibf_sparse_t *const sparse) {
+	int err;
+	FILE* in;
+	assert(path != NULL);
+	assert(sparse != NULL);
+	if ((in = fopen(path, "rb")) == NULL) return ERR_IO;
+	err = ibf_sparse_read(in, sparse);
+	fclose(in);
+	return err;
+}
+
+static int cmp_position(void const *a, void const *b) {
+	uint64_t x = ((uint64_t const*)a)[0];
+	uint64_t y = ((uint64_t const*)b)[0];
+	return x < y ? -1 : x > y;
+}
+
+int ibf_sparse_store(char const *const path, ibf_sparse_t const *const sparse) {
+	int err;
+	FILE* out;
+	uint64_t i, n, next, buffer64;
+	uint64_t (*order)[2];/*(position, slot) of the nonzero buckets, by position*/
+	assert(path != NULL);
+	assert(sparse != NULL);
+	if ((order = malloc((sparse->size ? sparse->size : 1) * sizeof *order)) == NULL) return ERR_ALLOC;
+	for(i = n = 0; i < sparse->size; ++i) {
+		if (ibf_bucket_empty(&sparse->cells[i])) continue;
+		order[n][0] = sparse->positions[i];
+		order[n++][1] = i;
+	}
+	qsort(order, n, sizeof *order, cmp_position);
+	if((out = fopen(path, "wb")) == NULL) {
+		free(order);
+		return ERR_IO;
+	}
+	err = ibf_header_write(out, &sparse->sketch, TRUE);
+	buffer64 = hton64(n);
+	if (!err && fwrite(&buffer64, sizeof buffer64, 1, out) != 1) err = ERR_IO;
+	for(i = next = 0; !err && i < n; ++i) {
+		if (ibf_varint_write(out, order[i][0] - next) != NO_ERROR || ibf_bucket_store(out, &sparse->cells[order[i][1]]) != NO_ERROR) err = ERR_IO;
+		next = order[i][0] + 1;
+	}
+	if (!err) err = ibf_seres_write(out, &sparse->sketch);
+	if (fclose(out) != 0 && err == NO_ERROR) err = ERR_IO;
+	free(order);
+	return err;
+}
+
+int ibf_sparse_destroy(ibf_sparse_t *const sparse) {
+	int err;
+	assert(sparse != NULL);
+	err = NO_ERROR;
+	if (sparse->sketch.seres != NULL) err = ibf_hash_destroy(sparse->sketch.seres);
+	if (sparse->positions) free(sparse->positions);
+	if (sparse->cells) free(sparse->cells);
+	if (sparse->table) free(sparse->table);
+	memset(sparse, 0, sizeof *sparse);
+	return err;
+}
+
+static int ibf_stack_push(uint64_t **const stack, uint64_t *const size, uint64_t *const capacity, uint64_t value) {
+	void *dummy;
+	if (*size == *capacity) {
+		*capacity = *capacity ? 2 * *capacity : 1024;
+		if ((dummy = realloc(*stack, *capacity * sizeof(uint64_t))) == NULL) return ERR_ALLOC;
+		*stack = (uint64_t*)dummy;
+	}
+	(*stack)[(*size)++] = value;
+	return NO_ERROR;
+}
+
+/*
+ * Same output and counters as ibf_list_seq.
+ * A cell whose key maps to an empty cell cannot be pure (the key would be there too), so it is skipped as a false pure
+ * cell before being peeled: this also stops garbage keys from bouncing between two cells.
+ */
+int ibf_sparse_list_seq(ibf_sparse_t *const sparse, void (*output_bucket)(bucket_t const *const, char, void*), void *iostruct) {
+	int err;
+	uint64_t i, j, slot, other, top, capacity, seen, blen;
+	uint64_t *stack;
+	uint64_t positions[RMAX];
+	unsigned char pure;
+	bucket_t peeled;
+	bucket_t *cell;
+	assert(sparse != NULL);
+	assert(output_bucket != NULL);
+	stack = NULL;
+	top = capacity = seen = 0;
+	blen = sparse->sketch.chunk_size * sparse->sketch.repetitions;
+	err = NO_ERROR;
+	counters.remaining_cells = 0;
+	for(i = 0; !err && i < sparse->size; ++i) if (sparse->cells[i].counter == 1 || sparse->cells[i].counter == -1) err = ibf_stack_push(&stack, &top, &capacity, i);
+	while(!err && top > 0 && seen < MAXPASSES * blen) {
+		slot = stack[--top];
+		if (sparse->cells[slot].counter != 1 && sparse->cells[slot].counter != -1) continue;
+		++seen;
+		peeled = sparse->cells[slot];
+		#ifdef STORE_WEIGHTS
+		err = ibf_hash_key(peeled.keysum, peeled.weight * peeled.counter, sparse->sketch.repetitions, sparse->sketch.hash_family, sparse->sketch.seres);
+		#else
+		err = ibf_hash_key(peeled.keysum, 1, sparse->sketch.repetitions, sparse->sketch.hash_family, sparse->sketch.seres);
+		#endif
+		if (err != NO_ERROR) break;
+		ibf_positions(&sparse->sketch, positions);
+		for (j = 0, pure = FALSE; j < sparse->sketch.repetitions; ++j) pure |= positions[j] == sparse->positions[slot];
+		for (j = 0; pure && j < sparse->sketch.repetitions; ++j) {
+			other = ibf_sparse_find(sparse, positions[j]);
+			pure = other != sparse->size && !ibf_bucket_empty(&sparse->cells[other]);
+		}
+		if (!pure) {/*may become pure once other keys are peeled, it is then pushed again*/
+			++counters.false_pure;
+			continue;
+		}
+		for (j = 0; !err && j < sparse->sketch.repetitions; ++j) {
+			if (positions[j] == sparse->positions[slot]) continue;
+			if ((err = ibf_sparse_slot(sparse, positions[j], &other)) != NO_ERROR) break;
+			cell = &sparse->cells[other];
+			cell->counter -= peeled.counter;
+			#ifdef STORE_WEIGHTS
+			cell->weight -= peeled.weight;
+			#endif
+			for(i = 0; i < WSIZE; ++i) cell->keysum[i] ^= peeled.keysum[i];
+			#ifndef GLEN
+			cell->key_len ^= peeled.key_len;
+			#endif
+			#ifndef RPOS
+			cell->position ^= peeled.position;
+			#endif
+			if (cell->counter == 1 || cell->counter == -1) err = ibf_stack_push(&stack, &top, &capacity, other);
+		}
+		if (err) break;
+		++counters.pure_hits;
+		output_bucket(&peeled, peeled.counter == 1 ? 'i' : 'j', iostruct);
+		memset(&sparse->cells[slot], 0, sizeof(bucket_t));
+	}
+	if (stack) free(stack);
+	counters.peel_iterations += seen;
+	if (err) return err;
+	for(i = 0; i < sparse->size; ++i) counters.remaining_cells += !ibf_bucket_empty(&sparse->cells[i]);
+	return counters.remaining_cells ? ERR_VALUE : NO_ERROR;
+}
+
+int ibf_sparse_list_counted(ibf_sparse_t *const sparse, void (*output_key)(bucket_t const *const, char, int64_t, void*), void *iostruct) {
+#ifdef STORE_WEIGHTS
+	int err;
+	peeled_t peeled;
+#endif
+	assert(sparse != NULL);
+	assert(output_key != NULL);
+#ifndef STORE_WEIGHTS
+	return ERR_INCOMPATIBLE;
+#else
+	peeled.keys = NULL;
+	peeled.size = peeled.capacity = 0;
+	peeled.err = NO_ERROR;
+	err = ibf_sparse_list_seq(sparse, &collect_bucket, &peeled);
+	return ibf_output_counted(&peeled, err, output_key, iostruct);
+#endif
+}
+
+/*
+ * i-th cell of the first repetition: each key is counted exactly once there.
+ */
+static inline uint64_t ibf_first_row_cell(ibf_t const *const sketch, uint64_t i) {
+	if (sketch->layout == IBF_LAYOUT_BLOCKED) return (i / sketch->block_width) * sketch->repetitions * sketch->block_width + i % sketch->block_width;
+	return i;
+}
+
+int ibf_weight_seq(ibf_t const *const sketch, int64_t *const weight) {
+	size_t i;
+	assert(sketch != NULL);
+	assert(weight != NULL);
+	*weight = 0;
+	if (sketch->repetitions != 0 || sketch->chunk_size != 0) {
+		for(i = 0; i < sketch->chunk_size; ++i) {
+			#ifdef STORE_WEIGHTS
+			*weight += sketch->data[ibf_first_row_cell(sketch, i)].weight;
+			#else
+			*weight += sketch->data[ibf_first_row_cell(sketch, i)].counter;/*sets have unit weights*/
+			#endif
+		}
+	}
+	return NO_ERROR;
+}
+
 int ibf_count_seq(ibf_t const *const sketch, unsigned long *const count) {
 	size_t i;
 	assert(sketch != NULL);
@@ -471,7 +1866,7 @@ int ibf_count_seq(ibf_t const *const sketch, unsigned long *const count) {
 	*count = 0;
 	if (sketch->repetitions != 0 || sketch->chunk_size != 0) {
 		for(i = 0; i < sketch->chunk_size; ++i) {
-			*count += sketch->data[i].counter;
+			*count += sketch->data[ibf_first_row_cell(sketch, i)].counter;
 		}
 	}
 	return NO_ERROR;
@@ -71,6 +71,9 @@ typedef struct {
 typedef struct {
     int64_t counter;/*<POSSIBLE SOURCE OF ERRORS: changed from unsigned to signed because of symmetry. If bugs use a defined threshold = 2^63*/
     uint8_t keysum[WSIZE];
+    #ifdef STORE_WEIGHTS/*counting IBLT: each key is stored together with its multiplicity*/
+    int64_t weight;
+    #endif
     #ifndef GLEN/*if all keys are the same length, then store it inside the ibf itself, saving space in the buckets*/
     keysum_len_t key_len;
     #endif
@@ -79,40 +82,147 @@ typedef struct {
     #endif
 } bucket_t;
 
+enum Hash_family {IBF_HASH_MURMUR3, IBF_HASH_MIX64, IBF_HASH_WYHASH, IBF_HASH_FAMILIES};
+
+enum Layout {IBF_LAYOUT_CLASSIC, IBF_LAYOUT_BLOCKED, IBF_LAYOUT_FOLDABLE, IBF_LAYOUTS};
+
+enum Alloc_policy {IBF_ALLOC_DEFAULT = 0, IBF_ALLOC_HUGEPAGES = 1, IBF_ALLOC_INTERLEAVE = 2};/*flags, see ibf_set_alloc_policy*/
+
+#define BLOCKED_MAX_EXPANSION 4 /*blocked sketches larger than this many times the classic one are rejected*/
+
 typedef struct {
     /*uint32_t seed;*/
     uint8_t repetitions;/* number of hashes/blocks */
+    uint8_t hash_family;/* enum Hash_family used to select the buckets of a key, stored in the sketch header */
+    uint8_t layout;/* enum Layout, classic: one chunk per repetition, blocked: all buckets of a key in one block, foldable: classic with power-of-two chunks */
+    uint32_t block_width;/* blocked layout only, cells of a block for each repetition (a block is r * block_width cells) */
     float epsilon;/*approximation factor*/
     uint64_t chunk_size;/*depends on r, and the expected number of differences (+ the approx factor to augment the prob. of success)*/
     #ifdef GLEN/*if all keys are the same length, it is stored here and not into each bucket*/
     keysum_len_t key_len;
     #endif
     bucket_t *data;/*the sketch itself*/
+    uint8_t data_mapped;/* data was mmap'ed (huge pages/NUMA policy) instead of malloc'ed */
     hash_gen_t *seres;/* seeds + results for each block */
 } ibf_t;
 
+typedef struct {
+    uint64_t inserted;/* keys inserted by ibf_insert_seq/ibf_insert_counted_seq */
+    uint64_t skipped;/* fragments ignored by the _seq insertions/deletions because of a base not in {A,C,G,T} */
+    uint64_t peel_iterations;/* iterations of the listing loop */
+    uint64_t pure_hits;/* pure cells peeled, i.e. keys listed */
+    uint64_t false_pure;/* cells with counter +-1 holding more than one key (hash of the keysum not pointing back to the cell) */
+    uint64_t remaining_cells;/* nonzero cells left by the last listing, 0 if all keys were recovered */
+} ibf_counters_t;
+
+typedef struct {
+    ibf_t sketch;/* parameters and hash seeds, sketch.data is not used (NULL) */
+    uint64_t size;/* buckets stored, the other ones are zero */
+    uint64_t capacity;
+    uint64_t *positions;/* position of each stored bucket in the dense sketch */
+    bucket_t *cells;
+    uint64_t *table;/* open addressing table of the stored buckets by position (slot + 1, 0 if free) */
+    uint64_t table_size;
+} ibf_sparse_t;
+
+void ibf_counters_get(ibf_counters_t *const counters);/*of the calling thread, updated by the _seq insertions and the listings*/
+
+void ibf_counters_add(ibf_counters_t const *const counters);/*adds counters gathered by another thread to those of the calling one*/
+
+void ibf_set_alloc_policy(uint8_t policy);/*enum Alloc_policy flags for the buckets of the sketches created afterwards (init, load, copy, diff)*/
+
 int ibf_sketch_init(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, ibf_t *const sketch);
 
+int ibf_sketch_init_blocked(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint32_t block_width, ibf_t *const sketch);/*block_width = 0 -> classic layout*/
+
+uint32_t ibf_blocked_min_width(unsigned char r, float epsilon, unsigned int n);/*narrowest block accepted for n differences, 0 if none*/
+
+int ibf_sketch_init_foldable(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, ibf_t *const sketch);
+
+int ibf_sketch_shape(unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint32_t block_width, unsigned char foldable, ibf_t *const sketch);/*as the init functions, without allocating the buckets (data == NULL)*/
+
+int ibf_sketch_fold(ibf_t const *const sketch, uint64_t factor, ibf_t *const result);/*factor: power of two, result is the sketch of chunk_size / factor*/
+
+int ibf_sketch_fold_factor(ibf_t const *const sketch, unsigned int n, uint64_t *const factor);/*largest factor keeping a sketch for n differences*/
+
+int ibf_sketch_set_hash(ibf_t *const sketch, uint8_t family);/*call before inserting any key*/
+
+int ibf_hash_family_parse(char const *const name, uint8_t *const family);
+
+char const *ibf_hash_family_name(uint8_t family);
+
 int ibf_sketch_copy(ibf_t const *const source, ibf_t *const dest);
 
 int ibf_sketch_destroy(ibf_t *const sketch);
 
 int ibf_sketch_store(char const * const path, ibf_t const * const sketch);
 
+int ibf_sketch_write(FILE *const out, ibf_t const *const sketch);/*same format as ibf_sketch_store, on an open stream (pipe, socket)*/
+
 int ibf_sketch_load(char const * const path, ibf_t * const sketch);
 
+int ibf_sketch_read(FILE *const in, ibf_t *const sketch);/*reads one sketch written by ibf_sketch_write, leaving the stream after it*/
+
+int ibf_sketch_sub_load(char const *const path, ibf_t *const sketch);/*sketch = sketch - the stored sketch, without loading it*/
+
+int ibf_sketch_sub_read(FILE *const in, ibf_t *const sketch);
+
+int ibf_sketch_diff_stream(char const *const apath, char const *const bpath, char const *const opath, uint64_t buffer_size, unsigned char sparse);/*stored a - b, using about buffer_size bytes of memory*/
+
+int ibf_sketch_write_sparse(FILE *const out, ibf_t const *const sketch);
+
+int ibf_sketch_store_sparse(char const *const path, ibf_t const *const sketch);/*only the nonzero buckets, for difference sketches, any load function reads it*/
+
+int ibf_sketch_is_sparse(char const *const path, uint8_t *const sparse);
+
+int ibf_sketch_nonzero(ibf_t const *const sketch, uint64_t *const count);
+
+int ibf_sparse_load(char const *const path, ibf_sparse_t *const sparse);/*sparse or dense file, only nonzero buckets are kept in memory*/
+
+int ibf_sparse_read(FILE *const in, ibf_sparse_t *const sparse);
+
+int ibf_sparse_store(char const *const path, ibf_sparse_t const *const sparse);
+
+int ibf_sparse_destroy(ibf_sparse_t *const sparse);
+
 int ibf_sketch_print(ibf_t const *const sketch, FILE *const strm);
 
 int ibf_sketch_dump(ibf_t const *const sketch, FILE *const strm);
 
 int ibf_sketch_diff(ibf_t const *const a, ibf_t const *const b, ibf_t *const result);
 
+int ibf_sketch_sub_inplace(ibf_t *const a, ibf_t const *const b);/*a = a - b, as ibf_sketch_diff without a third sketch*/
+
+int ibf_sketch_add_inplace(ibf_t *const a, ibf_t const *const b);/*a = a + b, for sketches built on disjoint sets*/
+
 int ibf_insert_seq(void const *const seq, int start, int end, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len);
 
+int ibf_insert_seq_multi(void const *const seq, int start, int end, ibf_t *const sketches, uint32_t count, uint8_t *const buffer, uint64_t buffer_len);/*one key into several sketches, hashed once per seed*/
+
 int ibf_delete_seq(void const *const seq, int start, int end, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len);
 
+int ibf_pack_seq(void const *const seq, int start, int end, uint8_t *const buffer, uint64_t buffer_len);/*key as stored in the buckets (WSIZE bytes), ERR_VALUE if skipped (counted as such)*/
+
+int ibf_insert_packed(uint8_t const *const packed, unsigned int len, ibf_t *const sketch);/*packed: WSIZE bytes, 2bit-encoded as pack2bit, zero-padded*/
+
+int ibf_spill_seq(FILE *const spill, void const *const seq, int start, int end, uint8_t *const buffer, uint64_t buffer_len);/*as ibf_insert_seq, appending the key to a spill file for ibf_sketch_store_spilled*/
+
+int ibf_sketch_store_spilled(char const *const path, ibf_t *const sketch, FILE *const spill, uint64_t memory);/*stores the sketch of the spilled keys, built memory bytes of buckets at a time (sketch from ibf_sketch_shape)*/
+
 int ibf_list_seq(ibf_t *const sketch, void (*output_bucket)(bucket_t const *const, char, void*), void *iostruct);/*DESTRUCTIVE OPERATION, make copy of sketch if needed*/
 
+int ibf_insert_counted_seq(void const *const seq, int start, int end, int64_t weight, ibf_t *const sketch, uint8_t *const buffer, uint64_t buffer_len);
+
+int ibf_insert_counted_packed(uint8_t const *const packed, unsigned int len, int64_t weight, ibf_t *const sketch);
+
+int ibf_list_counted(ibf_t *const sketch, void (*output_key)(bucket_t const *const, char, int64_t, void*), void *iostruct);/*DESTRUCTIVE OPERATION, make copy of sketch if needed*/
+
+int ibf_sparse_list_seq(ibf_sparse_t *const sparse, void (*output_bucket)(bucket_t const *const, char, void*), void *iostruct);/*DESTRUCTIVE OPERATION, as ibf_list_seq*/
+
+int ibf_sparse_list_counted(ibf_sparse_t *const sparse, void (*output_key)(bucket_t const *const, char, int64_t, void*), void *iostruct);/*DESTRUCTIVE OPERATION, as ibf_list_counted*/
+
+int ibf_weight_seq(ibf_t const *const sketch, int64_t *const weight);
+
 int ibf_count_seq(ibf_t const *const sketch, unsigned long *const count);
 
 int ibf_buffer_init(uint8_t** const buffer);
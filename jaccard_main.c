@@ -2,18 +2,23 @@
 #include <stdio.h>
 #include "jaccard_main.h"
 #include "ketopt.h"
+#include "constants.h"
 #include "ibflib.h"
+#include "stats.h"
 /*#include "minHash.h"*/
 
 typedef struct {
     unsigned long long unique_i_size;
     unsigned long long unique_j_size;
+    unsigned long long weighted_difference;/*sum of |count_i - count_j| over all keys*/
 } callback_t;
 
 void print_jaccard_help();
 
 void increment_difference_size(const bucket_t *bucket, char source, void *sizes);
 
+void increment_weighted_difference(const bucket_t *bucket, char source, int64_t delta, void *sizes);
+
 enum SketchType {IBF, MINHASH};
 
 int compute_ibf_jaccard(char const *const ibf1_path, char const *const ibf2_path);
@@ -24,7 +29,7 @@ enum Error jaccard_main(int argc, char** argv) {
     char *path1, *path2;
     enum Error err;
     enum SketchType stype;
-    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
+    static ko_longopt_t longopts[] = {{"stats", ko_no_argument, LONGOPT_STATS}, {NULL, 0, 0}};
 
     stype = IBF;/* IBF is always used because y option is not available anymore */
     err = NO_ERROR;
@@ -39,6 +44,8 @@ enum Error jaccard_main(int argc, char** argv) {
             if (strcmp(opt.arg, "ibf") == 0) stype = IBF;
             else if (strcmp(opt.arg, "mh") == 0) stype = MINHASH;
             else return ERR_OPTION;
+        } else if (c == LONGOPT_STATS) {
+            stats_enable("jaccard");
         } else if (c == 'h') {
             print_jaccard_help();
             return NO_ERROR;
@@ -60,6 +67,7 @@ enum Error jaccard_main(int argc, char** argv) {
         default:
             fprintf(stderr, "[Jaccard] This should never happen\n");
     }
+    stats_print(stderr);
     return err;
 }
 
@@ -68,6 +76,7 @@ void print_jaccard_help() {
     fprintf(stderr, "\t-i\tfirst sketch\n");
     fprintf(stderr, "\t-j\tsecond sketch\n");
     /*fprintf(stderr, "\t-y\tsketch type (ibf, mh) [ibf]\n");*/
+    fprintf(stderr, "\t--stats\tprint run statistics (phase times, counters, peak memory) as JSON on stderr\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }
 
@@ -77,27 +86,55 @@ void increment_difference_size(const bucket_t *bucket, char source, void *sizes)
     else ++dummy->unique_j_size;
 }
 
+void increment_weighted_difference(const bucket_t *bucket, char source, int64_t delta, void *sizes) {
+    callback_t *dummy = (callback_t*) sizes;
+    if (source == 'i') ++dummy->unique_i_size;
+    else if (source == 'j') ++dummy->unique_j_size;
+    dummy->weighted_difference += delta < 0 ? -delta : delta;
+}
+
 int compute_ibf_jaccard(char const *const ibf1_path, char const *const ibf2_path) {
+    int err;
+    ibf_t ibf1, ibf2;
+    err = NO_ERROR;
+    stats_begin(STATS_LOAD);
+    if (!err && (err = ibf_sketch_load(ibf1_path, &ibf1)) != NO_ERROR) fprintf(stderr, "Unable to read the first invertible bloom filter\n");
+    if (!err && (err = ibf_sketch_load(ibf2_path, &ibf2)) != NO_ERROR) fprintf(stderr, "Unable to read the second invertible bloom filter\n");
+    stats_end(STATS_LOAD);
+    if (!err) {
+        err = sketch_jaccard(&ibf1, &ibf2, stdout);
+        ibf_sketch_destroy(&ibf1);
+        ibf_sketch_destroy(&ibf2);
+    } else fprintf(stdout, "NaN,NaN,NaN\n");
+    return err;
+}
+
+int sketch_jaccard(ibf_t *const ibf1, ibf_t const *const ibf2, FILE *const out) {
     int err;
     unsigned long L0i, L0j;
+    int64_t L1i, L1j;
     double jaccard, containment_i_j, containment_j_i;
-    ibf_t ibf1, ibf2, res;
     callback_t increments;
-    res.seres = NULL;
-    res.data = NULL;
     increments.unique_i_size = 0;
     increments.unique_j_size = 0;
+    increments.weighted_difference = 0;
+    L1i = L1j = 0;
     err = NO_ERROR;
-    if (!err && (err = ibf_sketch_load(ibf1_path, &ibf1)) != NO_ERROR) fprintf(stderr, "Unable to read the first invertible bloom filter\n");
-    if (!err && (err = ibf_sketch_load(ibf2_path, &ibf2)) != NO_ERROR) fprintf(stderr, "Unable to read the second invertible bloom filter\n");
-    if (!err) if ((err = ibf_sketch_diff(&ibf1, &ibf2, &res)) != NO_ERROR) fprintf(stderr, "Error while computing the ibf difference\n");
-    if (!err) err = ibf_count_seq(&ibf1, &L0i);
-    if (!err) err = ibf_count_seq(&ibf2, &L0j);
-    if (!err) err = ibf_sketch_destroy(&ibf1);
-    if (!err) err = ibf_sketch_destroy(&ibf2);
+    if (!err) err = ibf_count_seq(ibf1, &L0i);
+    if (!err) err = ibf_count_seq(ibf2, &L0j);
+    if (!err) err = ibf_weight_seq(ibf1, &L1i);
+    if (!err) err = ibf_weight_seq(ibf2, &L1j);
+    stats_begin(STATS_DIFF);/*the sizes are taken first, ibf1 then becomes the difference*/
+    if (!err) if ((err = ibf_sketch_sub_inplace(ibf1, ibf2)) != NO_ERROR) fprintf(stderr, "Error while computing the ibf difference\n");
+    stats_end(STATS_DIFF);
     
-    if (!err) if ((err = ibf_list_seq(&res, &increment_difference_size, &increments)) != NO_ERROR) fprintf(stderr, "Error while peeling the sketch for jaccard computation\n");
-    if (!err) err = ibf_sketch_destroy(&res);
+    stats_begin(STATS_PEEL);
+    #ifdef STORE_WEIGHTS
+    if (!err) if ((err = ibf_list_counted(ibf1, &increment_weighted_difference, &increments)) != NO_ERROR) fprintf(stderr, "Error while peeling the sketch for jaccard computation\n");
+    #else
+    if (!err) if ((err = ibf_list_seq(ibf1, &increment_difference_size, &increments)) != NO_ERROR) fprintf(stderr, "Error while peeling the sketch for jaccard computation\n");
+    #endif
+    stats_end(STATS_PEEL);
     if (!err) jaccard = ((double)(L0i - increments.unique_i_size)) / (L0i + increments.unique_j_size);
     if (!err) if (jaccard != ((double)(L0j - increments.unique_j_size)) / (L0j + increments.unique_i_size)) {
         fprintf(stderr, "Inconsistent Jaccard\n");
@@ -106,8 +143,13 @@ int compute_ibf_jaccard(char const *const ibf1_path, char const *const ibf2_path
     if (!err) {
         containment_i_j = (double)(L0i - increments.unique_i_size) / L0i;
         containment_j_i = (double)(L0j - increments.unique_j_size) / L0j;
-        fprintf(stdout, "%f,%f,%f\n", jaccard, containment_i_j, containment_j_i);
-    } else fprintf(stdout, "NaN,NaN,NaN\n");
+        #ifdef STORE_WEIGHTS /*weighted Jaccard = sum(min) / sum(max) = (L1i + L1j - diff) / (L1i + L1j + diff)*/
+        fprintf(out, "%f,%f,%f,%f\n", jaccard, containment_i_j, containment_j_i, 
+            (double)(L1i + L1j - (int64_t)increments.weighted_difference) / (L1i + L1j + (int64_t)increments.weighted_difference));
+        #else
+        fprintf(out, "%f,%f,%f\n", jaccard, containment_i_j, containment_j_i);
+        #endif
+    } else fprintf(out, "NaN,NaN,NaN\n");
     return err;
 }
 
@@ -1,10 +1,14 @@
 #ifndef JACCARD_MAIN_H
 #define JACCARD_MAIN_H
 
+#include <stdio.h>
 #include "err.h"
+#include "ibflib.h"
 
 enum Error jaccard_main(int argc, char** argv);
 
 enum Error count_main(int args, char ** argv);
 
+int sketch_jaccard(ibf_t *const ibf1, ibf_t const *const ibf2, FILE *const out);/*prints jaccard,containment_i_j,containment_j_i[,weighted jaccard] to out, ibf1 is overwritten by the difference*/
+
 #endif/*JACCARD_MAIN_H*/
@@ -0,0 +1,214 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "./kmc_api/kmc_file.h"
+#include "kmc_partitions.h"
+extern "C" {
+	#include "ketopt.h"
+	#include "constants.h"
+	#include "ibflib.h"
+	#include "err.h"
+}
+
+/*
+ * Build an IBLT directly from a KMC database.
+ * K-mers are taken from their binary representation and inserted already 2bit-packed,
+ * so no string conversion (to_string + pack2bit) takes place.
+ * The result is the same IBLT produced by 'ibltseq build' on the listed k-mers.
+ */
+
+void print_kmc2ibf_help()
+{
+	std::cerr <<
+		"kmc2ibf options:\n" <<
+		"\t-i\tinput KMC database (without extensions)\n" <<
+		"\t-o\tInvertible Bloom Filter file (binary output)\n" <<
+		"\t-n\tnumber of differences to track (0 < n)\n" <<
+		"\t-r\tnumber of hash functions [3] (3 <= r <= 7)\n" <<
+		"\t-e\tepsilon [0] (0 <= epsilon)\n" <<
+		"\t-s\trandom seed [42]\n" <<
+		"\t-H\thash family used to place keys: murmur3, mix64 (fastest for k <= 32), wyhash (wide keys) [murmur3]\n" <<
+		"\t-B\tblocked layout: all buckets of a key fall in one block of r * B cells, 0 for the classic layout [0]\n" <<
+		"\t-m\tminimum k-mer count [database minimum]\n" <<
+		"\t-M\tmaximum k-mer count [database maximum]\n" <<
+		"\t-t\tnumber of threads, each one builds a full-size IBLT of a range of the KMC prefix LUT, merged at the end (t times the memory of one sketch) [1]\n" <<
+		"\t-w\tinsert k-mers with their counts (counting IBLT, needs configure.py sequences --weighted)\n" <<
+		"\t--hugepages\tback the sketches with huge pages (explicit if reserved, transparent otherwise)\n" <<
+		"\t--interleave\tinterleave the sketches over all NUMA nodes, instead of placing each one on the node of the thread filling it\n" <<
+		"\t-h\tshow this help\n";
+}
+
+/*
+ * Write the k bases of a k-mer (as returned by CKmerAPI::to_long, right-aligned)
+ * with the same layout as pack2bit: first base in the most significant bits of out[0].
+ */
+static inline void pack_kmer(std::vector<uint64> const& rows, uint32_t k, uint8_t *const out)
+{
+	uint64_t lead = rows.size() * 64 - 2 * k;
+	for(uint64_t j = 0; j < CEILING(2 * k, 8); ++j)
+	{
+		uint64_t bit = lead + 8 * j;
+		uint64_t r = bit / 64;
+		uint64_t sh = bit % 64;
+		uint64_t w = rows[r] << sh;
+		if(sh > 56 and r + 1 < rows.size()) w |= rows[r + 1] >> (64 - sh);
+		out[j] = static_cast<uint8_t>(w >> 56);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	static ko_longopt_t longopts[] = {
+		{const_cast<char*>("hugepages"), ko_no_argument, LONGOPT_HUGEPAGES},
+		{const_cast<char*>("interleave"), ko_no_argument, LONGOPT_INTERLEAVE},
+		{NULL, 0, 0}
+	};
+	ketopt_t opt = KETOPT_INIT;
+	int c;
+	std::string kmc_path, output_path;
+	unsigned int n = 0, s = 42;
+	unsigned char r = 3;
+	float e = 0;
+	uint32_t min_count = 0, max_count = 0;
+	std::size_t nthreads = 1;
+	bool weighted = false;
+	uint8_t hash_family = IBF_HASH_MURMUR3;
+	uint32_t block_width = 0;
+	uint8_t alloc_policy = IBF_ALLOC_DEFAULT;
+	while((c = ketopt(&opt, argc, argv, 1, "i:o:n:r:e:s:H:B:m:M:t:wh", longopts)) >= 0)
+	{
+		if (c == 'i') {
+			kmc_path = opt.arg;
+		} else if (c == 'o') {
+			output_path = opt.arg;
+		} else if (c == 'n') {
+			n = std::stoul(opt.arg, nullptr, 10);
+		} else if (c == 'r') {
+			r = static_cast<unsigned char>(std::stoul(opt.arg, nullptr, 10));
+		} else if (c == 'e') {
+			e = std::stof(opt.arg);
+		} else if (c == 's') {
+			s = std::stoul(opt.arg, nullptr, 10);
+		} else if (c == 'H') {
+			if (ibf_hash_family_parse(opt.arg, &hash_family) != NO_ERROR) {
+				std::cerr << "Unknown hash family " << opt.arg << "\n";
+				return EXIT_FAILURE;
+			}
+		} else if (c == 'B') {
+			block_width = std::stoul(opt.arg, nullptr, 10);
+		} else if (c == 'm') {
+			min_count = std::stoul(opt.arg, nullptr, 10);
+		} else if (c == 'M') {
+			max_count = std::stoul(opt.arg, nullptr, 10);
+		} else if (c == 't') {
+			nthreads = std::max(std::stoul(opt.arg, nullptr, 10), 1UL);
+		} else if (c == 'w') {
+			weighted = true;
+		} else if (c == LONGOPT_HUGEPAGES) {
+			alloc_policy |= IBF_ALLOC_HUGEPAGES;
+		} else if (c == LONGOPT_INTERLEAVE) {
+			alloc_policy |= IBF_ALLOC_INTERLEAVE;
+		} else if (c == 'h') {
+			print_kmc2ibf_help();
+			return EXIT_SUCCESS;
+		} else {
+			std::cerr << "Option -" << static_cast<char>(c) << " not available\n";
+			print_kmc2ibf_help();
+			return EXIT_FAILURE;
+		}
+	}
+	if(kmc_path.length() == 0 or output_path.length() == 0 or n == 0 or r < 3 or r > 7 or e < 0) {
+		if(kmc_path.length() == 0) std::cerr << "Option -i is mandatory\n";
+		if(output_path.length() == 0) std::cerr << "Option -o is mandatory\n";
+		if(n == 0) std::cerr << "Unspecified n\n";
+		if(r < 3 or r > 7) std::cerr << "2 < r < 8\n";
+		if(e < 0) std::cerr << "0 <= e\n";
+		print_kmc2ibf_help();
+		return EXIT_FAILURE;
+	}
+
+	if (block_width != 0 and block_width < ibf_blocked_min_width(r, e, n)) {
+		std::cerr << "Blocks of " << block_width << " cells need more than " << BLOCKED_MAX_EXPANSION << " times the buckets of the classic layout for n = " << n << ", the narrowest accepted is -B " << ibf_blocked_min_width(r, e, n) << "\n";
+		return EXIT_FAILURE;
+	}
+
+	CKMCFile kmcdb;
+	if (!kmcdb.OpenForListing(kmc_path)) {
+		throw std::runtime_error("Unable to open the database\n");
+	}
+	CKMCFileInfo infos;
+	kmcdb.Info(infos);
+	uint32_t k = infos.kmer_length;
+	auto partitions = lut_partitions(kmcdb.LUTSize(), nthreads);
+	kmcdb.Close();
+#ifdef DNALEN
+	if (k > DNALEN) {
+		std::cerr << "k-mers of length " << k << " do not fit in buckets configured for " << DNALEN << " bases\n";
+		return EXIT_FAILURE;
+	}
+#else
+	std::cerr << "km-peeler must be configured for sequences (see configure.py)\n";
+	return EXIT_FAILURE;
+#endif
+#ifndef STORE_WEIGHTS
+	if (weighted) {
+		std::cerr << "Option -w needs km-peeler configured for counting IBLTs (configure.py sequences --weighted)\n";
+		return EXIT_FAILURE;
+	}
+#endif
+
+	ibf_set_alloc_policy(alloc_policy);
+	std::vector<ibf_t> sketches(partitions.size());
+	std::vector<int> errors(partitions.size(), NO_ERROR);
+	for(auto& sketch : sketches)
+	{
+		std::memset(&sketch, 0, sizeof(ibf_t));
+		if ((errors[0] = ibf_sketch_init_blocked(s, r, e, n, block_width, &sketch)) != NO_ERROR) break;
+		if ((errors[0] = ibf_sketch_set_hash(&sketch, hash_family)) != NO_ERROR) break;
+		#ifdef GLEN
+		sketch.key_len = k;
+		#endif
+	}
+	if (errors[0] == NO_ERROR)
+	{
+		auto build_partition = [&](std::size_t p)
+		{
+			CKMCFile kmcpart;
+			if (!kmcpart.OpenForListing(kmc_path, partitions[p].first, partitions[p].second))
+			{
+				errors[p] = ERR_FILE;
+				return;
+			}
+			if ((max_count and !kmcpart.SetMaxCount(max_count)) or (min_count and !kmcpart.SetMinCount(min_count)))
+			{
+				errors[p] = ERR_VALUE;
+				return;
+			}
+			CKmerAPI kmer(k);
+			uint32_t counter;
+			std::vector<uint64> rows;
+			uint8_t buffer[WSIZE] = {0};
+			while(errors[p] == NO_ERROR and kmcpart.ReadNextKmer(kmer, counter))
+			{
+				kmer.to_long(rows);
+				pack_kmer(rows, k, buffer);
+				errors[p] = weighted ? ibf_insert_counted_packed(buffer, k, counter, &sketches[p]) : ibf_insert_packed(buffer, k, &sketches[p]);
+			}
+			kmcpart.Close();
+		};
+		for_each_partition(partitions.size(), build_partition);
+	}
+	int err = NO_ERROR;
+	for(auto e : errors) if (err == NO_ERROR) err = e;
+	for(std::size_t p = 1; p < sketches.size() and err == NO_ERROR; ++p) err = ibf_sketch_add_inplace(&sketches[0], &sketches[p]);
+	if (err == NO_ERROR) {
+		err = ibf_sketch_store(output_path.c_str(), &sketches[0]);
+		if (err != NO_ERROR) print_error(static_cast<enum Error>(err), const_cast<char*>("IBF save"));
+	} else {
+		print_error(static_cast<enum Error>(err), const_cast<char*>("KMC database insertion"));
+	}
+	for(auto& sketch : sketches) ibf_sketch_destroy(&sketch);
+	return err == NO_ERROR ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -59,6 +59,17 @@ bool CKMCFile::OpenForRA(const std::string &file_name)
 // RET	: true		- if successful
 //----------------------------------------------------------------------------------
 bool CKMCFile::OpenForListing(const std::string &file_name)
+{
+	return OpenForListing(file_name, 0, UINT64_MAX);
+}
+//----------------------------------------------------------------------------------
+// Open files *kmc_pre & *.kmc_suf for listing a range of LUT entries, *.kmc_suf is buffered
+// IN	: file_name - the name of kmer_counter's output
+// IN	: lut_begin - first LUT entry to list
+// IN	: lut_end	- one past the last LUT entry to list (clamped to LUTSize())
+// RET	: true		- if successful
+//----------------------------------------------------------------------------------
+bool CKMCFile::OpenForListing(const std::string &file_name, uint64 lut_begin, uint64 lut_end)
 {
 	uint64 size;
 
@@ -71,16 +82,41 @@ bool CKMCFile::OpenForListing(const std::string &file_name)
 	if (!OpenASingleFile(file_name + ".kmc_pre", file_pre, size, (char *)"KMCP"))
 		return false;
 
-	ReadParamsFrom_prefix_file_buf(size, open_mode::opened_for_listing);
+	if (!ReadParamsFrom_prefix_file_buf(size, open_mode::opened_for_listing))
+		return false;
+
+	lut_end = MIN(lut_end, lut_size);
+	lut_begin = MIN(lut_begin, lut_end);
+	listing_begin = 0;
+	listing_end = total_kmers;
+	if (lut_begin != 0 || lut_end != lut_size)
+	{
+		uint64 bounds[2] = {lut_begin, lut_end};
+		for (auto& bound : bounds)
+		{
+			if (bound == lut_size)
+				bound = total_kmers; // for kmc1 the last LUT entry is not stored
+			else
+			{
+				my_fseek(file_pre, 4 + 8 * bound, SEEK_SET);
+				if (fread(&bound, sizeof(uint64), 1, file_pre) != 1)
+					return false;
+			}
+		}
+		listing_begin = bounds[0];
+		listing_end = bounds[1];
+		prefixFileBufferForListingMode = std::make_unique<CPrefixFileBufferForListingMode>(file_pre, lut_size, lut_prefix_length, kmc_version == 0, total_kmers, lut_begin);
+	}
 
-	end_of_file = total_kmers == 0;
+	end_of_file = listing_begin == listing_end;
 
 	if (!OpenASingleFile(file_name + ".kmc_suf", file_suf, size, (char *)"KMCS"))
 		return false;
 
 	sufix_file_buf = new uchar[part_size];
 
-	suffix_file_total_to_read = size;
+	my_fseek(file_suf, 4 + listing_begin * sufix_rec_size, SEEK_SET);
+	suffix_file_total_to_read = (listing_end - listing_begin) * sufix_rec_size;
 	suf_file_left_to_read = suffix_file_total_to_read;
 	auto to_read = MIN(suf_file_left_to_read, part_size);
 	auto readed = fread(sufix_file_buf, 1, to_read, file_suf);
@@ -94,7 +130,7 @@ bool CKMCFile::OpenForListing(const std::string &file_name)
 
 	is_opened = opened_for_listing;
 	prefix_index = 0;
-	sufix_number = 0;
+	sufix_number = listing_begin;
 	index_in_partial_buf = 0;
 	return true;
 }
@@ -220,6 +256,7 @@ bool CKMCFile::ReadParamsFrom_prefix_file_buf(uint64 &size, open_mode _open_mode
 		uint64 lut_area_size_in_bytes = size - (signature_map_size * sizeof(uint32)+header_offset + 8);
 		single_LUT_size = 1 << (2 * lut_prefix_length);
 		uint64 last_data_index = lut_area_size_in_bytes / sizeof(uint64);
+		lut_size = last_data_index;
 
 		signature_map = new uint32[signature_map_size];
 
@@ -295,6 +332,7 @@ bool CKMCFile::ReadParamsFrom_prefix_file_buf(uint64 &size, open_mode _open_mode
 
 		prefix_file_buf_size = (1ull << (2 * lut_prefix_length)) + 1;
 		uint64 last_data_index = prefix_file_buf_size - 1;
+		lut_size = last_data_index;
 
 		if (_open_mode == opened_for_RA)
 		{
@@ -490,7 +528,7 @@ bool CKMCFile::ReadNextKmer(CKmerAPI &kmer, uint32 &count)
 		}
 		sufix_number++;
 	
-		if(sufix_number == total_kmers)
+		if(sufix_number == listing_end)
 			end_of_file = true;
 	}
 	while ((counter_size != 0) && ((count < min_count) || (count > max_count))); //do not applay filtering if counter_size == 0 as it does not make sense
@@ -569,7 +607,7 @@ bool CKMCFile::ReadNextKmer(CKmerAPI &kmer, uint64 &count)
 		}
 		sufix_number++;
 
-		if (sufix_number == total_kmers)
+		if (sufix_number == listing_end)
 			end_of_file = true;
 
 	} while ((counter_size != 0) && ((count < min_count) || (count > max_count))); //do not applay filtering if counter_size == 0 as it does not make sense
@@ -634,7 +672,7 @@ bool CKMCFile::RestartListing(void)
 {
 	if(is_opened == opened_for_listing)
 	{
-		my_fseek(file_suf , 4 , SEEK_SET);
+		my_fseek(file_suf , 4 + listing_begin * sufix_rec_size , SEEK_SET);
 		suf_file_left_to_read = suffix_file_total_to_read;
 		auto to_read = MIN(suf_file_left_to_read, part_size);
 		auto readed = fread(sufix_file_buf, 1, to_read, file_suf);
@@ -646,10 +684,10 @@ bool CKMCFile::RestartListing(void)
 
 		suf_file_left_to_read -= readed;
 		prefix_index = 0;
-		sufix_number = 0;
+		sufix_number = listing_begin;
 		index_in_partial_buf = 0;
 
-		end_of_file = total_kmers == 0;
+		end_of_file = listing_begin == listing_end;
 
 		return true;
 	}
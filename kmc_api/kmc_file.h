@@ -61,16 +61,17 @@ class CKMCFile
 			posInBuf = 0;
 		}
 	public:
-		CPrefixFileBufferForListingMode(FILE* file, uint64_t wholeLutSize, uint64_t lutPrefixLen, bool isKMC1, uint64_t totalKmers)
+		CPrefixFileBufferForListingMode(FILE* file, uint64_t wholeLutSize, uint64_t lutPrefixLen, bool isKMC1, uint64_t totalKmers, uint64_t firstEntry = 0)
 			:
 			buff(new uint64_t[buffCapacity]),
-			leftToRead(wholeLutSize),
+			buffPosInFile(firstEntry),
+			leftToRead(wholeLutSize - firstEntry),
 			prefixMask((1ull << (2 * lutPrefixLen)) - 1),
 			file(file),
 			isKMC1(isKMC1),
 			totalKmers(totalKmers)
 		{
-			my_fseek(file, 4 + 8, SEEK_SET); //	skip KMCP and LUT[0] (always = 0)
+			my_fseek(file, 4 + 8 * (firstEntry + 1), SEEK_SET); //	skip KMCP and LUT[0..firstEntry] (LUT[0] always = 0)
 		}
 
 		//no control if next prefix exists here, responsibility to the caller
@@ -129,6 +130,9 @@ protected:
 	bool both_strands;
 
 	uint32 kmc_version;
+	uint64 lut_size;		// number of LUT entries (all bins for kmc2 databases)
+	uint64 listing_begin;	// first suffix record of the listed range
+	uint64 listing_end;		// one past the last suffix record of the listed range
 	uint32 sufix_size;		// sufix's size in bytes 
 	uint32 sufix_rec_size;  // sufix_size + counter_size
 
@@ -173,6 +177,12 @@ public:
 	// Open files *kmc_pre & *.kmc_suf, read *.kmc_pre to RAM, *.kmc_suf is buffered
 	bool OpenForListing(const std::string& file_name);
 
+	// Open files *kmc_pre & *.kmc_suf for listing only k-mers whose LUT entries are in [lut_begin, lut_end)
+	bool OpenForListing(const std::string& file_name, uint64 lut_begin, uint64 lut_end);
+
+	// Return the number of LUT entries. For kmc1 databases the entry index is the k-mer prefix
+	uint64 LUTSize() const noexcept { return lut_size; }
+
 	// Return true if kmc is in KMC2 compatiblie format
 	bool IsKMC2() const noexcept { return kmc_version == 0x200; }
 
@@ -0,0 +1,34 @@
+#ifndef KMC_PARTITIONS_H
+#define KMC_PARTITIONS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * Split the LUT of a KMC database into (at most) n contiguous, non-empty ranges.
+ * Each range can be listed independently with CKMCFile::OpenForListing(name, begin, end).
+ */
+inline std::vector<std::pair<uint64_t, uint64_t>> lut_partitions(uint64_t lut_size, std::size_t n)
+{
+	std::vector<std::pair<uint64_t, uint64_t>> ranges;
+	n = std::max(std::min(static_cast<uint64_t>(n), lut_size), static_cast<uint64_t>(1));
+	for(std::size_t i = 0; i < n; ++i) ranges.emplace_back(lut_size * i / n, lut_size * (i + 1) / n);
+	return ranges;
+}
+
+/*
+ * Run job(i) for every partition i, one thread each (the calling thread takes partition 0).
+ */
+template <typename F>
+void for_each_partition(std::size_t n, F job)
+{
+	std::vector<std::thread> workers;
+	for(std::size_t i = 1; i < n; ++i) workers.emplace_back(job, i);
+	if(n) job(0);
+	for(auto& worker : workers) worker.join();
+}
+
+#endif/*KMC_PARTITIONS_H*/
@@ -6,6 +6,7 @@
 #include "ketopt.h"
 #include "kseq.h"
 #include "constants.h"
+#include "mmlib.h"
 
 KSEQ_INIT(gzFile, gzread)
 
@@ -21,15 +22,19 @@ enum Error kmers_main(int argc, char *argv[]) {
     FILE* oh;
     long int parsed;
     unsigned char k;
+    unsigned short r;
+    uint64_t seed, kmer, mask, threshold;
 
     fp = NULL;
     oh = NULL;
     seq = NULL;
     k = 0;
+    r = 0;
+    seed = 42;
 
     opt = KETOPT_INIT;
     static ko_longopt_t longopts[] = {{NULL, 0, 0}};
-    while((c = ketopt(&opt, argc, argv, 1, "i:o:k:m:S:h", longopts)) >= 0) {
+    while((c = ketopt(&opt, argc, argv, 1, "i:o:k:m:r:S:h", longopts)) >= 0) {
         if (c == 'i') {
             if ((fp = gzopen(opt.arg, "r")) == NULL) {
                 fprintf(stderr, "Unable to open the input file %s\n", opt.arg);
@@ -49,8 +54,15 @@ enum Error kmers_main(int argc, char *argv[]) {
             k = (unsigned char)parsed;
         } else if (c == 'm') {
             /*silent option that does nothing but is useful to make all comands homegeneous*/
+        } else if (c == 'r') {
+            parsed = strtol(opt.arg, NULL, 10);
+            if (parsed > (unsigned short)-1 || parsed < 0) {
+                fprintf(stderr, "Unable to parse sampling rate\n");
+                return ERR_OUTOFBOUNDS;
+            }
+            r = (unsigned short)parsed;
         } else if (c == 'S') {
-            /*silent option that does nothing but is useful to make all comands homegeneous*/
+            seed = strtoull(opt.arg, NULL, 10);
         } else if (c == 'h') {
             print_kmers_help();
             return NO_ERROR;
@@ -72,13 +84,23 @@ enum Error kmers_main(int argc, char *argv[]) {
     if(oh == NULL) {
         oh = stdout;
     }
+    mask = k < 32 ? (1ULL<<2 * k) - 1 : UINT64_MAX;
+    threshold = frac_threshold(mask, r);
     err = NO_ERROR;
     seq = kseq_init(fp);
     while(kseq_read(seq) >= 0 && err == NO_ERROR) {
+        kmer = 0;
         for(i = j = 0; i < seq->seq.l && err == NO_ERROR; ++i) {
-            if (seq_nt4_table[(unsigned char)seq->seq.s[i]] < 4) ++j;
-            else j = 0;
+            c = seq_nt4_table[(unsigned char)seq->seq.s[i]];
+            if (c < 4) {
+                kmer = (kmer << 2 | c) & mask;/*rolling 2-bit encoding, only meaningful for k <= 32*/
+                ++j;
+            } else j = 0;
             if (j >= k) {
+                if (r > 1) {/*sampling is done before formatting so that rejected k-mers cost one hash only*/
+                    if (k <= 32 && hash64(seed ^ FRAG_SAMPLE_SALT, kmer, mask) > threshold) continue;
+                    if (k > 32 && !frag_sample(&seq->seq.s[i-k+1], k, seed, r)) continue;
+                }
                 fprintf(oh, "%.*s\n", k, &seq->seq.s[i-k+1]);
             }
         }
@@ -93,5 +115,7 @@ void print_kmers_help() {
     fprintf(stderr, "\t-i\tinput fasta file [stdin]\n");
     fprintf(stderr, "\t-o\toutput file [stdout].\n");
     fprintf(stderr, "\t-k\tk-mer (syncmer) size\n");
+    fprintf(stderr, "\t-r\tsampling rate, keep a k-mer if its hash is below max_hash / r [1]\n");
+    fprintf(stderr, "\t-S\tseed used for sampling [42]\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }
@@ -1,7 +1,12 @@
+#include <stdlib.h>
 #include <stdio.h>
 #include "list_main.h"
 #include "ketopt.h"
+#include "constants.h"
 #include "ibflib.h"
+#include "shard.h"
+#include "shard_main.h"
+#include "stats.h"
 
 #include <assert.h>
 
@@ -11,29 +16,38 @@ keysum_len_t binded_len;
 #endif
 
 void print_list_help();
+void print_difflist_help();
 
 void print_whole_bucket(const bucket_t *bucket, char source, void *unused);
-void print_exact_bucket(const bucket_t *bucket, char source, void *unused);
 
 enum Error list_main(int argc, char *argv[]) {
     ketopt_t opt;
     ibf_t ibf;
-    unsigned char sketch_read;
+    ibf_sparse_t sparse_ibf;
+    ibf_counters_t counters;
+    char *ipath, *residual_path;
+    uint8_t sparse, sharded;
+    unsigned int threads;
     int c;
     enum Error err;
 
     opt = KETOPT_INIT;
     err = NO_ERROR;
-    sketch_read = FALSE;
+    ipath = residual_path = NULL;
+    threads = 1;
 
-    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
-    while((c = ketopt(&opt, argc, argv, 1, "i:h", longopts)) >= 0) {
+    static ko_longopt_t longopts[] = {{"hugepages", ko_no_argument, LONGOPT_HUGEPAGES}, {"stats", ko_no_argument, LONGOPT_STATS}, {"residual", ko_required_argument, LONGOPT_RESIDUAL}, {NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:t:h", longopts)) >= 0) {
         if (c == 'i') {
-            sketch_read = TRUE;
-            if ((err = ibf_sketch_load(opt.arg, &ibf)) != NO_ERROR) {
-                fprintf(stderr, "Unable to read the first invertible bloom filter\n");
-                return err;
-            }
+            ipath = opt.arg;
+        } else if (c == 't') {
+            threads = (unsigned int)strtoul(opt.arg, NULL, 10);
+        } else if (c == LONGOPT_HUGEPAGES) {
+            ibf_set_alloc_policy(IBF_ALLOC_HUGEPAGES);
+        } else if (c == LONGOPT_STATS) {
+            stats_enable("list");
+        } else if (c == LONGOPT_RESIDUAL) {
+            residual_path = opt.arg;
         } else if (c == 'h') {
             print_list_help();
             return NO_ERROR;
@@ -42,21 +56,164 @@ enum Error list_main(int argc, char *argv[]) {
             return ERR_OPTION;
         }
     }
-    if(!sketch_read) {
+    if(ipath == NULL) {
         print_list_help();
         return ERR_OPTION;
     }
+    if ((err = sharded_is(ipath, &sharded)) == NO_ERROR && sharded) {/*shards peeled in parallel*/
+        if (residual_path != NULL) {
+            fprintf(stderr, "Option --residual is not available for sharded sketches\n");
+            return ERR_OPTION;
+        }
+        err = sharded_list(ipath, NULL, threads, "list");
+        stats_print(stderr);
+        return err;
+    }
+    if (err != NO_ERROR || (err = ibf_sketch_is_sparse(ipath, &sparse)) != NO_ERROR) {
+        fprintf(stderr, "Unable to read the first invertible bloom filter\n");
+        stats_print(stderr);
+        return err;
+    }
+    stats_begin(STATS_LOAD);
+    if (sparse) err = ibf_sparse_load(ipath, &sparse_ibf);/*sparse difference sketch, peeled without expanding it*/
+    else err = ibf_sketch_load(ipath, &ibf);/*after parsing, so that the allocation policy applies*/
+    stats_end(STATS_LOAD);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "Unable to read the first invertible bloom filter\n");
+        stats_print(stderr);
+        return err;
+    }
+    #ifdef GLEN
+    binded_len = sparse ? sparse_ibf.sketch.key_len : ibf.key_len;
+    #endif
+    stats_begin(STATS_PEEL);
+    #ifdef STORE_WEIGHTS
+    if ((err = sparse ? ibf_sparse_list_counted(&sparse_ibf, &print_counted_bucket, NULL) : ibf_list_counted(&ibf, &print_counted_bucket, NULL)) != NO_ERROR && residual_path == NULL) fprintf(stderr, "Error while peeling the sketch\n");
+    #else
+    if ((err = sparse ? ibf_sparse_list_seq(&sparse_ibf, &print_exact_bucket, NULL) : ibf_list_seq(&ibf, &print_exact_bucket, NULL)) != NO_ERROR && residual_path == NULL) fprintf(stderr, "Error while peeling the sketch\n");
+    #endif
+    stats_end(STATS_PEEL);
+    if (residual_path != NULL && (err == NO_ERROR || err == ERR_VALUE)) {/*the peeled sketch is the IBLT of the keys not listed (its 2-core)*/
+        ibf_counters_get(&counters);
+        stats_begin(STATS_STORE);
+        if ((err = sparse ? ibf_sparse_store(residual_path, &sparse_ibf) : ibf_sketch_store(residual_path, &ibf)) != NO_ERROR) fprintf(stderr, "Error saving the residual sketch\n");
+        stats_end(STATS_STORE);
+        if (err == NO_ERROR) fprintf(stderr, "[list] %llu keys listed, %llu nonzero cells left in the residual sketch %s\n", 
+            (unsigned long long)counters.pure_hits, (unsigned long long)counters.remaining_cells, residual_path);
+    }
+    stats_print(stderr);
+    if (sparse) ibf_sparse_destroy(&sparse_ibf);
+    else ibf_sketch_destroy(&ibf);
+    return err;
+}
+
+/*
+ * diff + list without the difference sketch: the second sketch is subtracted from the first one while being read,
+ * then the first one is peeled. One sketch in memory and no intermediate file.
+ */
+enum Error difflist_main(int argc, char *argv[]) {
+    ketopt_t opt;
+    ibf_t ibf;
+    ibf_counters_t counters;
+    char *ipath, *jpath, *residual_path;
+    uint8_t sharded;
+    unsigned int threads;
+    int c;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    err = NO_ERROR;
+    ipath = jpath = residual_path = NULL;
+    threads = 1;
+
+    static ko_longopt_t longopts[] = {{"hugepages", ko_no_argument, LONGOPT_HUGEPAGES}, {"stats", ko_no_argument, LONGOPT_STATS}, {"residual", ko_required_argument, LONGOPT_RESIDUAL}, {NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:j:t:h", longopts)) >= 0) {
+        if (c == 'i') {
+            ipath = opt.arg;
+        } else if (c == 'j') {
+            jpath = opt.arg;
+        } else if (c == 't') {
+            threads = (unsigned int)strtoul(opt.arg, NULL, 10);
+        } else if (c == LONGOPT_HUGEPAGES) {
+            ibf_set_alloc_policy(IBF_ALLOC_HUGEPAGES);
+        } else if (c == LONGOPT_STATS) {
+            stats_enable("difflist");
+        } else if (c == LONGOPT_RESIDUAL) {
+            residual_path = opt.arg;
+        } else if (c == 'h') {
+            print_difflist_help();
+            return NO_ERROR;
+        } else {
+            fprintf(stderr, "Option -%c not available\n", c);
+            return ERR_OPTION;
+        }
+    }
+    if (ipath == NULL || jpath == NULL) {
+        print_difflist_help();
+        return ERR_OPTION;
+    }
+    if (sharded_is(ipath, &sharded) == NO_ERROR && sharded) {
+        if (residual_path != NULL) {
+            fprintf(stderr, "Option --residual is not available for sharded sketches\n");
+            return ERR_OPTION;
+        }
+        err = sharded_list(ipath, jpath, threads, "difflist");
+        stats_print(stderr);
+        return err;
+    }
+    stats_begin(STATS_LOAD);
+    err = ibf_sketch_load(ipath, &ibf);
+    stats_end(STATS_LOAD);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "Unable to read the first invertible bloom filter\n");
+        stats_print(stderr);
+        return err;
+    }
+    stats_begin(STATS_DIFF);
+    if ((err = ibf_sketch_sub_load(jpath, &ibf)) == ERR_INCOMPATIBLE) fprintf(stderr, "Error while computing the ibf difference\n");
+    else if (err != NO_ERROR) fprintf(stderr, "Unable to read the second invertible bloom filter\n");
+    stats_end(STATS_DIFF);
     #ifdef GLEN
     binded_len = ibf.key_len;
     #endif
-    if ((err = ibf_list_seq(&ibf, &print_exact_bucket, NULL), NULL) != NO_ERROR) fprintf(stderr, "Error while peeling the sketch\n");
+    stats_begin(STATS_PEEL);
+    #ifdef STORE_WEIGHTS
+    if (!err && (err = ibf_list_counted(&ibf, &print_counted_bucket, NULL)) != NO_ERROR && residual_path == NULL) fprintf(stderr, "Error while peeling the sketch\n");
+    #else
+    if (!err && (err = ibf_list_seq(&ibf, &print_exact_bucket, NULL)) != NO_ERROR && residual_path == NULL) fprintf(stderr, "Error while peeling the sketch\n");
+    #endif
+    stats_end(STATS_PEEL);
+    if (residual_path != NULL && (err == NO_ERROR || err == ERR_VALUE)) {
+        ibf_counters_get(&counters);
+        stats_begin(STATS_STORE);
+        if ((err = ibf_sketch_store(residual_path, &ibf)) != NO_ERROR) fprintf(stderr, "Error saving the residual sketch\n");
+        stats_end(STATS_STORE);
+        if (err == NO_ERROR) fprintf(stderr, "[difflist] %llu keys listed, %llu nonzero cells left in the residual sketch %s\n", 
+            (unsigned long long)counters.pure_hits, (unsigned long long)counters.remaining_cells, residual_path);
+    }
+    stats_print(stderr);
     ibf_sketch_destroy(&ibf);
     return err;
 }
 
+void print_difflist_help() {
+    fprintf(stderr, "[difflist] options (list the difference of two sketches, as diff + list):\n");
+    fprintf(stderr, "\t-i\tfirst sketch\n");
+    fprintf(stderr, "\t-j\tsecond sketch, subtracted while being read\n");
+    fprintf(stderr, "\t-t\tnumber of threads, each one subtracting and peeling a shard at a time (sharded sketches) [1]\n");
+    fprintf(stderr, "\t--residual\twrite what could not be peeled (a sketch of the keys not listed) to this file, a partial listing is then not an error\n");
+    fprintf(stderr, "\t--hugepages\tback the sketch with huge pages (explicit if reserved, transparent otherwise)\n");
+    fprintf(stderr, "\t--stats\tprint run statistics (phase times, counters, peak memory) as JSON on stderr\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
+
 void print_list_help() {
     fprintf(stderr, "[list] options:\n");
     fprintf(stderr, "\t-i\tthe sketch to be listed\n");
+    fprintf(stderr, "\t-t\tnumber of threads, each one peeling a shard at a time (sharded sketches) [1]\n");
+    fprintf(stderr, "\t--residual\twrite what could not be peeled (a sketch of the keys not listed) to this file, a partial listing is then not an error\n");
+    fprintf(stderr, "\t--hugepages\tback the sketch with huge pages (explicit if reserved, transparent otherwise)\n");
+    fprintf(stderr, "\t--stats\tprint run statistics (phase times, counters, peak memory) as JSON on stderr\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }
 
@@ -81,7 +238,7 @@ void print_whole_bucket(const bucket_t *bucket, char source, void *unused) {
     fprintf(stdout, "\n");
 }
 
-void print_exact_bucket(const bucket_t *bucket, char source, void *unused) {
+void print_bucket_key(const bucket_t *bucket, FILE *out) {
     keysum_len_t len;
     char sbuf[5];
     unsigned char pack;
@@ -94,7 +251,6 @@ void print_exact_bucket(const bucket_t *bucket, char source, void *unused) {
     #endif
     sbuf[4] = '\0';
     i = 0;
-    fprintf(stdout, "%c,", source);
     while (i < len) {
         pack = bucket->keysum[i/4];
         for (j = 3; j >= 0; --j) {
@@ -106,10 +262,29 @@ void print_exact_bucket(const bucket_t *bucket, char source, void *unused) {
         if(i > len) {
             sbuf[4 - (i - len)] = '\0';
         }
-        fprintf(stdout, "%s", sbuf);
+        fprintf(out, "%s", sbuf);
     }
+}
+
+/*the last argument is the output stream, stdout if NULL*/
+void print_exact_bucket(const bucket_t *bucket, char source, void *stream) {
+    FILE *out;
+    assert(bucket != NULL);
+    out = stream ? (FILE*)stream : stdout;
+    fprintf(out, "%c,", source);
+    print_bucket_key(bucket, out);
     #ifndef RPOS
-    fprintf(stdout, ",%" format_pos, bucket->position);
+    fprintf(out, ",%" format_pos, bucket->position);
     #endif
-    fprintf(stdout, "\n");
+    fprintf(out, "\n");
+}
+
+/*source is 'i' or 'j' for keys in one set only, 'b' if the key is in both sets with different counts (delta = count_i - count_j)*/
+void print_counted_bucket(const bucket_t *bucket, char source, int64_t delta, void *stream) {
+    FILE *out;
+    assert(bucket != NULL);
+    out = stream ? (FILE*)stream : stdout;
+    fprintf(out, "%c,", source);
+    print_bucket_key(bucket, out);
+    fprintf(out, ",%lld\n", (long long)delta);
 }
@@ -2,7 +2,18 @@
 #define LIST_MAIN_H
 
 #include "err.h"
+#include "ibflib.h"
 
 enum Error list_main(int argc, char *argv[]);
 
+enum Error difflist_main(int argc, char *argv[]);
+
+#ifdef GLEN
+extern keysum_len_t binded_len;/*global key length of the keys printed by print_exact_bucket*/
+#endif
+
+void print_exact_bucket(const bucket_t *bucket, char source, void *stream);/*listing callbacks, printing to stream (stdout if NULL)*/
+
+void print_counted_bucket(const bucket_t *bucket, char source, int64_t delta, void *stream);
+
 #endif/*LIST_MAIN_H*/
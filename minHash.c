@@ -17,6 +17,14 @@ int minhash_sketch_init(uint32_t seed, uint64_t s, uint8_t hwidth, minhash_t *co
     sketch->hash_width = CEILING(hwidth, 8);
     byte_size = (s + 1) * sketch->hash_width;
     if((sketch->hashes = (uint8_t*)malloc(byte_size)) == NULL) return ERR_ALLOC; /* +1 is to avoid overflows with memmove */
+    sketch->threshold = UINT64_MAX;
+    sketch->buffered = 0;
+    sketch->buffer = NULL;
+    if (sketch->hash_width <= 8 && (sketch->buffer = (uint64_t*)malloc((2 * s + 1) * sizeof *sketch->buffer)) == NULL) {
+        free(sketch->hashes);
+        sketch->hashes = NULL;
+        return ERR_ALLOC;
+    }
     return NO_ERROR;
 }
 
@@ -51,6 +59,9 @@ int minhash_sketch_from_stream(FILE* istrm, minhash_t *const sketch) {
     if (fread(&sketch->seed, sizeof sketch->seed, 1, istrm) != 1) return ERR_IO;
     if (fread(&sketch->size, sizeof sketch->size, 1, istrm) != 1) return ERR_IO;
     if (fread(&sketch->hash_width, sizeof sketch->hash_width, 1, istrm) != 1) return ERR_IO;
+    sketch->threshold = UINT64_MAX;
+    sketch->buffered = 0;
+    sketch->buffer = NULL;
     sketch->seed = ntoh32(sketch->seed);
     sketch->size = hton64(sketch->size);
     if ((sketch->hashes = malloc(sketch->hash_width * sketch->size)) == NULL) return ERR_ALLOC;
@@ -94,13 +105,48 @@ int minhash_print(FILE* out, minhash_t const * const sketch) {
     return NO_ERROR;
 }
 
+static int cmp_uint64(void const *a, void const *b) {
+    uint64_t x = *(uint64_t const*)a;
+    uint64_t y = *(uint64_t const*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sort and deduplicate the candidates of a bottom-k sketch, keeping the s smallest ones.
+ * Once s distinct values are known, the largest one becomes the rejection threshold.
+ */
+static void bottomk_compact(uint64_t s, minhash_t *const sketch) {
+    uint64_t i, j;
+    qsort(sketch->buffer, sketch->buffered, sizeof *sketch->buffer, cmp_uint64);
+    for(i = j = 0; i < sketch->buffered && j < s; ++i) {
+        if (j == 0 || sketch->buffer[i] != sketch->buffer[j-1]) sketch->buffer[j++] = sketch->buffer[i];
+    }
+    sketch->buffered = j;
+    if (j == s && s > 0) sketch->threshold = sketch->buffer[s-1];
+}
+
+/*
+ * Insert a k-mer into a minHash sketch.
+ *
+ * When hash_width <= 8 hashes are handled as native (big-endian ordered) integers: a candidate
+ * is rejected in O(1) if not smaller than the current threshold, otherwise it is appended to a 2s buffer
+ * which is compacted when full. The sketch is materialised (sorted) by minhash_sketch_finalize.
+ * Larger widths use the sorted byte array directly.
+ */
 int minhash_sketch_insert(char const *const kmer, uint8_t k, uint64_t s, minhash_t *const sketch) {
-    uint64_t i;
+    uint64_t i, value;
     int cmp;
     uint8_t buffer[16];
     assert(kmer);
     assert(sketch);
     MurmurHash3_x64_128(kmer, k, sketch->seed, buffer);
+    if (sketch->buffer) {
+        for(i = 0, value = 0; i < sketch->hash_width; ++i) value = value << 8 | buffer[i];/* same order as memcmp */
+        if (value >= sketch->threshold) return NO_ERROR;
+        sketch->buffer[sketch->buffered++] = value;
+        if (sketch->buffered >= 2 * s) bottomk_compact(s, sketch);
+        return NO_ERROR;
+    }
     // fprintf(stderr, "%.*s = ", (int)k, kmer);
     // print_hex(buffer, 16);
     // fprintf(stderr, "\n");
@@ -124,6 +170,22 @@ int minhash_sketch_insert(char const *const kmer, uint8_t k, uint64_t s, minhash
     return NO_ERROR;
 }
 
+int minhash_sketch_finalize(uint64_t s, minhash_t *const sketch) {
+    uint64_t i, j;
+    assert(sketch);
+    if (sketch->buffer) {
+        bottomk_compact(s, sketch);
+        for(i = 0; i < sketch->buffered; ++i) {
+            for(j = 0; j < sketch->hash_width; ++j) 
+                ((uint8_t*)at(sketch, i))[j] = (uint8_t)(sketch->buffer[i] >> (8 * (sketch->hash_width - 1 - j)));
+        }
+        sketch->size = sketch->buffered;
+        free(sketch->buffer);
+        sketch->buffer = NULL;
+    }
+    return NO_ERROR;
+}
+
 int minhash_compare(minhash_t const *const s1, minhash_t const *const s2, double *jaccard) {
     uint64_t num, den, s;
     uint64_t i, j;
@@ -153,5 +215,9 @@ int minhash_sketch_destroy(minhash_t *const sketch) {
         free(sketch->hashes);
         sketch->hashes = NULL;
     }
+    if (sketch->buffer) {
+        free(sketch->buffer);
+        sketch->buffer = NULL;
+    }
     return NO_ERROR;
 }
@@ -8,6 +8,9 @@ typedef struct {
     uint64_t size;
     uint8_t hash_width;
     uint8_t *hashes;
+    uint64_t threshold; /* bottom-k construction only: candidates >= threshold cannot enter the sketch */
+    uint64_t buffered;  /* bottom-k construction only: number of candidates inside buffer */
+    uint64_t *buffer;   /* bottom-k construction only: native integer candidates (NULL if hash_width > 8) */
 } minhash_t;
 
 int minhash_sketch_init(uint32_t seed, uint64_t s, uint8_t hwidth, minhash_t *const sketch);
@@ -24,6 +27,8 @@ int minhash_print(FILE* out, minhash_t const * const sketch);
 
 int minhash_sketch_insert(char const *const kmer, uint8_t k, uint64_t s, minhash_t *const sketch);
 
+int minhash_sketch_finalize(uint64_t s, minhash_t *const sketch);
+
 int minhash_compare(minhash_t const *const s1, minhash_t const *const s2, double *jaccard);
 
 int minhash_sketch_destroy(minhash_t *const sketch);
@@ -26,7 +26,7 @@ enum Error minimizers_main(int argc, char *argv[]) {
     unsigned int i, j, mflen, buflen, delta;
     long int parsed;
     unsigned char k, m;
-    unsigned short w;
+    unsigned short w, r;
     unsigned char segmentation, split;/*, canonical;*/
     char* buffer;
     uint32_v_t mmpos;
@@ -38,6 +38,7 @@ enum Error minimizers_main(int argc, char *argv[]) {
     k = 0;
     m = 0;
     w = 0;
+    r = 0;
     segmentation = 255;
     /*canonical = FALSE;*/
     split = FALSE;
@@ -47,7 +48,7 @@ enum Error minimizers_main(int argc, char *argv[]) {
 
     opt = KETOPT_INIT;
     static ko_longopt_t longopts[] = {{NULL, 0, 0}};
-    while((c = ketopt(&opt, argc, argv, 1, "i:o:k:m:w:S:sh", longopts)) >= 0) {
+    while((c = ketopt(&opt, argc, argv, 1, "i:o:k:m:w:r:S:sh", longopts)) >= 0) {
         if (c == 'i') {
             if ((fp = gzopen(opt.arg, "r")) == NULL) {
                 fprintf(stderr, "Unable to open the input file %s\n", opt.arg);
@@ -85,6 +86,13 @@ enum Error minimizers_main(int argc, char *argv[]) {
                 return ERR_OUTOFBOUNDS;
             }
             w = (unsigned short)parsed;
+        } else if (c == 'r') {
+            parsed = strtol(opt.arg, NULL, 10);
+            if (parsed > (unsigned short)-1 || parsed < 0) {
+                fprintf(stderr, "Unable to parse sampling rate\n");
+                return ERR_OUTOFBOUNDS;
+            }
+            r = (unsigned short)parsed;
         } else if (c == 'S') {
             seed = strtoull(opt.arg, NULL, 10);
         } else if (c == 'c') {
@@ -134,7 +142,7 @@ enum Error minimizers_main(int argc, char *argv[]) {
             if ((err = mm_get_pos(seq->seq.s, seq->seq.l, k, w, seed, &mmpos)) != NO_ERROR) 
                 fprintf(stderr, "Error when computing minimizer positions for record: %.*s\n", (int)seq->name.l, seq->name.s);
             for(i = 0; i < mmpos.n && err == NO_ERROR; ++i) {
-                fprintf(oh, "%.*s\n", k, &seq->seq.s[mmpos.a[i]]);
+                print_fragment(oh, &seq->seq.s[mmpos.a[i]], k, seed, r);
             }
         } else {
             if ((err = mm_get_pos(seq->seq.s, seq->seq.l, m, k-m+1, seed, &mmpos)) != NO_ERROR) 
@@ -144,28 +152,28 @@ enum Error minimizers_main(int argc, char *argv[]) {
                 /*fprintf(stderr, "%u\n", mmpos.a[i]);*/
                 if (segmentation) {
                     delta = mmpos.a[i] - j;
-                    if (delta <= k) fprintf(oh, "%.*s\n", delta, &seq->seq.s[j]);
+                    if (delta <= k) print_fragment(oh, &seq->seq.s[j], delta, seed, r);
                 } else {/*splitted or grouped syncmers*/
                     if (mmpos.a[i] < (k - m)) {/*first mm positions, pad with A's*/
                         memset(buffer, 'A', buflen);/*buffer is always 2*k-m long*/
                         memcpy(&buffer[k - m - mmpos.a[i]], seq->seq.s, k + mmpos.a[i]);
-                        if (split) fprintf(oh, "%.*s\n", mflen, buffer + k-m);
-                        fprintf(oh, "%.*s\n", mflen, buffer);
+                        if (split) print_fragment(oh, buffer + k-m, mflen, seed, r);
+                        print_fragment(oh, buffer, mflen, seed, r);
                     } else if (seq->seq.l - mmpos.a[i] < k) {/*last positions closer than k to the end*/
                         memset(buffer, 'A', buflen);
                         memcpy(buffer, &seq->seq.s[mmpos.a[i]-k+m], seq->seq.l - mmpos.a[i]+k-m);// - mmpos.a[i]);
-                        if (split) fprintf(oh, "%.*s\n", mflen, buffer +k-m);
-                        fprintf(oh, "%.*s\n", mflen, buffer);
+                        if (split) print_fragment(oh, buffer +k-m, mflen, seed, r);
+                        print_fragment(oh, buffer, mflen, seed, r);
                     } else {/*padding not needed here*/
-                        if (split) fprintf(oh, "%.*s\n", mflen, &seq->seq.s[mmpos.a[i]]);
-                        fprintf(oh, "%.*s\n", mflen, &seq->seq.s[mmpos.a[i]-k+m]);
+                        if (split) print_fragment(oh, &seq->seq.s[mmpos.a[i]], mflen, seed, r);
+                        print_fragment(oh, &seq->seq.s[mmpos.a[i]-k+m], mflen, seed, r);
                     }
                 }
                 j = mmpos.a[i];
             }
             if (segmentation) { /*Add last segment, if needed*/
                 delta = seq->seq.l - j;
-                if (delta <= k) fprintf(oh, "%.*s\n", (int)(delta), &seq->seq.s[j]);
+                if (delta <= k) print_fragment(oh, &seq->seq.s[j], (int)(delta), seed, r);
             }/*
             } else {
                 memset(buffer, 'A', 2*k - m);
@@ -190,6 +198,7 @@ void print_minimizers_help() {
     fprintf(stderr, "\t-m\tminimizer size for grouping [k]. \n\t\tm > 0 output [p-(k-m):p+k] bases for each minimizer at position p.\n\t\tm < 0 fragments the input sequence at minimizer positions, disables option <s>\n");
     fprintf(stderr, "\t-s\tsplit each group of k-mers into its constituent syncmers <inactive>\n");
     fprintf(stderr, "\t-w\twindow length for indexing (number of k-mers), disables option <s>, incompatible with option <m>\n");
-    fprintf(stderr, "\t-S\tseed [42]\n");
+    fprintf(stderr, "\t-r\tsampling rate, keep a fragment if its hash is below max_hash / r [1]\n");
+    fprintf(stderr, "\t-S\tseed (also used for sampling) [42]\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }
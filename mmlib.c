@@ -4,6 +4,7 @@
 #include "mmlib.h"
 #include "compile_options.h"
 #include "constants.h"
+#include "murmur3.h"
 
 /*#include <stdio.h>*/
 #include <assert.h>
@@ -202,3 +203,49 @@ int sync_get_pos_pool(void *km, const char *seq, size_t slen, uint8_t k, uint8_t
 int sync_get_pos(const char *seq, size_t slen, uint8_t k, uint8_t s, uint64_t seed, uint32_v_t *sync_pos) {
 	return sync_get_pos_pool(NULL, seq, slen, k, s, seed, sync_pos);
 }
+
+/**
+ * Hash a fragment for sampling purposes
+ *
+ * Fragments of at most 32 bases made of {A,C,G,T} only are 2-bit packed (same encoding as the rolling k-mer
+ * of the fragmenters) and hashed with hash64, everything else falls back to MurmurHash3 on the raw string.
+ *
+ * @param hval     hash value of the fragment
+ * @param max_hash largest value the hash function can return (to be used with frac_threshold)
+ */
+int frag_hash(const char *seq, size_t len, uint64_t seed, uint64_t *hval, uint64_t *max_hash)
+{
+	size_t i;
+	uint64_t packed, mask;
+	uint64_t buffer[2];
+	int c;
+	assert(seq != NULL);
+	assert(hval != NULL);
+	assert(max_hash != NULL);
+	if (len <= 32) {
+		for(i = 0, packed = 0; i < len && (c = seq_nt4_table[(uint8_t)seq[i]]) < 4; ++i) packed = packed << 2 | c;
+		if (i == len) {
+			mask = len == 32 ? UINT64_MAX : (1ULL<<2 * len) - 1;
+			*hval = hash64(seed, packed, mask);
+			*max_hash = mask;
+			return NO_ERROR;
+		}
+	}
+	MurmurHash3_x64_128(seq, (int)len, (uint32_t)seed, buffer);
+	*hval = buffer[0];
+	*max_hash = UINT64_MAX;
+	return NO_ERROR;
+}
+
+int frag_sample(const char *seq, size_t len, uint64_t seed, uint16_t rate)
+{
+	uint64_t hval, max_hash;
+	if (rate <= 1) return TRUE;
+	frag_hash(seq, len, seed ^ FRAG_SAMPLE_SALT, &hval, &max_hash);
+	return hval <= frac_threshold(max_hash, rate);
+}
+
+void print_fragment(FILE *oh, const char *fragment, int len, uint64_t seed, uint16_t rate)
+{
+	if (rate <= 1 || frag_sample(fragment, len, seed, rate)) fprintf(oh, "%.*s\n", len, fragment);
+}
@@ -2,6 +2,7 @@
 #define MMLIB_H
 
 #include <stddef.h>
+#include <stdio.h>
 #include <inttypes.h>
 
 #define HEADMASK 0x80000000
@@ -30,6 +31,25 @@ static inline uint64_t hash64(uint64_t seed, uint64_t key, uint64_t mask)
 	return key;
 }
 
+/*
+FracMinHash-style sampling: a fragment is kept iff its hash is not greater than max_hash / rate,
+so that roughly one fragment out of rate survives and rejected ones are never written out.
+The sampling hash is salted: minimizers are selected by low hash64 values of the same seed,
+and an unsalted threshold would keep the smallest of them instead of one out of rate.
+*/
+#define FRAG_SAMPLE_SALT 0x85ebca6b
+
+static inline uint64_t frac_threshold(uint64_t max_hash, uint16_t rate)
+{
+	return rate ? max_hash / rate : max_hash;
+}
+
+int frag_hash(const char *seq, size_t len, uint64_t seed, uint64_t *hval, uint64_t *max_hash);
+
+int frag_sample(const char *seq, size_t len, uint64_t seed, uint16_t rate);
+
+void print_fragment(FILE *oh, const char *fragment, int len, uint64_t seed, uint16_t rate);/*prints fragment if sampled*/
+
 int mm_get_pos_pool(void *km, const char *seq, size_t slen, uint8_t m, uint16_t w, uint64_t seed, uint32_v_t *mm_pos);
 
 int mm_get_pos(const char *seq, size_t slen, uint8_t m, uint16_t w, uint64_t seed, uint32_v_t *mm_pos);
@@ -0,0 +1,357 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rateless.h"
+#include "murmur3.h"
+#include "err.h"
+#include "endian_fixer.h"
+
+#include <assert.h>
+
+#define RATELESS_MAGIC 0x52
+#define RATELESS_MULTIPLIER 0xda942042e4dd58b5ULL
+
+static uint64_t rateless_checksum(uint8_t const *const keysum, uint64_t key_len, uint32_t seed) {
+	hash_t hash;
+	MurmurHash3_x64_128(keysum, WSIZE, seed + (uint32_t)key_len, (void*)&hash);/*the length is part of the key when it is not global*/
+	return hash.ls64b;
+}
+
+/*
+ * Next symbol of a key: the gap after symbol i is about (i + 1.5) * (1 / sqrt(u) - 1) for u uniform in (0, 1],
+ * so that a key falls in symbol i with probability ~ 1 / (1 + i / 2).
+ */
+static void rateless_key_advance(rateless_key_t *const key) {
+	double gap;
+	key->prng *= RATELESS_MULTIPLIER;
+	gap = ceil(((double)key->next + 1.5) * (4294967296.0 / sqrt((double)key->prng + 1) - 1));
+	if (gap >= (double)(UINT64_MAX - key->next)) key->next = UINT64_MAX;/*never reached*/
+	else key->next += (uint64_t)gap;
+}
+
+static void rateless_key_reset(rateless_key_t *const key) {
+	key->prng = key->checksum;
+	key->next = 0;
+}
+
+static void rateless_symbol_apply(rateless_symbol_t *const symbol, rateless_key_t const *const key, int8_t side) {
+	uint64_t i;
+	symbol->count += side;
+	symbol->checksum ^= key->checksum;
+	for(i = 0; i < WSIZE; ++i) symbol->keysum[i] ^= key->keysum[i];
+	#ifndef GLEN
+	symbol->key_len ^= key->key_len;
+	#endif
+}
+
+int rateless_encoder_init(uint32_t seed, rateless_encoder_t *const encoder) {
+	assert(encoder != NULL);
+	encoder->seed = seed;
+	#ifdef GLEN
+	encoder->key_len = 0;
+	#endif
+	encoder->n = encoder->capacity = encoder->position = 0;
+	encoder->keys = NULL;
+	return NO_ERROR;
+}
+
+int rateless_encoder_add(char const *const seq, unsigned int start, unsigned int end, rateless_encoder_t *const encoder) {
+	rateless_key_t *key;
+	void *dummy;
+	assert(seq != NULL);
+	assert(start <= end);
+	assert(encoder != NULL);
+	if (encoder->n == encoder->capacity) {
+		encoder->capacity = encoder->capacity ? 2 * encoder->capacity : 1024;
+		if ((dummy = realloc(encoder->keys, encoder->capacity * sizeof(rateless_key_t))) == NULL) return ERR_ALLOC;
+		encoder->keys = (rateless_key_t*)dummy;
+	}
+	key = &encoder->keys[encoder->n];
+	memset(key->keysum, 0, WSIZE);
+#if defined(STORE_SEQUENCES) || defined(STORE_VLSEQUENCES) || defined(STORE_FRAGMENTS)
+	if (end - start > 4 * WSIZE) return ERR_OUTOFBOUNDS;
+	if (pack2bit(&seq[start], end - start, key->keysum) != NO_ERROR) return NO_ERROR;/*skip fragments with a base not in {A,C,G,T}*/
+#elif defined(STORE_HASHES)
+	if (end - start > WSIZE) return ERR_OUTOFBOUNDS;
+	memcpy(key->keysum, &seq[start], end - start);
+#endif
+	#ifdef GLEN
+	if (encoder->key_len < end - start) encoder->key_len = end - start;
+	key->checksum = rateless_checksum(key->keysum, 0, encoder->seed);
+	#else
+	key->key_len = (keysum_len_t)(end - start);
+	key->checksum = rateless_checksum(key->keysum, key->key_len, encoder->seed);
+	#endif
+	rateless_key_reset(key);
+	++encoder->n;
+	encoder->position = (uint64_t)-1;/*new keys start from symbol 0*/
+	return NO_ERROR;
+}
+
+int rateless_encoder_symbols(rateless_encoder_t *const encoder, uint64_t first, uint64_t count, rateless_symbol_t *const symbols) {
+	uint64_t i, last;
+	rateless_key_t *key;
+	assert(encoder != NULL);
+	assert(symbols != NULL);
+	memset(symbols, 0, count * sizeof(rateless_symbol_t));
+	if (first < encoder->position && encoder->position != 0) for(i = 0; i < encoder->n; ++i) rateless_key_reset(&encoder->keys[i]);
+	last = first + count;
+	for(i = 0; i < encoder->n; ++i) {
+		key = &encoder->keys[i];
+		for(; key->next < last; rateless_key_advance(key)) if (key->next >= first) rateless_symbol_apply(&symbols[key->next - first], key, 1);
+	}
+	encoder->position = last;
+	return NO_ERROR;
+}
+
+void rateless_encoder_destroy(rateless_encoder_t *const encoder) {
+	assert(encoder != NULL);
+	if (encoder->keys) free(encoder->keys);
+	encoder->keys = NULL;
+	encoder->n = encoder->capacity = 0;
+}
+
+int rateless_decoder_init(uint32_t seed, rateless_decoder_t *const decoder) {
+	assert(decoder != NULL);
+	memset(decoder, 0, sizeof *decoder);
+	decoder->seed = seed;
+	return NO_ERROR;
+}
+
+static void rateless_heap_sift_up(rateless_decoder_t *const decoder, uint64_t i) {
+	uint64_t parent, tmp;
+	for(; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (decoder->keys[decoder->heap[parent]].next <= decoder->keys[decoder->heap[i]].next) break;
+		tmp = decoder->heap[parent];
+		decoder->heap[parent] = decoder->heap[i];
+		decoder->heap[i] = tmp;
+	}
+}
+
+static void rateless_heap_sift_down(rateless_decoder_t *const decoder, uint64_t i) {
+	uint64_t child, tmp;
+	for(; (child = 2 * i + 1) < decoder->n; i = child) {
+		if (child + 1 < decoder->n && decoder->keys[decoder->heap[child + 1]].next < decoder->keys[decoder->heap[child]].next) ++child;
+		if (decoder->keys[decoder->heap[i]].next <= decoder->keys[decoder->heap[child]].next) break;
+		tmp = decoder->heap[child];
+		decoder->heap[child] = decoder->heap[i];
+		decoder->heap[i] = tmp;
+	}
+}
+
+static int rateless_pending_push(rateless_decoder_t *const decoder, uint64_t i) {
+	void *dummy;
+	if (decoder->pending_size == decoder->pending_capacity) {
+		decoder->pending_capacity = decoder->pending_capacity ? 2 * decoder->pending_capacity : 1024;
+		if ((dummy = realloc(decoder->pending, decoder->pending_capacity * sizeof(uint64_t))) == NULL) return ERR_ALLOC;
+		decoder->pending = (uint64_t*)dummy;
+	}
+	decoder->pending[decoder->pending_size++] = i;
+	return NO_ERROR;
+}
+
+/*a pure symbol holds a single key (count +-1 and checksum matching the keysum)*/
+static int rateless_symbol_pure(rateless_decoder_t const *const decoder, rateless_symbol_t const *const symbol) {
+	if (symbol->count != 1 && symbol->count != -1) return FALSE;
+	#ifdef GLEN
+	return symbol->checksum == rateless_checksum(symbol->keysum, 0, decoder->seed);
+	#else
+	return symbol->checksum == rateless_checksum(symbol->keysum, symbol->key_len, decoder->seed);
+	#endif
+}
+
+/*recover the key of a pure symbol and remove it from all the symbols received so far*/
+static int rateless_decoder_recover(rateless_decoder_t *const decoder, rateless_symbol_t const *const symbol) {
+	int err;
+	void *dummy;
+	rateless_key_t *key;
+	int8_t side;
+	if (decoder->n == decoder->key_capacity) {
+		decoder->key_capacity = decoder->key_capacity ? 2 * decoder->key_capacity : 1024;
+		if ((dummy = realloc(decoder->keys, decoder->key_capacity * sizeof(rateless_key_t))) == NULL) return ERR_ALLOC;
+		decoder->keys = (rateless_key_t*)dummy;
+		if ((dummy = realloc(decoder->sides, decoder->key_capacity * sizeof(int8_t))) == NULL) return ERR_ALLOC;
+		decoder->sides = (int8_t*)dummy;
+		if ((dummy = realloc(decoder->heap, decoder->key_capacity * sizeof(uint64_t))) == NULL) return ERR_ALLOC;
+		decoder->heap = (uint64_t*)dummy;
+	}
+	key = &decoder->keys[decoder->n];
+	side = (int8_t)symbol->count;
+	memcpy(key->keysum, symbol->keysum, WSIZE);
+	#ifndef GLEN
+	key->key_len = symbol->key_len;
+	#endif
+	key->checksum = symbol->checksum;
+	for(rateless_key_reset(key); key->next < decoder->m; rateless_key_advance(key)) {
+		rateless_symbol_apply(&decoder->symbols[key->next], key, -side);
+		if ((err = rateless_pending_push(decoder, key->next)) != NO_ERROR) return err;
+	}
+	decoder->sides[decoder->n] = side;
+	decoder->heap[decoder->n] = decoder->n;
+	++decoder->n;
+	rateless_heap_sift_up(decoder, decoder->n - 1);
+	return NO_ERROR;
+}
+
+int rateless_decoder_add(rateless_decoder_t *const decoder, rateless_symbol_t const *const symbol) {
+	int err;
+	void *dummy;
+	uint64_t i;
+	rateless_key_t *key;
+	rateless_symbol_t *current;
+	assert(decoder != NULL);
+	assert(symbol != NULL);
+	if (decoder->m == decoder->capacity) {
+		decoder->capacity = decoder->capacity ? 2 * decoder->capacity : 1024;
+		if ((dummy = realloc(decoder->symbols, decoder->capacity * sizeof(rateless_symbol_t))) == NULL) return ERR_ALLOC;
+		decoder->symbols = (rateless_symbol_t*)dummy;
+	}
+	current = &decoder->symbols[decoder->m];
+	memcpy(current, symbol, sizeof *current);
+	while (decoder->n > 0 && (key = &decoder->keys[decoder->heap[0]])->next == decoder->m) {/*keys already recovered falling in the new symbol*/
+		rateless_symbol_apply(current, key, -decoder->sides[decoder->heap[0]]);
+		rateless_key_advance(key);
+		rateless_heap_sift_down(decoder, 0);
+	}
+	i = decoder->m++;
+	if ((err = rateless_pending_push(decoder, i)) != NO_ERROR) return err;
+	while (decoder->pending_size > 0) {
+		i = decoder->pending[--decoder->pending_size];
+		if (rateless_symbol_pure(decoder, &decoder->symbols[i]) && (err = rateless_decoder_recover(decoder, &decoder->symbols[i])) != NO_ERROR) return err;
+	}
+	return NO_ERROR;
+}
+
+int rateless_decoder_done(rateless_decoder_t const *const decoder) {
+	uint64_t i;
+	rateless_symbol_t const *first;
+	assert(decoder != NULL);
+	if (decoder->m == 0) return FALSE;
+	first = &decoder->symbols[0];/*every key falls in symbol 0*/
+	if (first->count != 0 || first->checksum != 0) return FALSE;
+	for(i = 0; i < WSIZE; ++i) if (first->keysum[i] != 0) return FALSE;
+	return TRUE;
+}
+
+void rateless_decoder_destroy(rateless_decoder_t *const decoder) {
+	assert(decoder != NULL);
+	if (decoder->symbols) free(decoder->symbols);
+	if (decoder->keys) free(decoder->keys);
+	if (decoder->sides) free(decoder->sides);
+	if (decoder->heap) free(decoder->heap);
+	if (decoder->pending) free(decoder->pending);
+	memset(decoder, 0, sizeof *decoder);
+}
+
+void rateless_symbol_sub(rateless_symbol_t *const a, rateless_symbol_t const *const b) {
+	uint64_t i;
+	assert(a != NULL);
+	assert(b != NULL);
+	a->count -= b->count;
+	a->checksum ^= b->checksum;
+	for(i = 0; i < WSIZE; ++i) a->keysum[i] ^= b->keysum[i];
+	#ifndef GLEN
+	a->key_len ^= b->key_len;
+	#endif
+}
+
+void rateless_key_bucket(rateless_key_t const *const key, int8_t side, bucket_t *const bucket) {
+	assert(key != NULL);
+	assert(bucket != NULL);
+	memset(bucket, 0, sizeof *bucket);
+	bucket->counter = side;
+	memcpy(bucket->keysum, key->keysum, WSIZE);
+	#ifdef STORE_WEIGHTS
+	bucket->weight = side;
+	#endif
+	#ifndef GLEN
+	bucket->key_len = key->key_len;
+	#endif
+}
+
+int rateless_chunk_header_store(FILE *const out, uint32_t seed, uint64_t first, uint64_t count, uint64_t key_len) {
+	uint8_t magic;
+	uint32_t buffer32;
+	uint64_t buffer64;
+	#ifdef GLEN
+	keysum_len_t buffer_len;
+	#endif
+	assert(out != NULL);
+	magic = RATELESS_MAGIC;
+	if (fwrite(&magic, sizeof magic, 1, out) != 1) return ERR_IO;
+	buffer32 = hton32((uint32_t)WSIZE);
+	if (fwrite(&buffer32, sizeof buffer32, 1, out) != 1) return ERR_IO;
+	buffer32 = hton32(seed);
+	if (fwrite(&buffer32, sizeof buffer32, 1, out) != 1) return ERR_IO;
+	buffer64 = hton64(first);
+	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	buffer64 = hton64(count);
+	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	#ifdef GLEN
+	buffer_len = hton_len((keysum_len_t)key_len);
+	if (fwrite(&buffer_len, sizeof buffer_len, 1, out) != 1) return ERR_IO;
+	#endif
+	return NO_ERROR;
+}
+
+int rateless_chunk_header_load(FILE *const in, uint32_t *const seed, uint64_t *const first, uint64_t *const count, uint64_t *const key_len) {
+	uint8_t magic;
+	uint32_t buffer32;
+	#ifdef GLEN
+	keysum_len_t buffer_len;
+	#endif
+	assert(in != NULL);
+	if (fread(&magic, sizeof magic, 1, in) != 1) return feof(in) ? ERR_OUTOFBOUNDS : ERR_IO;/*end of the stream*/
+	if (magic != RATELESS_MAGIC) return ERR_INCOMPATIBLE;
+	if (fread(&buffer32, sizeof buffer32, 1, in) != 1) return ERR_IO;
+	if (ntoh32(buffer32) != WSIZE) return ERR_INCOMPATIBLE;
+	if (fread(&buffer32, sizeof buffer32, 1, in) != 1) return ERR_IO;
+	*seed = ntoh32(buffer32);
+	if (fread(first, sizeof *first, 1, in) != 1) return ERR_IO;
+	*first = ntoh64(*first);
+	if (fread(count, sizeof *count, 1, in) != 1) return ERR_IO;
+	*count = ntoh64(*count);
+	*key_len = 0;
+	#ifdef GLEN
+	if (fread(&buffer_len, sizeof buffer_len, 1, in) != 1) return ERR_IO;
+	*key_len = ntoh_len(buffer_len);
+	#endif
+	return NO_ERROR;
+}
+
+int rateless_symbol_store(FILE *const out, rateless_symbol_t const *const symbol) {
+	uint64_t buffer64;
+	#ifndef GLEN
+	keysum_len_t buffer_len;
+	#endif
+	assert(out != NULL);
+	assert(symbol != NULL);
+	buffer64 = hton64((uint64_t)symbol->count);
+	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	buffer64 = hton64(symbol->checksum);
+	if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	if (fwrite(symbol->keysum, sizeof(uint8_t), WSIZE, out) != WSIZE) return ERR_IO;
+	#ifndef GLEN
+	buffer_len = hton_len(symbol->key_len);
+	if (fwrite(&buffer_len, sizeof buffer_len, 1, out) != 1) return ERR_IO;
+	#endif
+	return NO_ERROR;
+}
+
+int rateless_symbol_load(FILE *const in, rateless_symbol_t *const symbol) {
+	uint64_t buffer64;
+	assert(in != NULL);
+	assert(symbol != NULL);
+	if (fread(&buffer64, sizeof buffer64, 1, in) != 1) return feof(in) ? ERR_OUTOFBOUNDS : ERR_IO;/*end of the stream*/
+	symbol->count = (int64_t)ntoh64(buffer64);
+	if (fread(&buffer64, sizeof buffer64, 1, in) != 1) return ERR_IO;
+	symbol->checksum = ntoh64(buffer64);
+	if (fread(symbol->keysum, sizeof(uint8_t), WSIZE, in) != WSIZE) return ERR_IO;
+	#ifndef GLEN
+	if (fread(&symbol->key_len, sizeof symbol->key_len, 1, in) != 1) return ERR_IO;
+	symbol->key_len = ntoh_len(symbol->key_len);
+	#endif
+	return NO_ERROR;
+}
@@ -0,0 +1,93 @@
+#ifndef RATELESS_H
+#define RATELESS_H
+
+#include <stdio.h>
+#include "constants.h"
+#include "ibflib.h"
+
+/*
+ * Rateless IBLTs (Yang, Gilad, Alizadeh, "Practical Rateless Set Reconciliation", SIGCOMM 2024).
+ * A set is encoded as an unbounded sequence of coded symbols: a key is added to symbol 0 and then to symbols
+ * whose gaps grow with their index, so that the density of the i-th symbol is about 1 / (1 + i / 2).
+ * Any prefix of the difference of two sequences can be peeled, and about 1.35 to 1.7 symbols per difference are
+ * enough whatever the size of the sets: the sender keeps sending symbols until the receiver has decoded.
+ */
+
+typedef struct {
+	int64_t count;/* number of keys of the first set minus those of the second one */
+	uint64_t checksum;/* XOR of the hashes of the keys, used to check purity */
+	uint8_t keysum[WSIZE];
+	#ifndef GLEN
+	keysum_len_t key_len;
+	#endif
+} rateless_symbol_t;
+
+typedef struct {
+	uint64_t checksum;/* hash of the key, also seeding its sequence of symbols */
+	uint64_t prng;
+	uint64_t next;/* next symbol the key is added to */
+	uint8_t keysum[WSIZE];
+	#ifndef GLEN
+	keysum_len_t key_len;
+	#endif
+} rateless_key_t;
+
+typedef struct {
+	uint32_t seed;
+	#ifdef GLEN
+	keysum_len_t key_len;
+	#endif
+	uint64_t n;
+	uint64_t capacity;
+	rateless_key_t *keys;
+	uint64_t position;/* first symbol not yet produced */
+} rateless_encoder_t;
+
+typedef struct {
+	uint32_t seed;
+	uint64_t m;/* number of symbols received */
+	uint64_t capacity;
+	rateless_symbol_t *symbols;/* difference of the symbols received */
+	uint64_t n;/* recovered keys */
+	uint64_t key_capacity;
+	rateless_key_t *keys;
+	int8_t *sides;/* +1: key of the first set only, -1: key of the second set only */
+	uint64_t *heap;/* recovered keys by their next symbol (min-heap) */
+	uint64_t *pending;/* symbols to be checked for purity */
+	uint64_t pending_size, pending_capacity;
+} rateless_decoder_t;
+
+int rateless_encoder_init(uint32_t seed, rateless_encoder_t *const encoder);
+
+int rateless_encoder_add(char const *const seq, unsigned int start, unsigned int end, rateless_encoder_t *const encoder);/*keys with a base not in {A,C,G,T} are skipped*/
+
+int rateless_encoder_symbols(rateless_encoder_t *const encoder, uint64_t first, uint64_t count, rateless_symbol_t *const symbols);/*symbols [first, first + count), faster if called with increasing ranges*/
+
+void rateless_encoder_destroy(rateless_encoder_t *const encoder);
+
+int rateless_decoder_init(uint32_t seed, rateless_decoder_t *const decoder);
+
+int rateless_decoder_add(rateless_decoder_t *const decoder, rateless_symbol_t const *const symbol);/*next symbol of the difference, then peel*/
+
+int rateless_decoder_done(rateless_decoder_t const *const decoder);/*TRUE when the whole difference has been recovered*/
+
+void rateless_decoder_destroy(rateless_decoder_t *const decoder);
+
+void rateless_symbol_sub(rateless_symbol_t *const a, rateless_symbol_t const *const b);/*a = a - b*/
+
+void rateless_key_bucket(rateless_key_t const *const key, int8_t side, bucket_t *const bucket);/*bucket view of a recovered key, for printing*/
+
+/*
+ * Streams of coded symbols are made of chunks: a header (seed, first symbol, number of symbols or 0 if the chunk
+ * lasts until the end of the stream, key length if global) followed by the symbols.
+ * Chunks with consecutive ranges can be concatenated to extend a prefix.
+ */
+int rateless_chunk_header_store(FILE *const out, uint32_t seed, uint64_t first, uint64_t count, uint64_t key_len);
+
+int rateless_chunk_header_load(FILE *const in, uint32_t *const seed, uint64_t *const first, uint64_t *const count, uint64_t *const key_len);
+
+int rateless_symbol_store(FILE *const out, rateless_symbol_t const *const symbol);
+
+int rateless_symbol_load(FILE *const in, rateless_symbol_t *const symbol);
+
+#endif/*RATELESS_H*/
@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "rateless_main.h"
+#include "ketopt.h"
+#include "constants.h"
+#include "rateless.h"
+#include "list_main.h"
+
+#include <assert.h>
+
+#define SYMBOL_BLOCK 4096 /*symbols computed and flushed together by encode*/
+
+typedef struct {
+    FILE *fp;
+    uint32_t seed;
+    uint64_t key_len;
+    uint64_t next;/* index of the next symbol */
+    uint64_t left;/* symbols left in the current chunk */
+    unsigned char unbounded;/* the current chunk lasts until the end of the stream */
+} symbol_stream_t;
+
+void print_encode_help();
+void print_decode_help();
+static int stream_next(symbol_stream_t *stream, rateless_symbol_t *symbol);
+
+/*
+ * Encode a set of keys (one per line, as for build) as a prefix of its stream of rateless coded symbols.
+ * The first m symbols are enough to decode up to ~m/1.7 differences, longer prefixes are obtained by running
+ * encode again from the next symbol (-b) and appending its output.
+ */
+enum Error encode_main(int argc, char** argv) {
+    ketopt_t opt;
+    FILE *fp, *out;
+    rateless_encoder_t encoder;
+    rateless_symbol_t *symbols;
+    char *kmer;
+    uint64_t m, first, position, count, j, kmer_size;
+    uint32_t seed;
+    int c, i;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    fp = NULL;
+    out = stdout;
+    symbols = NULL;
+    kmer = NULL;
+    m = first = 0;
+    seed = 42;
+    err = NO_ERROR;
+
+    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:o:m:b:s:h", longopts)) >= 0) {
+        if (c == 'i') {
+            if ((fp = fopen(opt.arg, "r")) == NULL) {
+                fprintf(stderr, "Unable to open the input file\n");
+                return ERR_FILE;
+            }
+        } else if (c == 'o') {
+            if ((out = fopen(opt.arg, "wb")) == NULL) {
+                fprintf(stderr, "Unable to open the output file\n");
+                if (fp) fclose(fp);
+                return ERR_FILE;
+            }
+        } else if (c == 'm') {
+            m = strtoull(opt.arg, NULL, 10);
+        } else if (c == 'b') {
+            first = strtoull(opt.arg, NULL, 10);
+        } else if (c == 's') {
+            seed = (uint32_t)strtoul(opt.arg, NULL, 10);
+        } else if (c == 'h') {
+            print_encode_help();
+            return NO_ERROR;
+        } else {
+            fprintf(stderr, "Option -%c not available\n", c);
+            return ERR_OPTION;
+        }
+    }
+    if(fp == NULL) fp = stdin;
+
+    rateless_encoder_init(seed, &encoder);
+    kmer_size = 4 * WSIZE + 1;
+    if ((kmer = (char*)malloc(kmer_size)) == NULL || (symbols = (rateless_symbol_t*)malloc(SYMBOL_BLOCK * sizeof(rateless_symbol_t))) == NULL) {
+        err = ERR_ALLOC;
+        print_error(err, "buffer allocation");
+    }
+    i = 0;
+    while(err == NO_ERROR && (c = fgetc(fp)) != EOF) {
+        if (c == '\n') {
+            if (i > 0) err = rateless_encoder_add(kmer, 0, i, &encoder);
+            i = 0;
+        } else if ((uint64_t)i < kmer_size) {
+            kmer[i++] = c;
+        } else {
+            err = ERR_OUTOFBOUNDS;
+        }
+    }
+    if (err == NO_ERROR && i > 0) err = rateless_encoder_add(kmer, 0, i, &encoder);
+    if (err == ERR_OUTOFBOUNDS) fprintf(stderr, "Keys longer than the configured bucket size\n");
+    else print_error(err, "key insertion");
+
+    #ifdef GLEN
+    if (err == NO_ERROR) err = rateless_chunk_header_store(out, seed, first, m, encoder.key_len);
+    #else
+    if (err == NO_ERROR) err = rateless_chunk_header_store(out, seed, first, m, 0);
+    #endif
+    for(position = first; err == NO_ERROR && (m == 0 || position < first + m); position += count) {/*m == 0: until the reader stops*/
+        count = m == 0 || first + m - position > SYMBOL_BLOCK ? SYMBOL_BLOCK : first + m - position;
+        err = rateless_encoder_symbols(&encoder, position, count, symbols);
+        for(j = 0; err == NO_ERROR && j < count; ++j) err = rateless_symbol_store(out, &symbols[j]);
+        if (err == NO_ERROR && fflush(out) != 0) err = ERR_IO;
+    }
+    if (err == ERR_IO) fprintf(stderr, "Error while writing the coded symbols\n");
+
+    if (kmer) free(kmer);
+    if (symbols) free(symbols);
+    rateless_encoder_destroy(&encoder);
+    if (fp != stdin) fclose(fp);
+    if (out != stdout) fclose(out);
+    return err;
+}
+
+/*
+ * Peel the difference of two streams of coded symbols built with the same seed, reading them in lockstep and
+ * stopping as soon as the difference is decoded. Keys of the first stream only are printed as i, those of the second
+ * one as j, like list does.
+ */
+enum Error decode_main(int argc, char** argv) {
+    ketopt_t opt;
+    symbol_stream_t a, b;
+    rateless_decoder_t decoder;
+    rateless_symbol_t sa, sb;
+    bucket_t bucket;
+    char *ipath, *jpath;
+    uint64_t max, i;
+    int c, erra, errb;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    ipath = jpath = NULL;
+    max = 0;
+    err = NO_ERROR;
+
+    static ko_longopt_t longopts[] = {{NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:j:m:h", longopts)) >= 0) {
+        if (c == 'i') {
+            ipath = opt.arg;
+        } else if (c == 'j') {
+            jpath = opt.arg;
+        } else if (c == 'm') {
+            max = strtoull(opt.arg, NULL, 10);
+        } else if (c == 'h') {
+            print_decode_help();
+            return NO_ERROR;
+        } else {
+            fprintf(stderr, "Option -%c not available\n", c);
+            return ERR_OPTION;
+        }
+    }
+    if (ipath == NULL) {
+        print_decode_help();
+        return ERR_OPTION;
+    }
+    memset(&a, 0, sizeof a);
+    memset(&b, 0, sizeof b);
+    if ((a.fp = fopen(ipath, "rb")) == NULL || (jpath != NULL && (b.fp = fopen(jpath, "rb")) == NULL)) {
+        fprintf(stderr, "Unable to open the input streams\n");
+        if (a.fp) fclose(a.fp);
+        return ERR_FILE;
+    }
+    memset(&sb, 0, sizeof sb);
+    rateless_decoder_init(0, &decoder);
+    for(i = 0; err == NO_ERROR && !rateless_decoder_done(&decoder) && (max == 0 || i < max); ++i) {
+        erra = stream_next(&a, &sa);
+        errb = b.fp ? stream_next(&b, &sb) : NO_ERROR;/*a single stream is decoded against the empty set*/
+        if (erra == ERR_OUTOFBOUNDS || errb == ERR_OUTOFBOUNDS) break;/*one of the streams ended*/
+        if ((err = erra ? erra : errb) != NO_ERROR) break;
+        if (i == 0) {
+            if (b.fp && a.seed != b.seed) {
+                err = ERR_INCOMPATIBLE;
+                break;
+            }
+            decoder.seed = a.seed;
+        }
+        rateless_symbol_sub(&sa, &sb);
+        err = rateless_decoder_add(&decoder, &sa);
+    }
+    if (err == ERR_INCOMPATIBLE) fprintf(stderr, "Incompatible streams (different seed or bucket size, or chunks not following each other)\n");
+    else if (err == ERR_IO) fprintf(stderr, "Truncated stream of coded symbols\n");
+    else if (err == NO_ERROR && !rateless_decoder_done(&decoder)) {
+        fprintf(stderr, "[decode] %llu symbols are not enough, %llu keys recovered so far: append more symbols (encode -b %llu)\n",
+            (unsigned long long)decoder.m, (unsigned long long)decoder.n, (unsigned long long)decoder.m);
+        err = ERR_VALUE;
+    }
+    if (err == NO_ERROR) {
+        #ifdef GLEN
+        binded_len = (keysum_len_t)(a.key_len > b.key_len ? a.key_len : b.key_len);
+        #endif
+        for(i = 0; i < decoder.n; ++i) {
+            rateless_key_bucket(&decoder.keys[i], decoder.sides[i], &bucket);
+            print_exact_bucket(&bucket, decoder.sides[i] > 0 ? 'i' : 'j', NULL);
+        }
+        fprintf(stderr, "[decode] %llu keys decoded from %llu symbols\n", (unsigned long long)decoder.n, (unsigned long long)decoder.m);
+    }
+    rateless_decoder_destroy(&decoder);
+    fclose(a.fp);
+    if (b.fp) fclose(b.fp);
+    return err;
+}
+
+/*next symbol of a stream, ERR_OUTOFBOUNDS at its end*/
+static int stream_next(symbol_stream_t *stream, rateless_symbol_t *symbol) {
+    int err;
+    uint32_t seed;
+    uint64_t first, count, key_len;
+    while (!stream->unbounded && stream->left == 0) {
+        if ((err = rateless_chunk_header_load(stream->fp, &seed, &first, &count, &key_len)) != NO_ERROR) return err;
+        if (first != stream->next || (stream->next != 0 && seed != stream->seed)) return ERR_INCOMPATIBLE;
+        stream->seed = seed;
+        if (stream->key_len < key_len) stream->key_len = key_len;
+        stream->left = count;
+        stream->unbounded = count == 0;
+    }
+    if ((err = rateless_symbol_load(stream->fp, symbol)) != NO_ERROR) return err == ERR_OUTOFBOUNDS && !stream->unbounded ? ERR_IO : err;
+    if (!stream->unbounded) --stream->left;
+    ++stream->next;
+    return NO_ERROR;
+}
+
+void print_encode_help() {
+    fprintf(stderr, "[encode] options:\n");
+    fprintf(stderr, "\t-i\tinput set of k-mers [stdin]\n");
+    fprintf(stderr, "\t-o\tstream of coded symbols (binary output) [stdout]\n");
+    fprintf(stderr, "\t-m\tnumber of symbols, 0 to write until the reader stops (pipes only) [0]\n");
+    fprintf(stderr, "\t-b\tindex of the first symbol, to extend a prefix already sent [0]\n");
+    fprintf(stderr, "\t-s\trandom seed [42]\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
+
+void print_decode_help() {
+    fprintf(stderr, "[decode] options:\n");
+    fprintf(stderr, "\t-i\tfirst stream of coded symbols\n");
+    fprintf(stderr, "\t-j\tsecond stream of coded symbols [empty set]\n");
+    fprintf(stderr, "\t-m\tmaximum number of symbols to read, 0 for no limit [0]\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
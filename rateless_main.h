@@ -0,0 +1,10 @@
+#ifndef RATELESS_MAIN_H
+#define RATELESS_MAIN_H
+
+#include "err.h"
+
+enum Error encode_main(int argc, char** argv);
+
+enum Error decode_main(int argc, char** argv);
+
+#endif/*RATELESS_MAIN_H*/
@@ -18,6 +18,7 @@ import pbench
 
 main_exec = "ibltseq"
 toset_script = "2set.py"
+multi_n_batch = 16 #sizes built together by the escalating-n searches
 
 kmc_cws_exec = "cws"
 
@@ -268,6 +269,22 @@ def ibf_sketch_set(executable: str, input_file: str, output_file: str, frag_len:
     out = subprocess.run(command, stdout=sys.stdout, stderr=sys.stderr)
     if out.returncode != 0: sys.stderr.write("ibltseq exited with error {}\n".format(out.returncode))
     
+def ibf_sketch_set_multi(executable: str, input_file: str, output_file: str, frag_len: int, ns: list[int], r: int, epsilon: float, seed: int) -> list[str]:
+    '''One sketch per n in a single pass over the input (build -n n1,n2,...), stored as <output_file>.n<n>'''
+    assert ns and all(n > 0 for n in ns)
+    if len(ns) == 1:
+        ibf_sketch_set(executable, input_file, output_file, frag_len, ns[0], r, epsilon, seed)
+        return [output_file]
+    assert input_file
+    assert output_file
+    assert 0 < frag_len <= 32
+    assert 3 <= r <= 7
+    assert 0 <= epsilon <= 1
+    command = [executable, "build", "-i", input_file, "-o", output_file, "-l", str(frag_len), "-n", ",".join(map(str, ns)), "-r", str(r), "-e", str(epsilon), "-s", str(seed)]
+    out = subprocess.run(command, stdout=sys.stdout, stderr=sys.stderr)
+    if out.returncode != 0: sys.stderr.write("ibltseq exited with error {}\n".format(out.returncode))
+    return ["{}.n{}".format(output_file, n) for n in ns]
+
 def ibf_sketch_each_sequence(executable: str, algo: str, input_fastx: str, output_folder: str, k: int, m: str, n: int, r: int, epsilon: float, seed: int):
     #TODO it needs a little bit of refactoring
     assert input_fastx
@@ -472,30 +489,28 @@ def compare_ibf_methods(aldiff_path: str, original: str, mutated: str, tmp_names
     if out.returncode != 0:
         sys.stderr.write("Error while generating syncmers table for the mutated sequence\n")
         sys.exit(os.EX_CANTCREAT)
-    peelable = False
-    n = starting_n
-    mm_len = configure_length("minimizers", k, m)
-    while not peelable and n < max_trials:
-        ibf_sketch_set(executable, dummy_mm_ori_table_name, dummy_ori_ibf, mm_len, n, 3, 0, 42)
-        ibf_sketch_set(executable, dummy_mm_mut_table_name, dummy_mut_ibf, mm_len, n, 3, 0, 42)
-        sketch_diff(executable, dummy_ori_ibf, dummy_mut_ibf, dummy_tmp_ibf)
-        message = sketch_list(executable, dummy_tmp_ibf)
-        peelable = check_peelability(message)
-        n += 1
-    mm_n = n-1
-    peelable = False
-    n = starting_n
-    sync_len = configure_length("syncmers", k, m)
-    while not peelable and n < max_trials:
-        ibf_sketch_set(executable, dummy_sm_ori_table_name, dummy_ori_ibf, sync_len, n, 3, 0, 42)
-        ibf_sketch_set(executable, dummy_sm_mut_table_name, dummy_mut_ibf, sync_len, n, 3, 0, 42)
-        sketch_diff(executable, dummy_ori_ibf, dummy_mut_ibf, dummy_tmp_ibf)
-        message = sketch_list(executable, dummy_tmp_ibf)
-        peelable = check_peelability(message)
-        n += 1
-    sm_n = n-1
+    mm_n = first_peelable_n(executable, dummy_mm_ori_table_name, dummy_mm_mut_table_name, dummy_ori_ibf, dummy_mut_ibf, dummy_tmp_ibf, configure_length("minimizers", k, m), starting_n, max_trials)
+    sm_n = first_peelable_n(executable, dummy_sm_ori_table_name, dummy_sm_mut_table_name, dummy_ori_ibf, dummy_mut_ibf, dummy_tmp_ibf, configure_length("syncmers", k, m), starting_n, max_trials)
     return mm_n, sm_n
 
+def first_peelable_n(executable: str, ori_table: str, mut_table: str, ori_ibf: str, mut_ibf: str, tmp_ibf: str, frag_len: int, starting_n: int, max_trials: int) -> int:
+    '''Smallest n in [starting_n, max_trials) whose difference sketch peels (max_trials - 1 if none), the sketches of a batch of sizes being built in one pass'''
+    n = starting_n
+    while n < max_trials:
+        ns = list(range(n, min(n + multi_n_batch, max_trials)))
+        ori_ibfs = ibf_sketch_set_multi(executable, ori_table, ori_ibf, frag_len, ns, 3, 0, 42)
+        mut_ibfs = ibf_sketch_set_multi(executable, mut_table, mut_ibf, frag_len, ns, 3, 0, 42)
+        found = None
+        for size, ori, mut in zip(ns, ori_ibfs, mut_ibfs):
+            if found is None:
+                sketch_diff(executable, ori, mut, tmp_ibf)
+                if check_peelability(sketch_list(executable, tmp_ibf)): found = size
+        if len(ns) > 1:
+            for f in ori_ibfs + mut_ibfs: os.remove(f)
+        if found is not None: return found
+        n = ns[-1] + 1
+    return max(starting_n, max_trials) - 1
+
 def ibf_build_minhash_collection(executable: str, hash_width: int, minhash_size: int, n: int, alice: list[str], bob: list[str], output_file: str):
     command = [executable, "collection", "-w", str(hash_width), "-z", str(minhash_size), "-n", str(n), "-o", output_file, "-a"] + alice + ["-b"] + bob
     out = subprocess.run(command, stderr=sys.stderr, stdout=subprocess.PIPE)
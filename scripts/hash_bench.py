@@ -0,0 +1,86 @@
+import os
+import sys
+import time
+import random
+import argparse
+import tempfile
+import subprocess
+
+"""
+Build/list throughput of the hash families of ibltseq (build -H).
+Two random sets of k-mers sharing all but --diff elements are sketched with each family,
+then their difference is listed. Each trial uses a different seed, so the fraction of
+fully peeled differences also estimates the peelability of each family.
+With -B, the same trials are repeated for each blocked layout width (0 is the classic layout).
+"""
+
+main_exec = "ibltseq"
+families = ["murmur3", "mix64", "wyhash"]
+
+def random_kmers(rng: random.Random, k: int, n: int) -> list[str]:
+    return ["".join(rng.choice("ACGT") for _ in range(k)) for _ in range(n)]
+
+def write_set(path: str, kmers: list[str]):
+    with open(path, "w") as fh:
+        fh.write("\n".join(kmers))
+        fh.write("\n")
+
+def timed(command: list) -> tuple[float, bytes]:
+    t0 = time.perf_counter()
+    p = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    return time.perf_counter() - t0, p.stdout if p.returncode == 0 else None
+
+def run_trial(executable: str, family: str, width: int, apath: str, bpath: str, tmpdir: str, n: int, r: int, epsilon: float, seed: int) -> tuple[float, float, int]:
+    ai, bi, di = (os.path.join(tmpdir, "{}.{}.ibf".format(name, family)) for name in ("a", "b", "d"))
+    build_time = 0
+    for ipath, opath in ((apath, ai), (bpath, bi)):
+        t, _ = timed([executable, "build", "-H", family, "-B", str(width), "-n", str(n), "-r", str(r), "-e", str(epsilon), "-s", str(seed), "-i", ipath, "-o", opath])
+        build_time += t
+    subprocess.run([executable, "diff", "-i", ai, "-j", bi, "-o", di], check=True)
+    list_time, listed = timed([executable, "list", "-i", di])
+    return build_time, list_time, (len(listed.splitlines()) if listed is not None else -1)
+
+def listed_keys(executable: str, path: str) -> int:
+    """keys listed also when peeling fails, which tells a weak family from a sketch slightly too small"""
+    p = subprocess.run([executable, "list", "-i", path], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    return len(p.stdout.splitlines())
+
+def main(args):
+    executable = os.path.join(args.bin, main_exec)
+    rng = random.Random(args.seed)
+    widths = [int(w) for w in args.B.split(",")]
+    sys.stdout.write("family,B,k,keys,diff,n,r,trials,peeled,mean_listed,build_keys_per_s,list_keys_per_s\n")
+    stats = {(family, width): [0, 0, 0, 0] for family in families for width in widths}
+    with tempfile.TemporaryDirectory() as tmpdir:
+        apath, bpath = os.path.join(tmpdir, "a.txt"), os.path.join(tmpdir, "b.txt")
+        for trial in range(args.trials):
+            common = random_kmers(rng, args.k, args.keys - args.diff // 2)
+            write_set(apath, common + random_kmers(rng, args.k, args.diff // 2))
+            write_set(bpath, common + random_kmers(rng, args.k, args.diff - args.diff // 2))
+            for family in families:
+                for width in widths:
+                    build_time, list_time, listed = run_trial(executable, family, width, apath, bpath, tmpdir, args.n, args.r, args.epsilon, args.seed + trial)
+                    stats[(family, width)][0] += build_time
+                    stats[(family, width)][1] += list_time
+                    stats[(family, width)][2] += listed == args.diff
+                    stats[(family, width)][3] += listed if listed >= 0 else listed_keys(executable, os.path.join(tmpdir, "d.{}.ibf".format(family)))
+    for family in families:
+        for width in widths:
+            build_time, list_time, peeled, listed = stats[(family, width)]
+            sys.stdout.write("{},{},{},{},{},{},{},{},{},{:.0f},{:.0f},{:.0f}\n".format(
+                family, width, args.k, args.keys, args.diff, args.n, args.r, args.trials, peeled, listed / args.trials,
+                2 * args.keys * args.trials / build_time, args.diff * args.trials / list_time))
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Build/list throughput and peelability of each IBLT hash family")
+    parser.add_argument("-b", "--bin", help="folder containing the ibltseq executable", type=str, default=".")
+    parser.add_argument("-k", help="k-mer length (must fit the configured bucket size)", type=int, default=31)
+    parser.add_argument("-m", "--keys", help="number of k-mers in each set", type=int, default=1000000)
+    parser.add_argument("-d", "--diff", help="size of the symmetric difference", type=int, default=10000)
+    parser.add_argument("-n", help="number of differences the sketches are built for", type=int, default=12000)
+    parser.add_argument("-r", help="number of hash functions", type=int, default=3)
+    parser.add_argument("-e", "--epsilon", help="epsilon", type=float, default=0)
+    parser.add_argument("-B", help="comma-separated blocked layout widths, 0 for the classic layout", type=str, default="0")
+    parser.add_argument("-t", "--trials", help="number of random trials", type=int, default=3)
+    parser.add_argument("-s", "--seed", help="random seed", type=int, default=42)
+    main(parser.parse_args())
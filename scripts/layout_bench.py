@@ -0,0 +1,121 @@
+import os
+import sys
+import time
+import random
+import argparse
+import tempfile
+import subprocess
+
+"""
+Classic vs blocked IBLT layouts (ibltseq build -B).
+
+calibrate: for each block width, the size of a blocked sketch relative to the classic one (ibflib sizing)
+           and the smallest extra space on top of it for which a sketch holding exactly n random k-mers
+           peels at least as often as the classic one. The extra space should be ~0 at every width.
+           Each hash family (-H) is calibrated on its own: the block of a key is picked by its hash too.
+bench:     insertion (build) and peeling (list) rates of sketches holding n random k-mers for each layout.
+"""
+
+main_exec = "ibltseq"
+
+def random_kmers(rng: random.Random, k: int, n: int) -> list[str]:
+    return ["".join(rng.choice("ACGT") for _ in range(k)) for _ in range(n)]
+
+def write_set(path: str, kmers: list[str]):
+    with open(path, "w") as fh:
+        fh.write("\n".join(kmers))
+        fh.write("\n")
+
+def build(executable: str, input_file: str, output_file: str, n: int, r: int, width: int, seed: int, family: str) -> float:
+    t0 = time.perf_counter()
+    p = subprocess.run([executable, "build", "-n", str(n), "-r", str(r), "-B", str(width), "-s", str(seed), "-H", family, "-i", input_file, "-o", output_file], stderr=subprocess.DEVNULL)
+    return time.perf_counter() - t0 if p.returncode == 0 else None # narrow blocks may need too much memory
+
+def peel(executable: str, sketch: str) -> tuple[float, int]:
+    t0 = time.perf_counter()
+    p = subprocess.run([executable, "list", "-i", sketch], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    return time.perf_counter() - t0, (len(p.stdout.splitlines()) if p.returncode == 0 else -1)
+
+def success_rate(executable: str, kmer_sets: list, tmpdir: str, n: int, r: int, width: int, family: str) -> float:
+    sketch = os.path.join(tmpdir, "s.ibf")
+    peeled = 0
+    for seed, (path, size) in enumerate(kmer_sets):
+        if build(executable, path, sketch, n, r, width, seed, family) is None: return -1
+        peeled += peel(executable, sketch)[1] == size
+    return peeled / len(kmer_sets)
+
+def calibrate_main(args):
+    executable = os.path.join(args.bin, main_exec)
+    rng = random.Random(args.seed)
+    sys.stdout.write("family,width,size_ratio,extra_overhead,success,classic_success\n")
+    with tempfile.TemporaryDirectory() as tmpdir:
+        kmer_sets = []
+        for trial in range(args.trials):
+            path = os.path.join(tmpdir, "{}.txt".format(trial))
+            write_set(path, random_kmers(rng, args.k, args.n))
+            kmer_sets.append((path, args.n))
+        sketch = os.path.join(tmpdir, "s.ibf")
+        classic_n = round(args.n * (1 + args.margin))
+        for family in args.family.split(","):
+            target = success_rate(executable, kmer_sets, tmpdir, classic_n, args.r, 0, family)
+            classic_size = os.path.getsize(sketch)
+            for log_width in range(args.max_log_width + 1):
+                width = 1 << log_width
+                rate = lambda overhead: success_rate(executable, kmer_sets, tmpdir, round(classic_n * (1 + overhead)), args.r, width, family)
+                lo, hi = 0, args.max_overhead
+                if (success := rate(lo)) < 0:
+                    sys.stdout.write("{},{},inf,inf,0,{:.3f}\n".format(family, width, target))
+                    continue
+                size_ratio = os.path.getsize(sketch) / classic_size
+                if success >= target: hi = lo
+                elif rate(hi) < target: lo = hi = float("inf")
+                while hi - lo > args.step: # peeling success grows with the overhead, bisect the smallest sufficient one
+                    mid = (lo + hi) / 2
+                    if rate(mid) >= target: hi = mid
+                    else: lo = mid
+                if hi != lo: success = rate(hi)
+                sys.stdout.write("{},{},{:.3f},{:.3f},{:.3f},{:.3f}\n".format(family, width, size_ratio, hi, success, target))
+                sys.stdout.flush()
+
+def bench_main(args):
+    executable = os.path.join(args.bin, main_exec)
+    rng = random.Random(args.seed)
+    sys.stdout.write("width,n,r,family,peeled,insert_keys_per_s,peel_keys_per_s\n")
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path, sketch = os.path.join(tmpdir, "set.txt"), os.path.join(tmpdir, "s.ibf")
+        write_set(path, random_kmers(rng, args.k, args.n))
+        for family in args.family.split(","):
+            for width in [0] + args.widths:
+                build_times = [build(executable, path, sketch, round(args.n * (1 + args.epsilon)), args.r, width, args.seed, family) for _ in range(args.trials)]
+                if None in build_times: # block width too narrow for n and r
+                    sys.stdout.write("{},{},{},{},rejected,0,0\n".format(width, args.n, args.r, family))
+                    continue
+                peel_time, peeled = min(peel(executable, sketch) for _ in range(args.trials))
+                sys.stdout.write("{},{},{},{},{},{:.0f},{:.0f}\n".format(width, args.n, args.r, family, peeled == args.n, args.n / min(build_times), args.n / peel_time))
+                sys.stdout.flush()
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Calibration and benchmark of the blocked IBLT layout")
+    subparsers = parser.add_subparsers(dest="command")
+    for name, default_n, default_trials in (("calibrate", 10000, 20), ("bench", 1000000, 3)):
+        subparser = subparsers.add_parser(name)
+        subparser.add_argument("-b", "--bin", help="folder containing the ibltseq executable", type=str, default=".")
+        subparser.add_argument("-k", help="k-mer length (must fit the configured bucket size)", type=int, default=31)
+        subparser.add_argument("-n", help="number of k-mers in the sketch", type=int, default=default_n)
+        subparser.add_argument("-r", help="number of hash functions", type=int, default=3)
+        subparser.add_argument("-H", "--family", help="comma-separated hash families", type=str, default="murmur3,mix64,wyhash")
+        subparser.add_argument("-t", "--trials", help="number of trials", type=int, default=default_trials)
+        subparser.add_argument("-s", "--seed", help="random seed", type=int, default=42)
+    calibrate_parser = subparsers.choices["calibrate"]
+    calibrate_parser.add_argument("-w", "--max-log-width", help="largest block width (log2) to calibrate", type=int, default=11)
+    calibrate_parser.add_argument("-x", "--max-overhead", help="largest relative overhead to try", type=float, default=4)
+    calibrate_parser.add_argument("-m", "--margin", help="the classic sketch is built for n * (1 + margin) keys", type=float, default=0.25)
+    calibrate_parser.add_argument("--step", help="precision of the overhead", type=float, default=0.02)
+    calibrate_parser.set_defaults(func=calibrate_main)
+    bench_parser = subparsers.choices["bench"]
+    bench_parser.add_argument("-W", "--widths", help="block widths to compare with the classic layout", type=int, nargs="+", default=[64, 256, 1024, 4096, 16384])
+    bench_parser.add_argument("-e", "--epsilon", help="sketches are built for n * (1 + epsilon) keys", type=float, default=0.25)
+    bench_parser.set_defaults(func=bench_main)
+    args = parser.parse_args()
+    if args.command is None: parser.print_help()
+    else: args.func(args)
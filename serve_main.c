@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "serve_main.h"
+#include "ketopt.h"
+#include "constants.h"
+#include "ibflib.h"
+#include "list_main.h"
+#include "jaccard_main.h"
+
+/*
+ * Protocol: the client sends a query byte followed by its sketch (ibf_sketch_store format) and closes its side.
+ * The server answers with the text that list (i,j keys) or jaccard would print, or with a summary line,
+ * and terminates the answer with a status line "#<error code>" (0 on success).
+ * Keys of the client sketch only are reported as i, keys of the reference sketch only as j.
+ */
+enum Query {QUERY_LIST = 'L', QUERY_SUMMARY = 'S', QUERY_JACCARD = 'J'};
+
+#define SERVE_TIMEOUT 10 /*seconds a client may stay silent (or not read the answer) before being dropped*/
+
+typedef struct {
+    char *path;/* Unix socket, or NULL for TCP */
+    char *host;
+    long port;
+} endpoint_t;
+
+typedef struct {
+    unsigned long long unique_i;
+    unsigned long long unique_j;
+    unsigned long long changed;/* counting IBLTs only: keys in both sketches with different counts */
+} summary_t;
+
+static volatile sig_atomic_t stop_serving;
+
+void print_serve_help();
+void print_reconcile_help();
+static int parse_endpoint_option(int c, char const *arg, endpoint_t *endpoint);
+static int endpoint_open(endpoint_t const *endpoint, int listening);
+static int serve_query(int fd, ibf_t const *reference);
+
+static void serve_stop(int signum) {
+    stop_serving = TRUE;
+}
+
+/*
+ * Keep a reference sketch resident and answer diff/peel/jaccard queries from reconcile, one at a time,
+ * until interrupted (SIGINT/SIGTERM) or after -n queries.
+ */
+enum Error serve_main(int argc, char** argv) {
+    ketopt_t opt;
+    endpoint_t endpoint;
+    ibf_t reference;
+    struct sigaction action;
+    char *ipath;
+    unsigned long max_queries, served;
+    int c, lfd, fd;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    ipath = NULL;
+    endpoint.path = NULL;
+    endpoint.host = "127.0.0.1";
+    endpoint.port = 0;
+    max_queries = 0;
+    err = NO_ERROR;
+
+    static ko_longopt_t longopts[] = {{"socket", ko_required_argument, LONGOPT_SOCKET}, {"port", ko_required_argument, LONGOPT_PORT}, {"host", ko_required_argument, LONGOPT_HOST}, {"hugepages", ko_no_argument, LONGOPT_HUGEPAGES}, {NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:n:h", longopts)) >= 0) {
+        if (c == 'i') {
+            ipath = opt.arg;
+        } else if (c == 'n') {
+            max_queries = strtoul(opt.arg, NULL, 10);
+        } else if (c == LONGOPT_HUGEPAGES) {
+            ibf_set_alloc_policy(IBF_ALLOC_HUGEPAGES);
+        } else if (c == 'h') {
+            print_serve_help();
+            return NO_ERROR;
+        } else if (parse_endpoint_option(c, opt.arg, &endpoint) != NO_ERROR) {
+            fprintf(stderr, "Option -%c not available\n", c);
+            return ERR_OPTION;
+        }
+    }
+    if (ipath == NULL || (endpoint.path == NULL) == (endpoint.port == 0)) {
+        print_serve_help();
+        return ERR_OPTION;
+    }
+    if ((err = ibf_sketch_load(ipath, &reference)) != NO_ERROR) {
+        fprintf(stderr, "Unable to read the reference invertible bloom filter\n");
+        return err;
+    }
+    if ((lfd = endpoint_open(&endpoint, TRUE)) < 0) {
+        fprintf(stderr, "Unable to listen on the socket: %s\n", strerror(errno));
+        ibf_sketch_destroy(&reference);
+        return ERR_IO;
+    }
+    memset(&action, 0, sizeof action);
+    action.sa_handler = serve_stop;/*no SA_RESTART: accept returns on interruption*/
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);/*a client leaving early must not stop the server*/
+    fprintf(stderr, "[serve] ready\n");
+    for(served = 0; !stop_serving && (max_queries == 0 || served < max_queries);) {
+        if ((fd = accept(lfd, NULL, NULL)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Unable to accept connections: %s\n", strerror(errno));
+            err = ERR_IO;
+            break;
+        }
+        serve_query(fd, &reference);
+        ++served;
+    }
+    close(lfd);
+    if (endpoint.path) unlink(endpoint.path);
+    fprintf(stderr, "[serve] %lu queries answered\n", served);
+    ibf_sketch_destroy(&reference);
+    return err;
+}
+
+#ifdef STORE_WEIGHTS
+static void summary_count_weighted(const bucket_t *bucket, char source, int64_t delta, void *summary) {
+    if (source == 'i') ++((summary_t*)summary)->unique_i;
+    else if (source == 'j') ++((summary_t*)summary)->unique_j;
+    else ++((summary_t*)summary)->changed;
+}
+#else
+static void summary_count(const bucket_t *bucket, char source, void *summary) {
+    if (source == 'i') ++((summary_t*)summary)->unique_i;
+    else ++((summary_t*)summary)->unique_j;
+}
+#endif
+
+/*answer the query of one connection, the status is also sent to the client*/
+static int serve_query(int fd, ibf_t const *reference) {
+    FILE *in, *out;
+    ibf_t query;
+    summary_t summary;
+    ibf_counters_t counters;
+    struct timeval timeout;
+    int op, err;
+
+    memset(&query, 0, sizeof query);
+    memset(&summary, 0, sizeof summary);
+    err = NO_ERROR;
+    timeout.tv_sec = SERVE_TIMEOUT;/*queries are answered one at a time, an idle client must not stall the next ones*/
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+    if ((in = fdopen(fd, "rb")) == NULL) {
+        close(fd);
+        return ERR_IO;
+    }
+    if ((out = fdopen(dup(fd), "wb")) == NULL) {
+        fclose(in);
+        return ERR_IO;
+    }
+    errno = 0;
+    if ((op = fgetc(in)) == EOF) err = ERR_IO;
+    if (!err) err = ibf_sketch_read(in, &query);
+    if (err && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        fprintf(stderr, "[serve] no data for %d s, connection dropped\n", SERVE_TIMEOUT);
+        fclose(out);
+        fclose(in);
+        ibf_sketch_destroy(&query);
+        return ERR_IO;
+    }
+    if (!err && op != QUERY_LIST && op != QUERY_SUMMARY && op != QUERY_JACCARD) err = ERR_OPTION;
+    if (!err && op == QUERY_JACCARD) err = sketch_jaccard(&query, reference, out);
+    else if (!err) {
+        err = ibf_sketch_sub_inplace(&query, reference);/*the query becomes the difference*/
+        #ifdef GLEN
+        binded_len = query.key_len;
+        #endif
+        #ifdef STORE_WEIGHTS
+        if (!err) err = ibf_list_counted(&query, op == QUERY_LIST ? &print_counted_bucket : &summary_count_weighted, op == QUERY_LIST ? (void*)out : (void*)&summary);
+        #else
+        if (!err) err = ibf_list_seq(&query, op == QUERY_LIST ? &print_exact_bucket : &summary_count, op == QUERY_LIST ? (void*)out : (void*)&summary);
+        #endif
+        if (op == QUERY_SUMMARY && (err == NO_ERROR || err == ERR_VALUE)) {/*the summary is also useful when the difference is too large*/
+            ibf_counters_get(&counters);
+            #ifdef STORE_WEIGHTS
+            fprintf(out, "%llu,%llu,%llu,%llu\n", summary.unique_i, summary.unique_j, summary.changed, (unsigned long long)counters.remaining_cells);
+            #else
+            fprintf(out, "%llu,%llu,%llu\n", summary.unique_i, summary.unique_j, (unsigned long long)counters.remaining_cells);
+            #endif
+        }
+    }
+    fprintf(out, "#%d\n", err);
+    fclose(out);
+    fclose(in);
+    fprintf(stderr, "[serve] query %c: status %d\n", op == EOF ? '-' : op, err);
+    ibf_sketch_destroy(&query);
+    return err;
+}
+
+/*
+ * Send a local sketch to a running serve and print its answer.
+ * The sketch file is streamed as is, the client never loads it.
+ */
+enum Error reconcile_main(int argc, char** argv) {
+    ketopt_t opt;
+    endpoint_t endpoint;
+    FILE *sketch, *in, *out;
+    char *ipath, *line, buffer[BUFSIZ];
+    size_t line_size, len;
+    int c, fd, status, query;
+    enum Error err;
+
+    opt = KETOPT_INIT;
+    ipath = NULL;
+    endpoint.path = NULL;
+    endpoint.host = "127.0.0.1";
+    endpoint.port = 0;
+    query = QUERY_LIST;
+    line = NULL;
+    line_size = 0;
+    status = -1;
+    err = NO_ERROR;
+
+    static ko_longopt_t longopts[] = {{"socket", ko_required_argument, LONGOPT_SOCKET}, {"port", ko_required_argument, LONGOPT_PORT}, {"host", ko_required_argument, LONGOPT_HOST}, {NULL, 0, 0}};
+    while((c = ketopt(&opt, argc, argv, 1, "i:q:h", longopts)) >= 0) {
+        if (c == 'i') {
+            ipath = opt.arg;
+        } else if (c == 'q') {
+            if (strcmp(opt.arg, "list") == 0) query = QUERY_LIST;
+            else if (strcmp(opt.arg, "summary") == 0) query = QUERY_SUMMARY;
+            else if (strcmp(opt.arg, "jaccard") == 0) query = QUERY_JACCARD;
+            else {
+                fprintf(stderr, "Unknown query %s\n", opt.arg);
+                return ERR_OPTION;
+            }
+        } else if (c == 'h') {
+            print_reconcile_help();
+            return NO_ERROR;
+        } else if (parse_endpoint_option(c, opt.arg, &endpoint) != NO_ERROR) {
+            fprintf(stderr, "Option -%c not available\n", c);
+            return ERR_OPTION;
+        }
+    }
+    if (ipath == NULL || (endpoint.path == NULL) == (endpoint.port == 0)) {
+        print_reconcile_help();
+        return ERR_OPTION;
+    }
+    if ((sketch = fopen(ipath, "rb")) == NULL) {
+        fprintf(stderr, "Unable to open the local sketch\n");
+        return ERR_FILE;
+    }
+    if ((fd = endpoint_open(&endpoint, FALSE)) < 0) {
+        fprintf(stderr, "Unable to connect to the server: %s\n", strerror(errno));
+        fclose(sketch);
+        return ERR_IO;
+    }
+    signal(SIGPIPE, SIG_IGN);/*write errors are reported instead*/
+    if ((out = fdopen(dup(fd), "wb")) == NULL) err = ERR_IO;
+    if (!err && fputc(query, out) == EOF) err = ERR_IO;
+    while (!err && (len = fread(buffer, 1, sizeof buffer, sketch)) > 0) if (fwrite(buffer, 1, len, out) != len) err = ERR_IO;
+    if (out && fclose(out) != 0 && !err) err = ERR_IO;
+    fclose(sketch);
+    shutdown(fd, SHUT_WR);/*end of the query*/
+    if ((in = fdopen(fd, "rb")) == NULL) {
+        close(fd);
+        return ERR_IO;
+    }
+    while (getline(&line, &line_size, in) > 0) {
+        if (line[0] == '#') status = atoi(&line[1]);
+        else fputs(line, stdout);
+    }
+    fclose(in);
+    if (line) free(line);
+    if (status < 0) {
+        fprintf(stderr, "The server closed the connection without answering\n");
+        return ERR_IO;
+    }
+    if (status != NO_ERROR) fprintf(stderr, "The server could not answer the query\n");
+    return (enum Error)status;
+}
+
+static int parse_endpoint_option(int c, char const *arg, endpoint_t *endpoint) {
+    if (c == LONGOPT_SOCKET) {
+        endpoint->path = (char*)arg;
+    } else if (c == LONGOPT_PORT) {
+        endpoint->port = strtol(arg, NULL, 10);
+        if (endpoint->port <= 0 || endpoint->port > 0xFFFF) return ERR_OPTION;
+    } else if (c == LONGOPT_HOST) {
+        endpoint->host = (char*)arg;
+    } else return ERR_OPTION;
+    return NO_ERROR;
+}
+
+/*listening or connected socket, -1 on error (errno set)*/
+static int endpoint_open(endpoint_t const *endpoint, int listening) {
+    struct sockaddr_un unix_address;
+    struct sockaddr_in inet_address;
+    struct sockaddr *address;
+    socklen_t address_len;
+    int fd, yes;
+    if (endpoint->path) {
+        memset(&unix_address, 0, sizeof unix_address);
+        unix_address.sun_family = AF_UNIX;
+        if (strlen(endpoint->path) >= sizeof unix_address.sun_path) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        strcpy(unix_address.sun_path, endpoint->path);
+        address = (struct sockaddr*)&unix_address;
+        address_len = sizeof unix_address;
+        if (listening) unlink(endpoint->path);/*left by a previous server*/
+    } else {
+        memset(&inet_address, 0, sizeof inet_address);
+        inet_address.sin_family = AF_INET;
+        inet_address.sin_port = htons((uint16_t)endpoint->port);
+        if (inet_pton(AF_INET, endpoint->host, &inet_address.sin_addr) != 1) {
+            errno = EINVAL;
+            return -1;
+        }
+        address = (struct sockaddr*)&inet_address;
+        address_len = sizeof inet_address;
+    }
+    if ((fd = socket(address->sa_family, SOCK_STREAM, 0)) < 0) return -1;
+    yes = 1;
+    if (listening && !endpoint->path) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof yes);
+    if (listening ? bind(fd, address, address_len) < 0 || listen(fd, 16) < 0 : connect(fd, address, address_len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void print_serve_help() {
+    fprintf(stderr, "[serve] options:\n");
+    fprintf(stderr, "\t-i\treference sketch, kept in memory\n");
+    fprintf(stderr, "\t--socket\tpath of the Unix socket to listen on\n");
+    fprintf(stderr, "\t--port\tTCP port to listen on (instead of --socket)\n");
+    fprintf(stderr, "\t--host\tIPv4 address to listen on with --port [127.0.0.1]\n");
+    fprintf(stderr, "\t-n\tstop after this number of queries, 0 to serve until interrupted [0]\n");
+    fprintf(stderr, "\t--hugepages\tback the sketches with huge pages (explicit if reserved, transparent otherwise)\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
+
+void print_reconcile_help() {
+    fprintf(stderr, "[reconcile] options:\n");
+    fprintf(stderr, "\t-i\tlocal sketch, sent to the server\n");
+    fprintf(stderr, "\t--socket\tpath of the Unix socket of the server\n");
+    fprintf(stderr, "\t--port\tTCP port of the server (instead of --socket)\n");
+    fprintf(stderr, "\t--host\tIPv4 address of the server with --port [127.0.0.1]\n");
+    fprintf(stderr, "\t-q\tquery: list (keys of the difference, as list), summary (i_only,j_only[,changed],nonzero cells left), jaccard (as jaccard) [list]\n");
+    fprintf(stderr, "\t-h\tshow this help\n");
+}
@@ -0,0 +1,10 @@
+#ifndef SERVE_MAIN_H
+#define SERVE_MAIN_H
+
+#include "err.h"
+
+enum Error serve_main(int argc, char** argv);
+
+enum Error reconcile_main(int argc, char** argv);
+
+#endif/*SERVE_MAIN_H*/
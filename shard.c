@@ -0,0 +1,340 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shard.h"
+#include "murmur3.h"
+#include "err.h"
+#include "endian_fixer.h"
+
+#include <assert.h>
+#include <pthread.h>
+
+#define SHARD_ROUTE_SALT 0x9e3779b9 /*keeps the routing hash independent of the bucket hashes of the same seed*/
+#define SHARD_COPY_BYTES (1 << 16)
+
+typedef struct {
+	sharded_t *sketch;
+	uint32_t nkeys;
+	unsigned int thread, threads;
+	int err;
+} shard_worker_t;
+
+/*multiply-shift of the hash prefix, so that any number of shards is balanced*/
+static uint32_t shard_route(uint8_t const *const packed, unsigned int len, uint32_t seed, uint32_t count) {
+	hash_t hash;
+	MurmurHash3_x64_128(packed, WSIZE, (seed ^ SHARD_ROUTE_SALT) + len, (void*)&hash);
+	return (uint32_t)(((hash.ms64b >> 32) * count) >> 32);
+}
+
+uint64_t shard_n(unsigned int n, uint32_t count) {
+	double mean;
+	assert(count != 0);
+	mean = (double)n / count;
+	return (uint64_t)ceil(mean + SHARD_LOAD_Z * sqrt(mean)) + 1;
+}
+
+int shard_count(unsigned char r, float epsilon, unsigned int n, uint64_t cache_bytes, uint32_t *const count) {
+	int err;
+	ibf_t shape;
+	uint64_t bytes;
+	assert(count != NULL);
+	for(*count = 1; *count < n; ++*count) {
+		if ((err = ibf_sketch_shape(0, r, epsilon, (unsigned int)shard_n(n, *count), 0, FALSE, &shape)) != NO_ERROR) return err;
+		bytes = shape.chunk_size * shape.repetitions * sizeof(bucket_t);
+		ibf_sketch_destroy(&shape);
+		if (bytes <= cache_bytes) break;
+		if (bytes / cache_bytes > 2) *count += (uint32_t)(*count * (bytes / cache_bytes - 1) / 2);/*far from it, jump ahead*/
+	}
+	return NO_ERROR;
+}
+
+static int sharded_alloc(uint32_t count, sharded_t *const sketch) {
+	memset(sketch, 0, sizeof *sketch);
+	sketch->dir.count = count;
+	sketch->dir.n = (uint64_t*)calloc(count, sizeof(uint64_t));
+	sketch->dir.offsets = (uint64_t*)calloc(count + 1, sizeof(uint64_t));
+	sketch->shards = (ibf_t*)calloc(count, sizeof(ibf_t));
+	if (sketch->dir.n == NULL || sketch->dir.offsets == NULL || sketch->shards == NULL) return ERR_ALLOC;
+	return NO_ERROR;
+}
+
+static int shard_init(unsigned int root_seed, unsigned char r, float epsilon, uint64_t n, uint8_t hash_family, ibf_t *const shard) {
+	int err;
+	if (n > (unsigned int)-1) return ERR_OUTOFBOUNDS;
+	if ((err = ibf_sketch_init(root_seed, r, epsilon, (unsigned int)n, shard)) != NO_ERROR) return err;
+	return ibf_sketch_set_hash(shard, hash_family);
+}
+
+int sharded_init(uint32_t count, unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint8_t hash_family, sharded_t *const sketch) {
+	int err;
+	uint32_t i;
+	assert(sketch != NULL);
+	if (count == 0) return ERR_VALUE;
+	if ((err = sharded_alloc(count, sketch)) != NO_ERROR) return err;
+	sketch->dir.seed = root_seed;
+	for(i = 0; i < count && err == NO_ERROR; ++i) {
+		sketch->dir.n[i] = shard_n(n, count);
+		err = shard_init(root_seed, r, epsilon, sketch->dir.n[i], hash_family, &sketch->shards[i]);
+	}
+	return err;
+}
+
+int sharded_resize_init(char const *const path, uint32_t const *const which, uint32_t nwhich, unsigned int root_seed, unsigned char r, float epsilon, uint8_t hash_family, sharded_t *const sketch) {
+	int err;
+	FILE *in;
+	shard_dir_t dir;
+	uint32_t i;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	if ((in = fopen(path, "rb")) == NULL) return ERR_FILE;
+	err = shard_dir_read(in, &dir);
+	fclose(in);
+	if (err != NO_ERROR) return err;
+	if (dir.seed != root_seed) err = ERR_INCOMPATIBLE;
+	if (err == NO_ERROR && (err = sharded_alloc(dir.count, sketch)) == NO_ERROR) {
+		sketch->dir.seed = dir.seed;
+		memcpy(sketch->dir.n, dir.n, dir.count * sizeof(uint64_t));
+		memcpy(sketch->dir.offsets, dir.offsets, (dir.count + 1) * sizeof(uint64_t));
+		sketch->previous = path;
+	}
+	for(i = 0; i < nwhich && err == NO_ERROR; ++i) {
+		if (which[i] >= dir.count) err = ERR_OUTOFBOUNDS;
+		else if (sketch->shards[which[i]].data == NULL) {/*listed twice: resized once*/
+			sketch->dir.n[which[i]] *= 2;
+			err = shard_init(root_seed, r, epsilon, sketch->dir.n[which[i]], hash_family, &sketch->shards[which[i]]);
+		}
+	}
+	shard_dir_destroy(&dir);
+	return err;
+}
+
+static void *shard_insert_worker(void *arg) {
+	shard_worker_t *worker;
+	sharded_t *sketch;
+	uint32_t j, route;
+	worker = (shard_worker_t*)arg;
+	sketch = worker->sketch;
+	for(j = 0; j < worker->nkeys && worker->err == NO_ERROR; ++j) {
+		route = sketch->routes[j];
+		if (route == SHARD_NONE || route % worker->threads != worker->thread || sketch->shards[route].data == NULL) continue;
+		worker->err = ibf_insert_packed(&sketch->packed[(uint64_t)j * WSIZE], sketch->lens[j], &sketch->shards[route]);
+	}
+	return NULL;
+}
+
+int sharded_insert_batch(sharded_t *const sketch, char const *const kmers, uint32_t const *const ends, uint32_t nkeys, unsigned int threads) {
+	int err;
+	uint32_t j, start;
+	unsigned int t, started;
+	ibf_counters_t routed;
+	shard_worker_t *workers;
+	pthread_t *tids;
+	assert(sketch != NULL);
+	if (threads == 0) threads = 1;
+	if (nkeys > sketch->capacity) {
+		free(sketch->packed);
+		free(sketch->lens);
+		free(sketch->routes);
+		sketch->packed = (uint8_t*)malloc((uint64_t)nkeys * WSIZE);
+		sketch->lens = (unsigned int*)malloc(nkeys * sizeof(unsigned int));
+		sketch->routes = (uint32_t*)malloc(nkeys * sizeof(uint32_t));
+		sketch->capacity = nkeys;
+		if (sketch->packed == NULL || sketch->lens == NULL || sketch->routes == NULL) {
+			sketch->capacity = 0;
+			return ERR_ALLOC;
+		}
+	}
+	memset(&routed, 0, sizeof routed);
+	for(j = 0, start = 0; j < nkeys; start = ends[j++]) {/*packed and routed once, by this thread*/
+		sketch->lens[j] = ends[j] - start;
+		err = ibf_pack_seq(kmers, start, ends[j], &sketch->packed[(uint64_t)j * WSIZE], WSIZE);
+		if (err == ERR_VALUE) sketch->routes[j] = SHARD_NONE;/*counted as skipped*/
+		else if (err != NO_ERROR) return err;
+		else {
+			sketch->routes[j] = shard_route(&sketch->packed[(uint64_t)j * WSIZE], sketch->lens[j], sketch->dir.seed, sketch->dir.count);
+			++routed.inserted;
+		}
+	}
+	ibf_counters_add(&routed);
+	if (threads > sketch->dir.count) threads = sketch->dir.count;
+	workers = (shard_worker_t*)calloc(threads, sizeof(shard_worker_t));
+	tids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+	if (workers == NULL || tids == NULL) {
+		free(workers);
+		free(tids);
+		return ERR_ALLOC;
+	}
+	for(t = 0; t < threads; ++t) {
+		workers[t].sketch = sketch;
+		workers[t].nkeys = nkeys;
+		workers[t].thread = t;
+		workers[t].threads = threads;
+	}
+	for(started = 1; started < threads && pthread_create(&tids[started], NULL, &shard_insert_worker, &workers[started]) == 0; ++started);
+	shard_insert_worker(&workers[0]);
+	for(t = 1; t < started; ++t) pthread_join(tids[t], NULL);
+	for(t = started; t < threads; ++t) shard_insert_worker(&workers[t]);/*threads not started*/
+	err = NO_ERROR;
+	for(t = 0; t < threads && err == NO_ERROR; ++t) err = workers[t].err;
+	free(workers);
+	free(tids);
+	return err;
+}
+
+static int shard_u32_write(FILE *const out, uint32_t value) {
+	value = hton32(value);
+	return fwrite(&value, sizeof value, 1, out) == 1 ? NO_ERROR : ERR_IO;
+}
+
+static int shard_u64_write(FILE *const out, uint64_t const *const values, uint64_t count) {
+	uint64_t i, buffer64;
+	for(i = 0; i < count; ++i) {
+		buffer64 = hton64(values[i]);
+		if (fwrite(&buffer64, sizeof buffer64, 1, out) != 1) return ERR_IO;
+	}
+	return NO_ERROR;
+}
+
+static int shard_u64_read(FILE *const in, uint64_t *const values, uint64_t count) {
+	uint64_t i;
+	for(i = 0; i < count; ++i) {
+		if (fread(&values[i], sizeof values[i], 1, in) != 1) return ERR_IO;
+		values[i] = ntoh64(values[i]);
+	}
+	return NO_ERROR;
+}
+
+/*section [begin, end) of in, appended to out*/
+static int shard_copy(FILE *const in, uint64_t begin, uint64_t end, FILE *const out) {
+	uint8_t buffer[SHARD_COPY_BYTES];
+	size_t len;
+	if (fseek(in, (long)begin, SEEK_SET) != 0) return ERR_IO;
+	for(; begin < end; begin += len) {
+		len = end - begin < SHARD_COPY_BYTES ? end - begin : SHARD_COPY_BYTES;
+		if (fread(buffer, 1, len, in) != len || fwrite(buffer, 1, len, out) != len) return ERR_IO;
+	}
+	return NO_ERROR;
+}
+
+int sharded_store(char const *const path, sharded_t const *const sketch, float sparse) {
+	int err;
+	FILE *out, *previous;
+	char *target;
+	uint64_t *offsets, nonzero;
+	long position;
+	ibf_t const *shard;
+	uint32_t i, count;
+	assert(path != NULL);
+	assert(sketch != NULL);
+	count = sketch->dir.count;
+	out = previous = NULL;
+	target = (char*)path;
+	err = NO_ERROR;
+	if ((offsets = (uint64_t*)calloc(count + 1, sizeof(uint64_t))) == NULL) return ERR_ALLOC;
+	if (sketch->previous) {/*possibly the same file: written next to it, then renamed*/
+		if ((target = (char*)malloc(strlen(path) + 5)) == NULL) err = ERR_ALLOC;
+		else sprintf(target, "%s.tmp", path);
+		if (!err && (previous = fopen(sketch->previous, "rb")) == NULL) err = ERR_FILE;
+	}
+	if (!err && (out = fopen(target, "wb")) == NULL) err = ERR_IO;
+	if (!err && fwrite(SHARD_MAGIC, 1, 4, out) != 4) err = ERR_IO;
+	if (!err) err = shard_u32_write(out, count);
+	if (!err) err = shard_u32_write(out, sketch->dir.seed);
+	if (!err) err = shard_u64_write(out, sketch->dir.n, count);
+	position = out ? ftell(out) : 0;
+	if (!err) err = shard_u64_write(out, offsets, count + 1);/*patched once the sections are written*/
+	for(i = 0; i < count && err == NO_ERROR; ++i) {
+		offsets[i] = (uint64_t)ftell(out);
+		shard = &sketch->shards[i];
+		if (shard->data == NULL) err = shard_copy(previous, sketch->dir.offsets[i], sketch->dir.offsets[i + 1], out);
+		else if ((err = ibf_sketch_nonzero(shard, &nonzero)) == NO_ERROR) {
+			err = nonzero < sparse * shard->chunk_size * shard->repetitions ? ibf_sketch_write_sparse(out, shard) : ibf_sketch_write(out, shard);
+		}
+	}
+	if (!err) offsets[count] = (uint64_t)ftell(out);
+	if (!err && fseek(out, position, SEEK_SET) != 0) err = ERR_IO;
+	if (!err) err = shard_u64_write(out, offsets, count + 1);
+	if (out && fclose(out) != 0 && err == NO_ERROR) err = ERR_IO;
+	if (previous) fclose(previous);
+	if (!err && target != path && rename(target, path) != 0) err = ERR_IO;
+	if (target != path) {
+		if (err && out) remove(target);
+		free(target);
+	}
+	free(offsets);
+	return err;
+}
+
+int sharded_destroy(sharded_t *const sketch) {
+	int err;
+	uint32_t i;
+	assert(sketch != NULL);
+	err = NO_ERROR;
+	for(i = 0; sketch->shards && i < sketch->dir.count; ++i) {
+		if (sketch->shards[i].data != NULL || sketch->shards[i].seres != NULL) if (ibf_sketch_destroy(&sketch->shards[i]) != NO_ERROR) err = ERR_RUNTIME;
+	}
+	free(sketch->shards);
+	free(sketch->packed);
+	free(sketch->lens);
+	free(sketch->routes);
+	shard_dir_destroy(&sketch->dir);
+	memset(sketch, 0, sizeof *sketch);
+	return err;
+}
+
+int sharded_is(char const *const path, uint8_t *const sharded) {
+	FILE *in;
+	char magic[4];
+	assert(path != NULL);
+	assert(sharded != NULL);
+	if ((in = fopen(path, "rb")) == NULL) return ERR_FILE;
+	*sharded = fread(magic, 1, 4, in) == 4 && memcmp(magic, SHARD_MAGIC, 4) == 0;
+	fclose(in);
+	return NO_ERROR;
+}
+
+int shard_dir_read(FILE *const in, shard_dir_t *const dir) {
+	char magic[4];
+	uint32_t buffer32, i;
+	assert(in != NULL);
+	assert(dir != NULL);
+	memset(dir, 0, sizeof *dir);
+	if (fread(magic, 1, 4, in) != 4) return ERR_IO;
+	if (memcmp(magic, SHARD_MAGIC, 4) != 0) return ERR_INCOMPATIBLE;
+	if (fread(&buffer32, sizeof buffer32, 1, in) != 1) return ERR_IO;
+	dir->count = ntoh32(buffer32);
+	if (fread(&buffer32, sizeof buffer32, 1, in) != 1) return ERR_IO;
+	dir->seed = ntoh32(buffer32);
+	if (dir->count == 0) return ERR_INCOMPATIBLE;
+	dir->n = (uint64_t*)malloc(dir->count * sizeof(uint64_t));
+	dir->offsets = (uint64_t*)malloc((dir->count + 1) * sizeof(uint64_t));
+	if (dir->n == NULL || dir->offsets == NULL) return ERR_ALLOC;
+	if (shard_u64_read(in, dir->n, dir->count) != NO_ERROR || shard_u64_read(in, dir->offsets, dir->count + 1) != NO_ERROR) return ERR_IO;
+	for(i = 0; i < dir->count; ++i) if (dir->offsets[i] > dir->offsets[i + 1]) return ERR_INCOMPATIBLE;
+	return NO_ERROR;
+}
+
+int shard_dir_destroy(shard_dir_t *const dir) {
+	assert(dir != NULL);
+	free(dir->n);
+	free(dir->offsets);
+	dir->n = dir->offsets = NULL;
+	return NO_ERROR;
+}
+
+int shard_read(FILE *const in, shard_dir_t const *const dir, uint32_t i, ibf_t *const shard) {
+	assert(in != NULL);
+	assert(dir != NULL);
+	if (i >= dir->count) return ERR_OUTOFBOUNDS;
+	if (fseek(in, (long)dir->offsets[i], SEEK_SET) != 0) return ERR_IO;
+	return ibf_sketch_read(in, shard);
+}
+
+int shard_sub_read(FILE *const in, shard_dir_t const *const dir, uint32_t i, ibf_t *const shard) {
+	assert(in != NULL);
+	assert(dir != NULL);
+	if (i >= dir->count) return ERR_OUTOFBOUNDS;
+	if (fseek(in, (long)dir->offsets[i], SEEK_SET) != 0) return ERR_IO;
+	return ibf_sketch_sub_read(in, shard);
+}
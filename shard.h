@@ -0,0 +1,65 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdio.h>
+#include "constants.h"
+#include "ibflib.h"
+
+/*
+ * Sharded sketches: each key is routed by the prefix of a hash of its own (independent of the bucket hashes) to one
+ * of S sketches, the shards, each sized for n/S differences plus a margin and small enough to stay in cache while it
+ * is built or peeled. Shards are independent: they are built, subtracted and peeled in parallel, and a shard too
+ * small for its part of the difference fails alone and can be rebuilt larger while the other ones are kept.
+ *
+ * File: "IBFS", S (uint32), routing seed (uint32), the differences tracked by each shard (S uint64), the offsets of
+ * the sections from the start of the file (S + 1 uint64, the last one being the end of the file), then the sections,
+ * one sketch each in the ibf_sketch_write format (dense or sparse).
+ */
+
+#define SHARD_MAGIC "IBFS"
+#define SHARD_CACHE_BYTES (1 << 20) /*default size of the buckets of a shard, about a L2 cache*/
+#define SHARD_LOAD_Z 3 /*shards track n/S + z * sqrt(n/S) differences, the number of differences of a shard being ~Poisson(n/S)*/
+#define SHARD_NONE 0xFFFFFFFF /*route of a skipped key*/
+
+typedef struct {
+	uint32_t count;/* number of shards */
+	uint32_t seed;/* of the routing hash */
+	uint64_t *n;/* differences tracked by each shard */
+	uint64_t *offsets;/* section of shard i: [offsets[i], offsets[i + 1]) */
+} shard_dir_t;
+
+typedef struct {
+	shard_dir_t dir;/* offsets unused until stored */
+	ibf_t *shards;/* shards[i].data == NULL: kept as it is in the file being resized */
+	char const *previous;/* file being resized, NULL for a new one */
+	uint32_t capacity;/* keys of the batch buffers below */
+	uint8_t *packed;/* keys of the current batch, packed */
+	unsigned int *lens;
+	uint32_t *routes;
+} sharded_t;
+
+int shard_count(unsigned char r, float epsilon, unsigned int n, uint64_t cache_bytes, uint32_t *const count);/*fewest shards whose buckets fit in cache_bytes each*/
+
+uint64_t shard_n(unsigned int n, uint32_t count);
+
+int sharded_init(uint32_t count, unsigned int root_seed, unsigned char r, float epsilon, unsigned int n, uint8_t hash_family, sharded_t *const sketch);
+
+int sharded_resize_init(char const *const path, uint32_t const *const which, uint32_t nwhich, unsigned int root_seed, unsigned char r, float epsilon, uint8_t hash_family, sharded_t *const sketch);/*only the listed shards, for twice their n, are rebuilt*/
+
+int sharded_insert_batch(sharded_t *const sketch, char const *const kmers, uint32_t const *const ends, uint32_t nkeys, unsigned int threads);/*keys kmers[ends[j-1], ends[j]), each thread filling its own shards*/
+
+int sharded_store(char const *const path, sharded_t const *const sketch, float sparse);/*shards with less than a fraction sparse of nonzero buckets are stored sparse*/
+
+int sharded_destroy(sharded_t *const sketch);
+
+int sharded_is(char const *const path, uint8_t *const sharded);
+
+int shard_dir_read(FILE *const in, shard_dir_t *const dir);
+
+int shard_dir_destroy(shard_dir_t *const dir);
+
+int shard_read(FILE *const in, shard_dir_t const *const dir, uint32_t i, ibf_t *const shard);
+
+int shard_sub_read(FILE *const in, shard_dir_t const *const dir, uint32_t i, ibf_t *const shard);/*shard = shard - shard i of the file*/
+
+#endif/*SHARD_H*/
@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "shard_main.h"
+#include "constants.h"
+#include "ibflib.h"
+#include "shard.h"
+#include "list_main.h"
+#include "stats.h"
+
+#include <assert.h>
+#include <pthread.h>
+
+typedef struct {
+    int err;
+    char *listing;/* keys listed, printed in shard order once all shards are done */
+    size_t listing_len;
+    uint64_t listed, remaining;
+} shard_result_t;
+
+typedef struct {
+    char const *ipath, *jpath;
+    shard_dir_t idir, jdir;
+    ibf_t *diffs;/* diff: the differences are kept to be stored, NULL: they are peeled */
+    shard_result_t *results;
+    uint32_t next;/* next shard to be processed */
+    pthread_mutex_t lock;
+} shard_job_t;
+
+typedef struct {
+    shard_job_t *job;
+    ibf_counters_t counters;/* of the shards peeled by this thread */
+} shard_thread_t;
+
+static enum Error shard_run(shard_job_t *job, unsigned int threads);
+static void *shard_worker(void *arg);
+static enum Error shard_job_open(char const *const ipath, char const *const jpath, shard_job_t *job);
+static void shard_job_close(shard_job_t *job);
+
+/*
+ * Shards are independent: each thread takes the next shard, reads it, subtracts the same shard of the second
+ * sketch and peels it into its own buffer. Shards failing to peel are reported on their own and their keys are
+ * dropped, the keys of all the other ones being listed, so that only them have to be rebuilt larger (build --resize).
+ */
+enum Error sharded_list(char const *const ipath, char const *const jpath, unsigned int threads, char const *const command) {
+    shard_job_t job;
+    shard_result_t *result;
+    char *failed;
+    size_t failed_len;
+    FILE *failed_list;
+    uint32_t i, nfailed;
+    enum Error err;
+
+    assert(ipath != NULL);
+    if ((err = shard_job_open(ipath, jpath, &job)) != NO_ERROR) return err;
+    stats_begin(STATS_PEEL);/*loading, subtracting and peeling overlap across shards*/
+    err = shard_run(&job, threads);
+    stats_end(STATS_PEEL);
+    failed = NULL;
+    failed_len = 0;
+    nfailed = 0;
+    if ((failed_list = open_memstream(&failed, &failed_len)) == NULL && err == NO_ERROR) err = ERR_ALLOC;
+    for(i = 0; err == NO_ERROR && i < job.idir.count; ++i) {
+        result = &job.results[i];
+        if (result->err == NO_ERROR) {/*the keys of a failed shard are mostly false pure cells, they are not listed*/
+            if (result->listing_len != 0) fwrite(result->listing, 1, result->listing_len, stdout);
+            continue;
+        }
+        if (result->err == ERR_VALUE) {
+            fprintf(stderr, "[%s] shard %u failed: %llu keys peeled (not listed), %llu nonzero cells left\n", command, i, (unsigned long long)result->listed, (unsigned long long)result->remaining);
+            fprintf(failed_list, "%s%u", nfailed++ ? "," : "", i);
+        } else if (result->err == ERR_INCOMPATIBLE) {
+            fprintf(stderr, "[%s] shard %u: incompatible sketches (resized on one side only?)\n", command, i);
+        } else {
+            fprintf(stderr, "[%s] shard %u: unable to read it\n", command, i);
+        }
+    }
+    if (failed_list) fclose(failed_list);
+    for(i = 0; i < job.idir.count; ++i) if (job.results[i].err != NO_ERROR && (err == NO_ERROR || err == ERR_VALUE)) err = job.results[i].err;/*failed peeling only if nothing worse*/
+    if (nfailed) fprintf(stderr, "[%s] %u of %u shards failed, rebuild them larger on both sides with build --resize %s (same options)\n", command, nfailed, job.idir.count, failed);
+    free(failed);
+    shard_job_close(&job);
+    return err;
+}
+
+enum Error sharded_diff(char const *const ipath, char const *const jpath, char const *const opath, unsigned int threads, double density) {
+    shard_job_t job;
+    sharded_t difference;
+    uint32_t i;
+    enum Error err;
+
+    assert(ipath != NULL && jpath != NULL && opath != NULL);
+    if ((err = shard_job_open(ipath, jpath, &job)) != NO_ERROR) return err;
+    if ((job.diffs = (ibf_t*)calloc(job.idir.count, sizeof(ibf_t))) == NULL) err = ERR_ALLOC;
+    stats_begin(STATS_DIFF);
+    if (err == NO_ERROR) err = shard_run(&job, threads);
+    stats_end(STATS_DIFF);
+    for(i = 0; err == NO_ERROR && i < job.idir.count; ++i) {
+        if ((err = job.results[i].err) == ERR_INCOMPATIBLE) fprintf(stderr, "[diff] shard %u: incompatible sketches (resized on one side only?)\n", i);
+        else if (err != NO_ERROR) fprintf(stderr, "[diff] shard %u: unable to read it\n", i);
+    }
+    if (err == NO_ERROR) {/*a view of the differences under the directory of the first sketch*/
+        memset(&difference, 0, sizeof difference);
+        difference.dir = job.idir;
+        difference.shards = job.diffs;
+        stats_begin(STATS_STORE);
+        if ((err = sharded_store(opath, &difference, (float)density)) != NO_ERROR) fprintf(stderr, "Error saving the difference\n");
+        stats_end(STATS_STORE);
+    }
+    shard_job_close(&job);
+    return err;
+}
+
+static enum Error shard_job_open(char const *const ipath, char const *const jpath, shard_job_t *job) {
+    FILE *in;
+    ibf_t first;
+    enum Error err;
+    memset(job, 0, sizeof *job);
+    job->ipath = ipath;
+    job->jpath = jpath;
+    if ((in = fopen(ipath, "rb")) == NULL || shard_dir_read(in, &job->idir) != NO_ERROR) {
+        fprintf(stderr, "Unable to read the first sharded sketch\n");
+        if (in) fclose(in);
+        shard_job_close(job);
+        return ERR_FILE;
+    }
+    memset(&first, 0, sizeof first);
+    err = shard_read(in, &job->idir, 0, &first);/*the key length of all shards*/
+    fclose(in);
+    #ifdef GLEN
+    if (err == NO_ERROR) binded_len = first.key_len;
+    #endif
+    ibf_sketch_destroy(&first);
+    if (err == NO_ERROR && jpath != NULL) {
+        if ((in = fopen(jpath, "rb")) == NULL || shard_dir_read(in, &job->jdir) != NO_ERROR) {
+            fprintf(stderr, "Unable to read the second sharded sketch\n");
+            err = ERR_FILE;
+        } else if (job->idir.count != job->jdir.count || job->idir.seed != job->jdir.seed) {
+            fprintf(stderr, "Incompatible sharded sketches (different number of shards or seed)\n");
+            err = ERR_INCOMPATIBLE;
+        } else if ((err = shard_read(in, &job->jdir, 0, &first)) == NO_ERROR) {
+            #ifdef GLEN
+            if (binded_len < first.key_len) binded_len = first.key_len;
+            #endif
+            ibf_sketch_destroy(&first);
+        }
+        if (in) fclose(in);
+    } else if (err != NO_ERROR) fprintf(stderr, "Unable to read the first sharded sketch\n");
+    if (err == NO_ERROR && (job->results = (shard_result_t*)calloc(job->idir.count, sizeof(shard_result_t))) == NULL) err = ERR_ALLOC;
+    if (err != NO_ERROR) shard_job_close(job);
+    return err;
+}
+
+static void shard_job_close(shard_job_t *job) {
+    uint32_t i;
+    for(i = 0; job->diffs && i < job->idir.count; ++i) ibf_sketch_destroy(&job->diffs[i]);
+    for(i = 0; job->results && i < job->idir.count; ++i) free(job->results[i].listing);
+    free(job->diffs);
+    free(job->results);
+    shard_dir_destroy(&job->idir);
+    shard_dir_destroy(&job->jdir);
+    memset(job, 0, sizeof *job);
+}
+
+static enum Error shard_run(shard_job_t *job, unsigned int threads) {
+    shard_thread_t *workers;
+    pthread_t *tids;
+    unsigned int t, started;
+    if (threads == 0) threads = 1;
+    if (threads > job->idir.count) threads = job->idir.count;
+    workers = (shard_thread_t*)calloc(threads, sizeof(shard_thread_t));
+    tids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    if (workers == NULL || tids == NULL || pthread_mutex_init(&job->lock, NULL) != 0) {
+        free(workers);
+        free(tids);
+        return ERR_ALLOC;
+    }
+    for(t = 0; t < threads; ++t) workers[t].job = job;
+    for(started = 0; started < threads && pthread_create(&tids[started], NULL, &shard_worker, &workers[started]) == 0; ++started);
+    if (started == 0) shard_worker(&workers[0]);/*no thread available, done by this one*/
+    for(t = 0; t < started; ++t) pthread_join(tids[t], NULL);
+    for(t = 0; t < threads; ++t) ibf_counters_add(&workers[t].counters);
+    pthread_mutex_destroy(&job->lock);
+    free(workers);
+    free(tids);
+    return NO_ERROR;
+}
+
+static void *shard_worker(void *arg) {
+    shard_thread_t *worker;
+    shard_job_t *job;
+    shard_result_t *result;
+    FILE *in, *jn, *listing;
+    ibf_t ibf;
+    ibf_counters_t before, after;
+    uint32_t i;
+    worker = (shard_thread_t*)arg;
+    job = worker->job;
+    in = fopen(job->ipath, "rb");/*a stream per thread, each one seeking to its shards*/
+    jn = job->jpath ? fopen(job->jpath, "rb") : NULL;
+    while (TRUE) {
+        pthread_mutex_lock(&job->lock);
+        i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->idir.count) break;
+        result = &job->results[i];
+        memset(&ibf, 0, sizeof ibf);
+        if (in == NULL || (job->jpath && jn == NULL)) result->err = ERR_FILE;
+        else result->err = shard_read(in, &job->idir, i, &ibf);
+        if (result->err == NO_ERROR && jn) result->err = shard_sub_read(jn, &job->jdir, i, &ibf);
+        if (job->diffs && result->err == NO_ERROR) {
+            job->diffs[i] = ibf;
+            continue;
+        }
+        if (result->err == NO_ERROR) {
+            ibf_counters_get(&before);
+            if ((listing = open_memstream(&result->listing, &result->listing_len)) == NULL) result->err = ERR_ALLOC;
+            #ifdef STORE_WEIGHTS
+            else result->err = ibf_list_counted(&ibf, &print_counted_bucket, listing);
+            #else
+            else result->err = ibf_list_seq(&ibf, &print_exact_bucket, listing);
+            #endif
+            if (listing) fclose(listing);
+            ibf_counters_get(&after);
+            result->listed = after.pure_hits - before.pure_hits;
+            result->remaining = after.remaining_cells;
+            worker->counters.peel_iterations += after.peel_iterations - before.peel_iterations;
+            worker->counters.pure_hits += result->listed;
+            worker->counters.false_pure += after.false_pure - before.false_pure;
+            worker->counters.remaining_cells += result->remaining;
+        }
+        ibf_sketch_destroy(&ibf);
+    }
+    if (in) fclose(in);
+    if (jn) fclose(jn);
+    return NULL;
+}
@@ -0,0 +1,10 @@
+#ifndef SHARD_MAIN_H
+#define SHARD_MAIN_H
+
+#include "err.h"
+
+enum Error sharded_list(char const *const ipath, char const *const jpath, unsigned int threads, char const *const command);/*list (jpath NULL) or difflist of sharded sketches*/
+
+enum Error sharded_diff(char const *const ipath, char const *const jpath, char const *const opath, unsigned int threads, double density);
+
+#endif/*SHARD_MAIN_H*/
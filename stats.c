@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "constants.h"
+#include "ibflib.h"
+#include "stats.h"
+
+#include <assert.h>
+
+static char const *const phase_names[STATS_PHASES] = {"parse", "hash", "insert", "load", "diff", "peel", "store"};
+
+static struct {
+	char const *command;/*NULL if disabled*/
+	double start_wall;
+	double wall[STATS_PHASES], cpu[STATS_PHASES];
+	double phase_wall[STATS_PHASES], phase_cpu[STATS_PHASES];/*start of the running phases*/
+	uint64_t calls[STATS_PHASES];
+} stats;
+
+static double clock_seconds(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats_enable(char const *const command) {
+	assert(command != NULL);
+	stats.command = command;
+	stats.start_wall = clock_seconds(CLOCK_MONOTONIC);
+}
+
+void stats_begin(enum Stats_phase phase) {
+	if (stats.command == NULL) return;
+	stats.phase_wall[phase] = clock_seconds(CLOCK_MONOTONIC);
+	stats.phase_cpu[phase] = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_end(enum Stats_phase phase) {
+	if (stats.command == NULL) return;
+	stats.wall[phase] += clock_seconds(CLOCK_MONOTONIC) - stats.phase_wall[phase];
+	stats.cpu[phase] += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - stats.phase_cpu[phase];
+	++stats.calls[phase];
+}
+
+void stats_print(FILE *const strm) {
+	int i, first;
+	long peak_rss;
+	struct rusage usage;
+	ibf_counters_t counters;
+	if (stats.command == NULL) return;
+	ibf_counters_get(&counters);
+	peak_rss = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+	#ifdef __APPLE__
+	if (peak_rss > 0) peak_rss /= 1024;/*bytes on macOS, KiB elsewhere*/
+	#endif
+	fprintf(strm, "{\"command\":\"%s\",\"wall_s\":%.6f,\"phases\":{", stats.command, clock_seconds(CLOCK_MONOTONIC) - stats.start_wall);
+	for(i = 0, first = TRUE; i < STATS_PHASES; ++i) {
+		if (stats.calls[i] == 0) continue;
+		fprintf(strm, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}", first ? "" : ",", phase_names[i], stats.wall[i], stats.cpu[i]);
+		first = FALSE;
+	}
+	fprintf(strm, "},\"keys_inserted\":%llu,\"keys_skipped\":%llu", (unsigned long long)counters.inserted, (unsigned long long)counters.skipped);
+	fprintf(strm, ",\"peel_iterations\":%llu,\"pure_hits\":%llu,\"false_pure_skips\":%llu,\"remaining_nonzero_cells\":%llu", 
+		(unsigned long long)counters.peel_iterations, (unsigned long long)counters.pure_hits, (unsigned long long)counters.false_pure, (unsigned long long)counters.remaining_cells);
+	fprintf(strm, ",\"peak_rss_kb\":%ld}\n", peak_rss);
+}
@@ -0,0 +1,22 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/*
+ * Run statistics of the ibltseq subcommands (--stats), printed as one JSON object on stderr:
+ * wall and CPU time of each phase, the counters of ibflib (ibf_counters_t) and the peak RSS.
+ * All functions are no-ops until stats_enable is called.
+ */
+
+enum Stats_phase {STATS_PARSE, STATS_HASH, STATS_INSERT, STATS_LOAD, STATS_DIFF, STATS_PEEL, STATS_STORE, STATS_PHASES};
+
+void stats_enable(char const *const command);
+
+void stats_begin(enum Stats_phase phase);
+
+void stats_end(enum Stats_phase phase);
+
+void stats_print(FILE *const strm);
+
+#endif/*STATS_H*/
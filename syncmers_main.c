@@ -38,7 +38,7 @@ enum Error syncmers_main(int argc, char *argv[]) {
     /*char* buffer;*/
     uint32_v_t syncpos;
     uint64_t seed;
-    unsigned short grouplen;
+    unsigned short grouplen, r;
     unsigned int extlen;
 
     fp = NULL;
@@ -51,11 +51,12 @@ enum Error syncmers_main(int argc, char *argv[]) {
     /*buffer = NULL;*/
     seed = 42;
     grouplen = 0;
+    r = 0;
     /*buflen = 0;*/
 
     opt = KETOPT_INIT;
     static ko_longopt_t longopts[] = {{NULL, 0, 0}};
-    while((c = ketopt(&opt, argc, argv, 1, "i:o:k:m:g:S:d:h", longopts)) >= 0) {
+    while((c = ketopt(&opt, argc, argv, 1, "i:o:k:m:g:r:S:d:h", longopts)) >= 0) {
         if (c == 'i') {
             if ((fp = gzopen(opt.arg, "r")) == NULL) {
                 fprintf(stderr, "Unable to open the input file %s\n", opt.arg);
@@ -91,6 +92,13 @@ enum Error syncmers_main(int argc, char *argv[]) {
                 return ERR_OUTOFBOUNDS;
             }
             grouplen = (unsigned short)parsed;
+        } else if (c == 'r') {
+            parsed = strtol(opt.arg, NULL, 10);
+            if (parsed > (unsigned short)-1 || parsed < 0) {
+                fprintf(stderr, "Unable to parse sampling rate\n");
+                return ERR_OUTOFBOUNDS;
+            }
+            r = (unsigned short)parsed;
         } else if (c == 'S') {
             seed = strtoull(opt.arg, NULL, 10);
         } else if (c == 'd') {
@@ -150,27 +158,27 @@ enum Error syncmers_main(int argc, char *argv[]) {
             /*fprintf(stderr, "%u\n", mmpos.a[i]);*/
             if (segmentation) {/*segments*/
                 delta = syncpos.a[i] - j;
-                if (delta <= k) fprintf(oh, "%.*s\n", delta, &seq->seq.s[j]);
+                if (delta <= k) print_fragment(oh, &seq->seq.s[j], delta, seed, r);
             } else if (grouplen) {/*extended syncmers*/
                 if ((syncpos.a[i] + k + grouplen) < seq->seq.l) {// && syncpos.a[i] >= grouplen) {
                     //fprintf(stderr, "%u, %u, pos = %u\n", grouplen, extlen, syncpos.a[i] - grouplen);
-                    fprintf(oh, "%.*s\n", extlen, &seq->seq.s[syncpos.a[i]]);// - grouplen]);
+                    print_fragment(oh, &seq->seq.s[syncpos.a[i]], extlen, seed, r);// - grouplen]);
                 }
             } else {/*simple syncmers*/
-                fprintf(oh, "%.*s\n", mflen, &seq->seq.s[syncpos.a[i]]);
+                print_fragment(oh, &seq->seq.s[syncpos.a[i]], mflen, seed, r);
             }
             j = syncpos.a[i];
         }
         if (segmentation) { /*Add last segment, if needed*/
             delta = seq->seq.l - j;
-            if (delta <= k) fprintf(oh, "%.*s\n", (int)(delta), &seq->seq.s[j]);
+            if (delta <= k) print_fragment(oh, &seq->seq.s[j], (int)(delta), seed, r);
         } else if (grouplen) {
             /*
             Quick and dirty solution, one should scan the sequence in order to find N's, see commented blocks at the end of this file.
             Unfortunately, I am in a hurry and I don't have time to do it properly.
             */
-            fprintf(oh, "%.*s\n", extlen, seq->seq.s);/*print first extended k-mer*/
-            fprintf(oh, "%.*s\n", extlen, &seq->seq.s[seq->seq.l - extlen]);/*print the last extended k-mer*/
+            print_fragment(oh, seq->seq.s, extlen, seed, r);/*print first extended k-mer*/
+            print_fragment(oh, &seq->seq.s[seq->seq.l - extlen], extlen, seed, r);/*print the last extended k-mer*/
         }
     }
     if (seq) kseq_destroy(seq);
@@ -187,7 +195,8 @@ void print_syncmers_help() {
     fprintf(stderr, "\t-k\tk-mer (syncmer) size\n");
     fprintf(stderr, "\t-m\tminimizer size for finding syncmers [k]. \n\t\tm > 0 output each syncmer.\n\t\tm < 0 fragments the input sequence at syncmer positions\n");
     fprintf(stderr, "\t-g\tif a syncmer is found at position p, print seq[p:p+k+g]. Incompatible with m < 0 [0]\n");
-    fprintf(stderr, "\t-S\tseed [42]\n");
+    fprintf(stderr, "\t-r\tsampling rate, keep a fragment if its hash is below max_hash / r [1]\n");
+    fprintf(stderr, "\t-S\tseed (also used for sampling) [42]\n");
     fprintf(stderr, "\t-d\tdebug file\n");
     fprintf(stderr, "\t-h\tshow this help\n");
 }